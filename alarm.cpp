@@ -0,0 +1,141 @@
+/**
+ * @file alarm.cpp
+ *
+ */
+
+/*********************
+ *      INCLUDES
+ *********************/
+#include <math.h>
+#include <stdio.h>
+
+#include <algorithm>
+
+#include "alarm.h"
+#include "pltag.h"
+
+using namespace std;
+
+/*********************
+ * MEMBER FUNCTIONS
+ *********************/
+
+Alarm::Alarm() {
+	_tag = NULL;
+	_rule = ALARM_THRESHOLD;
+	_high = NAN;
+	_low = NAN;
+	_hysteresis = 0;
+	_side = 0;
+	_debounce_ms = 0;
+	_condition = false;
+	_active = false;
+	_conditionTime_ms = 0;
+	_conditionValue = 0;
+	_edgeValue = 0;
+	_havePrev = false;
+	_prevValue = 0;
+	_prevTime_ms = 0;
+}
+
+Alarm::~Alarm() {
+}
+
+void Alarm::setThreshold(PLtag *tag, double high, double low, double hysteresis) {
+	_tag = tag;
+	_rule = ALARM_THRESHOLD;
+	_high = high;
+	_low = low;
+	_hysteresis = fabs(hysteresis);
+}
+
+void Alarm::setRate(PLtag *tag, double rateHigh, double rateLow, double hysteresis) {
+	_tag = tag;
+	_rule = ALARM_RATE;
+	_high = rateHigh;
+	_low = rateLow;
+	_hysteresis = fabs(hysteresis);
+}
+
+void Alarm::setStates(PLtag *tag, const std::vector<int> &states) {
+	_tag = tag;
+	_rule = ALARM_STATE;
+	_states = states;
+}
+
+alarm_edge Alarm::check(int64_t now_ms) {
+	double value;
+	bool condition;
+
+	if ((_tag == NULL) || _tag->isNoread()) {
+		_havePrev = false;				// no rate across a noread
+		return ALARM_EDGE_NONE;
+	}
+	value = _tag->getScaledValue();
+	condition = _evaluate(value, now_ms);
+	if (condition != _condition) {
+		_condition = condition;
+		_conditionTime_ms = now_ms;
+		_conditionValue = value;
+	} else if (condition == _active) {
+		return ALARM_EDGE_NONE;
+	}
+	return process(now_ms);
+}
+
+alarm_edge Alarm::process(int64_t now_ms) {
+	if (_condition == _active) return ALARM_EDGE_NONE;
+	if (now_ms - _conditionTime_ms < _debounce_ms) return ALARM_EDGE_NONE;
+	return _edge();
+}
+
+/**
+ * @returns true if x is outside the high or low limit
+ * the limit which made the condition true clears with the hysteresis
+ */
+bool Alarm::_outside(double x) {
+	double hystHigh = (_condition && (_side > 0)) ? _hysteresis : 0;
+	double hystLow = (_condition && (_side < 0)) ? _hysteresis : 0;
+
+	if (!isnan(_high) && (x > _high - hystHigh)) {
+		_side = 1;
+		return true;
+	}
+	if (!isnan(_low) && (x < _low + hystLow)) {
+		_side = -1;
+		return true;
+	}
+	return false;
+}
+
+/**
+ * @returns the rule condition for a new value
+ */
+bool Alarm::_evaluate(double value, int64_t now_ms) {
+	double rate;
+
+	switch (_rule) {
+	case ALARM_THRESHOLD:
+		return _outside(value);
+	case ALARM_RATE:
+		if (!_havePrev || (now_ms <= _prevTime_ms)) {
+			_havePrev = true;
+			_prevValue = value;
+			_prevTime_ms = now_ms;
+			return _condition;			// no rate yet
+		}
+		rate = (value - _prevValue) * 1000.0 / (now_ms - _prevTime_ms);
+		_prevValue = value;
+		_prevTime_ms = now_ms;
+		return _outside(rate);
+	case ALARM_STATE:
+		return find(_states.begin(), _states.end(), (int)lround(value)) != _states.end();
+	}
+	return false;
+}
+
+alarm_edge Alarm::_edge(void) {
+	_active = _condition;
+	_edgeValue = _conditionValue;
+	return _active ? ALARM_EDGE_RAISED : ALARM_EDGE_CLEARED;
+}
@@ -0,0 +1,119 @@
+/**
+ * @file alarm.h
+ *
+ -----------------------------------------------------------------------------
+  The Alarm class evaluates one alarm rule on the samples of a tag. It is
+  checked right after the tag received a new value, so an alarm is raised
+  or cleared at the read which crosses the limit.
+
+  Rules:
+  threshold - value above the high limit or below the low limit
+  rate      - change per second between two samples above rate_high or
+              below rate_low (negative for a falling value)
+  state     - value is one of a list of states (e.g. rstate)
+
+  The condition of threshold and rate rules clears only when the value is
+  back inside the limit by the hysteresis. A changed condition must hold
+  for the debounce time before the alarm is raised or cleared, a
+  condition which reverts within the debounce time is ignored.
+
+ -----------------------------------------------------------------------------
+ */
+
+#ifndef ALARM_H
+#define ALARM_H
+
+#include <stdint.h>
+
+#include <string>
+#include <vector>
+
+class PLtag;
+
+enum alarm_rule {
+	ALARM_THRESHOLD,
+	ALARM_RATE,
+	ALARM_STATE
+};
+
+enum alarm_edge {
+	ALARM_EDGE_NONE,
+	ALARM_EDGE_RAISED,
+	ALARM_EDGE_CLEARED
+};
+
+class Alarm {
+public:
+	Alarm();
+	~Alarm();
+
+	/**
+	 * alarm when the value is above high or below low, NAN = limit not used
+	 */
+	void setThreshold(PLtag *tag, double high, double low, double hysteresis);
+
+	/**
+	 * alarm when the change [1/s] is above rateHigh or below rateLow, NAN = limit not used
+	 */
+	void setRate(PLtag *tag, double rateHigh, double rateLow, double hysteresis);
+
+	/**
+	 * alarm while the value is one of the states
+	 */
+	void setStates(PLtag *tag, const std::vector<int> &states);
+
+	/**
+	 * @param debounce_ms: time a changed condition must hold [ms]
+	 */
+	void setDebounce(int debounce_ms) { _debounce_ms = debounce_ms; }
+
+	/**
+	 * evaluate the rule with a new value of the tag
+	 * @param now_ms: monotonic time [ms]
+	 * @returns edge of the alarm state
+	 */
+	alarm_edge check(int64_t now_ms);
+
+	/**
+	 * complete a debounce without a new value
+	 * @returns edge of the alarm state
+	 */
+	alarm_edge process(int64_t now_ms);
+
+	/**
+	 * @returns true while a changed condition is within the debounce time
+	 */
+	bool isPending(void) { return _condition != _active; }
+
+	bool isActive(void) { return _active; }
+	PLtag *getTag(void) { return _tag; }
+
+	/**
+	 * @returns value of the tag at the last edge
+	 */
+	double getEdgeValue(void) { return _edgeValue; }
+
+private:
+	bool _outside(double x);
+	bool _evaluate(double value, int64_t now_ms);
+	alarm_edge _edge(void);
+
+	PLtag *_tag;
+	alarm_rule _rule;
+	double _high;					// threshold or rate limits
+	double _low;
+	double _hysteresis;
+	int _side;						// limit of a true condition, 1 = high, -1 = low
+	std::vector<int> _states;
+	int _debounce_ms;
+	bool _condition;				// rule condition of the last value
+	bool _active;					// debounced alarm state
+	int64_t _conditionTime_ms;		// time the condition changed
+	double _conditionValue;			// value which changed the condition
+	double _edgeValue;
+	bool _havePrev;					// previous sample for the rate
+	double _prevValue;
+	int64_t _prevTime_ms;
+};
+
+#endif /* ALARM_H */
@@ -0,0 +1,144 @@
+/**
+ * @file energy.cpp
+ *
+ */
+
+/*********************
+ *      INCLUDES
+ *********************/
+#include <stdio.h>
+#include <string.h>
+
+#include "energy.h"
+#include "pltag.h"
+
+using namespace std;
+
+/*********************
+ * MEMBER FUNCTIONS
+ *********************/
+
+EnergyIntegrator::EnergyIntegrator() {
+	_input = NULL;
+	_voltage = NULL;
+	_counter = false;
+	_maxGap_ms = 0;
+	_rollover = 0;
+	_inputSeq = 0;
+	_havePrev = false;
+	_prevTime_ms = 0;
+	_prevInput = 0;
+	_prevPower = 0;
+	_gaps = 0;
+	_dayChanged = false;
+	memset(&_totals, 0, sizeof(_totals));
+	_totals.day = -1;
+}
+
+EnergyIntegrator::~EnergyIntegrator() {
+}
+
+void EnergyIntegrator::setCurrent(const char *name, PLtag *current, PLtag *voltage, double maxGap) {
+	_name = name;
+	_input = current;
+	_voltage = voltage;
+	_counter = false;
+	_maxGap_ms = maxGap * 1000;
+}
+
+void EnergyIntegrator::setCounter(const char *name, PLtag *counter, PLtag *voltage, double rollover) {
+	_name = name;
+	_input = counter;
+	_voltage = voltage;
+	_counter = true;
+	_rollover = rollover;
+}
+
+bool EnergyIntegrator::update(int today) {
+	double input, voltage = 0, power, delta, hours;
+	int64_t time_ms;
+
+	if (_input == NULL) return false;
+	if (today != _totals.day) _newDay(today);
+	if (_input->updateSeq == _inputSeq) return false;		// no new sample
+	_inputSeq = _input->updateSeq;		// only advanced by successful reads
+	input = _input->getScaledValue();
+	time_ms = _input->updateTime_ms;
+	if ((_voltage != NULL) && !_voltage->isNoread() && (_voltage->getLastUpdateTime() != 0))
+		voltage = _voltage->getScaledValue();
+	power = input * voltage;
+
+	if (_counter) {
+		if (_havePrev) {
+			delta = input - _prevInput;
+			if (delta < 0) delta = (_rollover > 0) ? delta + _rollover : 0;		// rollover or reset
+			_add(delta, delta * voltage);
+		}
+	} else if (_havePrev) {
+		if ((time_ms - _prevTime_ms > _maxGap_ms) || (time_ms < _prevTime_ms)) {
+			_gaps++;			// restart after the gap
+		} else {
+			hours = (time_ms - _prevTime_ms) / 3600000.0;
+			_add(((input + _prevInput) / 2) * hours, ((power + _prevPower) / 2) * hours);		// trapezoidal
+		}
+	}
+	_prevInput = input;
+	_prevPower = power;
+	_prevTime_ms = time_ms;
+	_havePrev = true;
+	return true;
+}
+
+bool EnergyIntegrator::takeDayChange(void) {
+	bool changed = _dayChanged;
+	_dayChanged = false;
+	return changed;
+}
+
+void EnergyIntegrator::_add(double ah, double wh) {
+	_totals.totalAh += ah;
+	_totals.totalWh += wh;
+	_totals.dayAh += ah;
+	_totals.dayWh += wh;
+}
+
+/**
+ * keep the totals of the previous day and restart the day totals
+ */
+void EnergyIntegrator::_newDay(int today) {
+	if (_totals.day >= 0) {
+		// the totals of a day which passed without a run are not known
+		_totals.prevDayAh = (today == _totals.day + 1) ? _totals.dayAh : 0;
+		_totals.prevDayWh = (today == _totals.day + 1) ? _totals.dayWh : 0;
+		_dayChanged = true;
+	}
+	_totals.day = today;
+	_totals.dayAh = 0;
+	_totals.dayWh = 0;
+}
+
+void EnergyIntegrator::save(FILE *fp) {
+	fprintf(fp, "%s %.9g %.9g %d %.9g %.9g %.9g %.9g %d %.9g\n", _name.c_str(), _totals.totalAh, _totals.totalWh,
+		_totals.day, _totals.dayAh, _totals.dayWh, _totals.prevDayAh, _totals.prevDayWh, (_counter && _havePrev) ? 1 : 0,
+		(_counter && _havePrev) ? _prevInput : 0);
+}
+
+bool EnergyIntegrator::restore(const char *line) {
+	char name[64];
+	energy_totals totals;
+	int fields, counterValid = 0;
+	double counter = 0;
+
+	// lines without the counter fields were written by an older version
+	fields = sscanf(line, "%63s %lf %lf %d %lf %lf %lf %lf %d %lf", name, &totals.totalAh, &totals.totalWh, &totals.day,
+		&totals.dayAh, &totals.dayWh, &totals.prevDayAh, &totals.prevDayWh, &counterValid, &counter);
+	if ((fields != 8) && (fields != 10)) return false;
+	if (_name != name) return false;
+	_totals = totals;
+	if (_counter && (fields == 10) && counterValid) {
+		// the increments while plbridge was not running are added with the next sample
+		_prevInput = counter;
+		_havePrev = true;
+	}
+	return true;
+}
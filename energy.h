@@ -0,0 +1,111 @@
+/**
+ * @file energy.h
+ *
+ -----------------------------------------------------------------------------
+  The EnergyIntegrator class accumulates Ah and Wh from the samples of a
+  current tag (integrated over time) or of a counter tag (Ah counter of
+  the PL device, the increments are added up and a rollover of the
+  counter is detected). Wh are computed with the voltage tag.
+
+  Samples are taken at the (monotonic) time the tag received its value.
+  An interval between two current samples which is longer than the
+  maximum gap is not integrated, the integrator restarts after the gap.
+
+  The accumulators hold the totals, the current day and the previous day.
+  They are saved to and restored from a state file, one line per
+  integrator: name totalAh totalWh day dayAh dayWh prevDayAh prevDayWh
+  counterValid counter (last counter value, counter mode only)
+
+ -----------------------------------------------------------------------------
+ */
+
+#ifndef ENERGY_H
+#define ENERGY_H
+
+#include <stdint.h>
+#include <stdio.h>
+
+#include <string>
+
+class PLtag;
+
+struct energy_totals {
+	double totalAh;
+	double totalWh;
+	int day;						// local day number of dayAh/dayWh
+	double dayAh;
+	double dayWh;
+	double prevDayAh;				// totals of the previous day
+	double prevDayWh;
+};
+
+class EnergyIntegrator {
+public:
+	EnergyIntegrator();
+	~EnergyIntegrator();
+
+	/**
+	 * integrate a current [A]
+	 * @param voltage: voltage tag [V], NULL for Ah only
+	 * @param maxGap: longest interval between samples which is integrated [s]
+	 */
+	void setCurrent(const char *name, PLtag *current, PLtag *voltage, double maxGap);
+
+	/**
+	 * add up the increments of an Ah counter
+	 * @param rollover: counter range, a decrease is a rollover, 0 = a decrease is a reset of the counter
+	 */
+	void setCounter(const char *name, PLtag *counter, PLtag *voltage, double rollover);
+
+	/**
+	 * process a new sample of the input tag
+	 * @param today: local day number, the day totals restart on a new day
+	 * @returns true if a new sample was processed
+	 */
+	bool update(int today);
+
+	const char *getName(void) { return _name.c_str(); }
+	const energy_totals &totals(void) { return _totals; }
+
+	/**
+	 * @returns number of intervals which were not integrated (gaps)
+	 */
+	unsigned long gaps(void) { return _gaps; }
+
+	/**
+	 * @returns true if the day totals restarted since the last call
+	 */
+	bool takeDayChange(void);
+
+	/**
+	 * write the state as one line
+	 */
+	void save(FILE *fp);
+
+	/**
+	 * restore the state from a line written by save()
+	 * @returns true if the line belongs to this integrator
+	 */
+	bool restore(const char *line);
+
+private:
+	void _add(double ah, double wh);
+	void _newDay(int today);
+
+	std::string _name;
+	PLtag *_input;					// current or counter tag
+	PLtag *_voltage;
+	bool _counter;					// input is an Ah counter
+	double _maxGap_ms;
+	double _rollover;
+	unsigned long _inputSeq;		// last sample processed
+	bool _havePrev;					// previous sample is valid
+	int64_t _prevTime_ms;
+	double _prevInput;
+	double _prevPower;				// [W] (current mode)
+	unsigned long _gaps;
+	bool _dayChanged;
+	energy_totals _totals;
+};
+
+#endif /* ENERGY_H */
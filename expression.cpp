@@ -0,0 +1,248 @@
+/**
+ * @file expression.cpp
+ *
+ */
+
+/*********************
+ *      INCLUDES
+ *********************/
+#include <ctype.h>
+#include <math.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include <algorithm>
+
+#include "expression.h"
+#include "pltag.h"
+
+using namespace std;
+
+/*********************
+ * MEMBER FUNCTIONS
+ *********************/
+
+Expression::Expression() {
+	_depth = 0;
+	_maxDepth = 0;
+	_text = NULL;
+	_pos = NULL;
+	_lookup = NULL;
+}
+
+Expression::~Expression() {
+}
+
+int Expression::compile(const char *text, PLtag *(*lookup)(const char *name)) {
+	_code.clear();
+	_inputs.clear();
+	_error.clear();
+	_depth = 0;
+	_maxDepth = 0;
+	if ((text == NULL) || (lookup == NULL)) return -1;
+	_text = text;
+	_pos = text;
+	_lookup = lookup;
+
+	if (!_parse_sum()) return -1;
+	_skip_space();
+	if (*_pos != 0) {
+		_fail("unexpected character");
+		return -1;
+	}
+	_stack.resize(_maxDepth);
+	return 0;
+}
+
+bool Expression::evaluate(double *result) {
+	int sp = 0;				// number of values on the stack
+	double *stack = _stack.data();
+
+	if (_code.empty()) return false;
+	for (size_t index = 0; index < _inputs.size(); index++) {
+		if (_inputs[index]->isNoread() || (_inputs[index]->getLastUpdateTime() == 0)) return false;
+	}
+	for (size_t index = 0; index < _code.size(); index++) {
+		const expr_op &op = _code[index];
+		switch (op.code) {
+		case EXPR_CONST:
+			stack[sp++] = op.constant;
+			break;
+		case EXPR_TAG:
+			stack[sp++] = op.tag->getScaledValue();
+			break;
+		case EXPR_ADD:
+			sp--;
+			stack[sp - 1] += stack[sp];
+			break;
+		case EXPR_SUB:
+			sp--;
+			stack[sp - 1] -= stack[sp];
+			break;
+		case EXPR_MUL:
+			sp--;
+			stack[sp - 1] *= stack[sp];
+			break;
+		case EXPR_DIV:
+			sp--;
+			stack[sp - 1] /= stack[sp];
+			break;
+		case EXPR_NEG:
+			stack[sp - 1] = -stack[sp - 1];
+			break;
+		case EXPR_MIN:
+			sp--;
+			stack[sp - 1] = min(stack[sp - 1], stack[sp]);
+			break;
+		case EXPR_MAX:
+			sp--;
+			stack[sp - 1] = max(stack[sp - 1], stack[sp]);
+			break;
+		case EXPR_ABS:
+			stack[sp - 1] = fabs(stack[sp - 1]);
+			break;
+		}
+	}
+	if (!isfinite(stack[0])) return false;		// e.g. division by zero
+	*result = stack[0];
+	return true;
+}
+
+/**
+ * sum: product { (+|-) product }
+ */
+bool Expression::_parse_sum(void) {
+	char op;
+
+	if (!_parse_product()) return false;
+	for (;;) {
+		_skip_space();
+		op = *_pos;
+		if ((op != '+') && (op != '-')) return true;
+		_pos++;
+		if (!_parse_product()) return false;
+		_emit((op == '+') ? EXPR_ADD : EXPR_SUB, -1);
+	}
+}
+
+/**
+ * product: unary { (*|/) unary }
+ */
+bool Expression::_parse_product(void) {
+	char op;
+
+	if (!_parse_unary()) return false;
+	for (;;) {
+		_skip_space();
+		op = *_pos;
+		if ((op != '*') && (op != '/')) return true;
+		_pos++;
+		if (!_parse_unary()) return false;
+		_emit((op == '*') ? EXPR_MUL : EXPR_DIV, -1);
+	}
+}
+
+/**
+ * unary: [-|+] unary | primary
+ */
+bool Expression::_parse_unary(void) {
+	_skip_space();
+	if (*_pos == '-') {
+		_pos++;
+		if (!_parse_unary()) return false;
+		_emit(EXPR_NEG, 0);
+		return true;
+	}
+	if (*_pos == '+') {
+		_pos++;
+		return _parse_unary();
+	}
+	return _parse_primary();
+}
+
+/**
+ * primary: number | name | function ( sum [, sum] ) | ( sum )
+ */
+bool Expression::_parse_primary(void) {
+	const char *start;
+	char *end;
+	double number;
+	string name;
+	PLtag *tag;
+	expr_opcode function;
+	int args;
+
+	_skip_space();
+	if (*_pos == '(') {
+		_pos++;
+		if (!_parse_sum()) return false;
+		_skip_space();
+		if (*_pos != ')') return _fail("missing ')'");
+		_pos++;
+		return true;
+	}
+	if (isdigit((unsigned char)*_pos) || (*_pos == '.')) {
+		number = strtod(_pos, &end);
+		if (end == _pos) return _fail("invalid number");
+		_pos = end;
+		_emit(EXPR_CONST, 1, number);
+		return true;
+	}
+	if (!isalpha((unsigned char)*_pos) && (*_pos != '_')) return _fail("value expected");
+
+	start = _pos;
+	while (isalnum((unsigned char)*_pos) || (*_pos == '_')) _pos++;
+	name.assign(start, _pos - start);
+	_skip_space();
+
+	if (*_pos == '(') {
+		if (name == "min") { function = EXPR_MIN; args = 2; }
+		else if (name == "max") { function = EXPR_MAX; args = 2; }
+		else if (name == "abs") { function = EXPR_ABS; args = 1; }
+		else return _fail("unknown function");
+		_pos++;
+		for (int arg = 0; arg < args; arg++) {
+			if (arg > 0) {
+				if (*_pos != ',') return _fail("missing ','");
+				_pos++;
+			}
+			if (!_parse_sum()) return false;
+			_skip_space();
+		}
+		if (*_pos != ')') return _fail("missing ')'");
+		_pos++;
+		_emit(function, 1 - args);
+		return true;
+	}
+
+	tag = _lookup(name.c_str());
+	if (tag == NULL) {
+		_pos = start;
+		return _fail(("unknown tag <" + name + ">").c_str());
+	}
+	if (find(_inputs.begin(), _inputs.end(), tag) == _inputs.end()) _inputs.push_back(tag);
+	_emit(EXPR_TAG, 1, 0, tag);
+	return true;
+}
+
+void Expression::_emit(expr_opcode code, int stackChange, double constant, PLtag *tag) {
+	expr_op op;
+	op.code = code;
+	op.constant = constant;
+	op.tag = tag;
+	_code.push_back(op);
+	_depth += stackChange;
+	if (_depth > _maxDepth) _maxDepth = _depth;
+}
+
+void Expression::_skip_space(void) {
+	while (isspace((unsigned char)*_pos)) _pos++;
+}
+
+bool Expression::_fail(const char *message) {
+	char position[32];
+	snprintf(position, sizeof(position), " at position %d", (int)(_pos - _text) + 1);
+	_error = string(message) + position;
+	return false;
+}
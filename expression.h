@@ -0,0 +1,94 @@
+/**
+ * @file expression.h
+ *
+ -----------------------------------------------------------------------------
+  The Expression class computes a value from other tags. The expression
+  text is parsed once into byte code for a small stack machine, tag names
+  are resolved to the tags at that time, so evaluating only walks the
+  byte code.
+
+  Syntax: numbers, tag names, + - * / unary -, parentheses and the
+  functions min(a, b), max(a, b), abs(a).
+  Tag names start with a letter or '_', followed by letters, digits, '_'.
+
+ -----------------------------------------------------------------------------
+ */
+
+#ifndef EXPRESSION_H
+#define EXPRESSION_H
+
+#include <stdint.h>
+
+#include <string>
+#include <vector>
+
+class PLtag;
+
+enum expr_opcode {
+	EXPR_CONST,
+	EXPR_TAG,
+	EXPR_ADD,
+	EXPR_SUB,
+	EXPR_MUL,
+	EXPR_DIV,
+	EXPR_NEG,
+	EXPR_MIN,
+	EXPR_MAX,
+	EXPR_ABS
+};
+
+struct expr_op {
+	uint8_t code;					// expr_opcode
+	double constant;				// EXPR_CONST
+	PLtag *tag;						// EXPR_TAG
+};
+
+class Expression {
+public:
+	Expression();
+	~Expression();
+
+	/**
+	 * parse an expression into byte code
+	 * @param lookup: resolves a tag name, returns NULL if the name is unknown
+	 * @returns 0 on success, -1 on failure (see error())
+	 */
+	int compile(const char *text, PLtag *(*lookup)(const char *name));
+
+	/**
+	 * evaluate the expression with the current scaled values of the input tags
+	 * @returns false if an input has no valid value or the result is not a finite number
+	 */
+	bool evaluate(double *result);
+
+	/**
+	 * @returns the tags used by the expression, each tag once
+	 */
+	const std::vector<PLtag *> &inputs(void) { return _inputs; }
+
+	/**
+	 * @returns description of the last compile error
+	 */
+	const std::string &error(void) { return _error; }
+
+private:
+	bool _parse_sum(void);
+	bool _parse_product(void);
+	bool _parse_unary(void);
+	bool _parse_primary(void);
+	void _emit(expr_opcode code, int stackChange, double constant = 0, PLtag *tag = NULL);
+	void _skip_space(void);
+	bool _fail(const char *message);
+
+	std::vector<expr_op> _code;
+	std::vector<PLtag *> _inputs;
+	std::vector<double> _stack;		// evaluation stack, sized at compile time
+	int _depth;						// stack depth while compiling
+	int _maxDepth;
+	const char *_text;
+	const char *_pos;				// parse position
+	PLtag *(*_lookup)(const char *name);
+	std::string _error;
+};
+
+#endif /* EXPRESSION_H */
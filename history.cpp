@@ -0,0 +1,222 @@
+/**
+ * @file history.cpp
+ *
+ */
+
+/*********************
+ *      INCLUDES
+ *********************/
+#include <errno.h>
+#include <stdio.h>
+#include <string.h>
+#include <unistd.h>
+
+#include "history.h"
+#include "plxx.h"
+
+using namespace std;
+
+/*********************
+ * MEMBER FUNCTIONS
+ *********************/
+
+PLhistory::PLhistory() {
+	_open = false;
+	memset(&_header, 0, sizeof(_header));
+	_header.completeDate = -1;
+	_header.downloadDate = -1;
+	_allLinks = 0;
+	_changed = 0;
+}
+
+PLhistory::~PLhistory() {
+}
+
+int PLhistory::localDay(time_t t) {
+	struct tm tm;
+	localtime_r(&t, &tm);
+	return (int)((t + tm.tm_gmtoff) / 86400);
+}
+
+int PLhistory::open(bool eeprom, int start, int days, int daySize, const char *cacheFile, int links) {
+	history_cache_header fileHeader;
+	history_unpublished entry;
+	uint32_t count;
+	size_t size;
+	FILE *fp;
+
+	if ((cacheFile == NULL) || (start < 0) || (days < 1) || (daySize < 1) || (start + (days * daySize) > 256) ||
+		(links < 1) || (links > 32)) return -1;
+	_fileName = cacheFile;
+	memset(&_header, 0, sizeof(_header));
+	_header.magic = HISTORY_MAGIC;
+	_header.version = HISTORY_VERSION;
+	_header.eeprom = eeprom ? 1 : 0;
+	_header.start = start;
+	_header.days = days;
+	_header.daySize = daySize;
+	_header.completeDate = -1;
+	_header.downloadDate = -1;
+	size = days * daySize;
+	_complete.assign(size, 0);
+	_pending.assign(size, 0);
+	_unpublished.clear();
+	_allLinks = (links == 32) ? 0xFFFFFFFF : (1U << links) - 1;
+	_changed = 0;
+	_open = true;
+
+	fp = fopen(cacheFile, "rb");
+	if (fp == NULL) return 0;			// no cache yet
+	if ((fread(&fileHeader, sizeof(fileHeader), 1, fp) == 1) && (fileHeader.magic == HISTORY_MAGIC) &&
+		((fileHeader.version == 1) || (fileHeader.version == HISTORY_VERSION)) && (fileHeader.eeprom == _header.eeprom) &&
+		(fileHeader.start == _header.start) && (fileHeader.days == _header.days) && (fileHeader.daySize == _header.daySize) &&
+		(fread(_complete.data(), size, 1, fp) == 1) && (fread(_pending.data(), size, 1, fp) == 1)) {
+		if ((fileHeader.version == HISTORY_VERSION) && (fread(&count, sizeof(count), 1, fp) == 1)) {
+			while ((count-- > 0) && (fread(&entry, sizeof(entry), 1, fp) == 1)) {
+				entry.links &= _allLinks;		// the number of links may have changed
+				if (entry.links != 0) _unpublished.push_back(entry);
+			}
+		}
+		fileHeader.version = HISTORY_VERSION;
+		_header = fileHeader;
+	} else {
+		fprintf(stderr, "%s: discarding cache %s (different region)\n", __func__, cacheFile);
+		_complete.assign(size, 0);
+		_pending.assign(size, 0);
+	}
+	fclose(fp);
+	return 0;
+}
+
+bool PLhistory::due(time_t now, int startHour) {
+	struct tm tm;
+	int today = localDay(now);
+
+	if (!_open) return false;
+	if (_header.downloadDate == today) return true;		// in progress
+	if (_header.completeDate >= today) return false;		// done for today
+	localtime_r(&now, &tm);
+	return tm.tm_hour >= startHour;
+}
+
+int PLhistory::step(Plxx *pl, time_t now, int maxBytes) {
+	int today = localDay(now);
+	int total = _header.days * _header.daySize;
+	int count = 0;
+	int retVal = 0;
+	uint8_t address;
+
+	if (!_open || (pl == NULL)) return -1;
+	if (_header.downloadDate != today) {
+		// start a new download, a stale one from a previous day is discarded
+		_header.downloadDate = today;
+		_header.nextByte = 0;
+	}
+	while ((count < maxBytes) && (_header.nextByte < total)) {
+		address = (uint8_t)(_header.start + _header.nextByte);
+		if (_header.eeprom) retVal = pl->read_EEPROM(address, &_pending[_header.nextByte]);
+		else retVal = pl->read_RAM(address, &_pending[_header.nextByte]);
+		if (retVal < 0) break;
+		_header.nextByte++;
+		count++;
+	}
+	if (_header.nextByte >= total) _finish();
+	_save();
+	return (retVal < 0) ? -1 : count;
+}
+
+/**
+ * compare the finished download with the previous one and make it the complete download
+ * new or changed days are added to the unpublished days, days which dropped out of the region are removed
+ */
+void PLhistory::_finish(void) {
+	int shift = (_header.completeDate < 0) ? _header.days : _header.downloadDate - _header.completeDate;
+	int size = _header.daySize;
+	int date;
+	size_t n;
+
+	for (n = 0; n < _unpublished.size(); ) {
+		if (_unpublished[n].date <= _header.downloadDate - _header.days) _unpublished.erase(_unpublished.begin() + n);
+		else n++;
+	}
+	for (int index = 0; index < _header.days; index++) {
+		// day <index> of this download was day <index - shift> of the previous download
+		if ((index - shift < 0) || (index - shift >= _header.days) ||
+			(memcmp(&_pending[index * size], &_complete[(index - shift) * size], size) != 0)) {
+			date = _header.downloadDate - index;
+			for (n = 0; (n < _unpublished.size()) && (_unpublished[n].date != date); n++);
+			if (n < _unpublished.size()) _unpublished[n].links = _allLinks;
+			else _unpublished.push_back({ date, _allLinks });
+			_changed++;
+		}
+	}
+	_complete = _pending;
+	_header.completeDate = _header.downloadDate;
+	_header.downloadDate = -1;
+	_header.nextByte = 0;
+}
+
+int PLhistory::takeChanged(void) {
+	int changed = _changed;
+	_changed = 0;
+	return changed;
+}
+
+std::vector<int> PLhistory::unpublished(void) {
+	std::vector<int> dates;
+	for (const history_unpublished &entry : _unpublished) dates.push_back(entry.date);
+	return dates;
+}
+
+bool PLhistory::isUnpublished(int date, int link) {
+	for (const history_unpublished &entry : _unpublished) {
+		if (entry.date == date) return (entry.links & (1U << link)) != 0;
+	}
+	return false;
+}
+
+void PLhistory::published(int date, int link) {
+	for (size_t n = 0; n < _unpublished.size(); n++) {
+		if (_unpublished[n].date != date) continue;
+		_unpublished[n].links &= ~(1U << link);
+		if (_unpublished[n].links == 0) {
+			// only saved when the day is done, a restart may publish it to a link again
+			_unpublished.erase(_unpublished.begin() + n);
+			_save();
+		}
+		return;
+	}
+}
+
+const uint8_t *PLhistory::day(int date) {
+	int index = _header.completeDate - date;
+	if ((_header.completeDate < 0) || (index < 0) || (index >= _header.days)) return NULL;
+	return &_complete[index * _header.daySize];
+}
+
+/**
+ * write header, both downloads and the unpublished days to the cache file
+ * the file is replaced atomically
+ * @returns 0 on success, -1 on failure
+ */
+int PLhistory::_save(void) {
+	string tmpName = _fileName + ".tmp";
+	FILE *fp = fopen(tmpName.c_str(), "wb");
+	uint32_t count = _unpublished.size();
+	bool ok;
+
+	if (fp == NULL) {
+		fprintf(stderr, "%s: unable to write %s: %s\n", __func__, tmpName.c_str(), strerror(errno));
+		return -1;
+	}
+	ok = (fwrite(&_header, sizeof(_header), 1, fp) == 1) && (fwrite(_complete.data(), _complete.size(), 1, fp) == 1) &&
+		(fwrite(_pending.data(), _pending.size(), 1, fp) == 1) && (fwrite(&count, sizeof(count), 1, fp) == 1) &&
+		((count == 0) || (fwrite(_unpublished.data(), sizeof(history_unpublished), count, fp) == count));
+	if (fclose(fp) != 0) ok = false;
+	if (!ok || (rename(tmpName.c_str(), _fileName.c_str()) != 0)) {
+		fprintf(stderr, "%s: unable to write %s\n", __func__, _fileName.c_str());
+		unlink(tmpName.c_str());
+		return -1;
+	}
+	return 0;
+}
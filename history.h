@@ -0,0 +1,152 @@
+/**
+ * @file history.h
+ *
+ -----------------------------------------------------------------------------
+  The PLhistory class downloads the daily history region of the PL device
+  once per day and keeps it in a cache file.
+
+  The download is done in small steps so it can be interleaved with the
+  cyclic reads. The progress is saved after every step, a download which
+  was interrupted (e.g. restart) resumes where it stopped. When the
+  download is complete it is compared with the previous download, only
+  new or changed days are reported.
+
+  History day 0 is the most recent day in the region. The days of the
+  previous download are shifted by the number of days between both
+  downloads before they are compared.
+
+  New or changed days are kept in the cache by their date (local day
+  number of the download minus the day index) until every link has
+  published them, or until they drop out of the region.
+
+  File layout: history_cache_header, complete download, download in
+  progress, history_unpublished entries
+
+ -----------------------------------------------------------------------------
+ */
+
+#ifndef HISTORY_H
+#define HISTORY_H
+
+#include <stdint.h>
+#include <time.h>
+
+#include <string>
+#include <vector>
+
+class Plxx;
+
+#define HISTORY_MAGIC 0x48484C50			// "PLHH"
+#define HISTORY_VERSION 2				// 1: no unpublished entries
+
+struct history_cache_header {
+	uint32_t magic;
+	uint16_t version;
+	uint8_t eeprom;						// region is in EEPROM (1) or RAM (0)
+	uint8_t reserved;
+	uint16_t start;						// first address of the region
+	uint16_t days;
+	uint16_t daySize;					// bytes per day
+	uint16_t nextByte;					// progress of the download in progress
+	int32_t completeDate;				// local day number of the last complete download, -1 = none
+	int32_t downloadDate;				// local day number of the download in progress, -1 = none
+};
+
+/**
+ * a new or changed day which has not been published to all links
+ */
+struct history_unpublished {
+	int32_t date;						// local day number of the day in the region
+	uint32_t links;						// bit mask of the links still to publish to
+};
+
+class PLhistory {
+public:
+	PLhistory();
+	~PLhistory();
+
+	/**
+	 * define the history region and load the cache
+	 * a cache which was written for a different region is discarded
+	 * @param eeprom: region is in EEPROM, otherwise RAM
+	 * @param start: first address
+	 * @param days: number of days in the region
+	 * @param daySize: bytes per day, days * daySize must fit into the address space
+	 * @param cacheFile: cache file path
+	 * @param links: number of links the new or changed days are published to
+	 * @returns 0 on success, -1 on failure
+	 */
+	int open(bool eeprom, int start, int days, int daySize, const char *cacheFile, int links);
+
+	/**
+	 * @returns true if the region is configured
+	 */
+	bool isOpen(void) { return _open; }
+
+	/**
+	 * @param startHour: local hour from which the daily download is due
+	 * @returns true if a download is due or in progress
+	 */
+	bool due(time_t now, int startHour);
+
+	/**
+	 * read the next bytes of the region, a new download is started if none is in progress
+	 * @param maxBytes: maximum number of reads
+	 * @returns number of bytes read, -1 if a read failed (the download resumes at the failed byte)
+	 */
+	int step(Plxx *pl, time_t now, int maxBytes);
+
+	/**
+	 * get and clear the number of days which were new or changed in the last complete download
+	 */
+	int takeChanged(void);
+
+	/**
+	 * @returns dates (local day numbers) of the days which are not published to all links
+	 */
+	std::vector<int> unpublished(void);
+
+	/**
+	 * @returns true if the day is not published to the link yet
+	 */
+	bool isUnpublished(int date, int link);
+
+	/**
+	 * the day was published to the link, it is removed when all links have it
+	 */
+	void published(int date, int link);
+
+	int days(void) { return _header.days; }
+	int daySize(void) { return _header.daySize; }
+
+	/**
+	 * @param date: local day number of the day in the region
+	 * @returns bytes of the day of the last complete download, NULL if it is not in the region
+	 */
+	const uint8_t *day(int date);
+
+	/**
+	 * @returns local day number of the last complete download, -1 if there is none
+	 */
+	int completeDate(void) { return _header.completeDate; }
+
+	/**
+	 * @returns local day number (days since epoch in local time)
+	 */
+	static int localDay(time_t t);
+
+private:
+	int _save(void);
+	void _finish(void);
+
+	bool _open;
+	std::string _fileName;
+	history_cache_header _header;
+	std::vector<uint8_t> _complete;		// last complete download
+	std::vector<uint8_t> _pending;		// download in progress
+	std::vector<history_unpublished> _unpublished;
+	uint32_t _allLinks;					// mask of all links
+	int _changed;						// days changed by the last complete download
+};
+
+#endif /* HISTORY_H */
@@ -15,12 +15,14 @@
 #include <stdlib.h>
 #include <stdio.h>
 #include <string.h>
+#include <math.h>
 #include <time.h>
 #include <unistd.h>
 #include <syslog.h>
 
 #include <stdexcept>
 #include <iostream>
+#include <algorithm>
 
 #include "mqtt.h"
 
@@ -33,6 +35,19 @@
 #define MQTT_BROKER_DEFAULT_PORT 1883
 #define MQTT_BROKER_DEFAULT_KEEPALIVE 60
 #define MQTT_RETAIN_DEFAULT false
+#define MQTT_MAX_QUEUED_DEFAULT 1000           // messages waiting to be sent
+#define MQTT_BACKOFF_MIN_DEFAULT 1000          // [ms] first reconnect delay
+#define MQTT_BACKOFF_MAX_DEFAULT 60000         // [ms] reconnect delay limit
+#define MQTT_FAILOVER_DELAY_DEFAULT 2000       // [ms] before trying next broker in parallel
+#define MQTT_CONNECT_TIMEOUT_DEFAULT 30000     // [ms] abandon connection attempt
+#define MQTT_TOPIC_ALIAS_MAX_DEFAULT 65535     // limited by the broker's topic alias maximum
+
+// connection slot states
+#define MQTT_SLOT_IDLE 0
+#define MQTT_SLOT_CONNECTING 1
+#define MQTT_SLOT_CONNECTED 2
+#define MQTT_SLOT_FAILED 3          // connection attempt failed
+#define MQTT_SLOT_LOST 4            // established connection was lost
 
 using namespace std;
 
@@ -65,6 +80,11 @@ static void on_connect(struct mosquitto *mosq, void *obj, int result) {
     ((MQTT*)obj)->connect_callback(mosq, result);
 }
 
+// Callback function for mosquitto connect async (MQTT v5 properties)
+static void on_connect_v5(struct mosquitto *mosq, void *obj, int result, int flags, const mosquitto_property *props) {
+    ((MQTT*)obj)->connect_v5_callback(mosq, result, props);
+}
+
 // Callback function for mosquitto disconnect async
 static void on_disconnect(struct mosquitto *mosq, void *obj, int rc) {
     // callback function of the relevant instance
@@ -95,6 +115,26 @@ static void on_subscribe(struct mosquitto *mosq, void *obj, int mid, int qos_cou
  * GLOBAL FUNCTIONS
  *********************/
 
+static int64_t monotonic_ms(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ((int64_t)ts.tv_sec * 1000) + (ts.tv_nsec / 1000000);
+}
+
+// bytes required to encode n as MQTT variable byte integer
+static int varint_size(int n) {
+    int size = 1;
+    while (n > 127) {
+        n >>= 7;
+        size++;
+    }
+    return size;
+}
+
+static bool broker_priority_less(const mqtt_broker &a, const mqtt_broker &b) {
+    return a.priority < b.priority;
+}
+
  /*********************
   * MEMBER FUNCTIONS
   *********************/
@@ -103,6 +143,8 @@ static void on_subscribe(struct mosquitto *mosq, void *obj, int mid, int qos_cou
  // Class MQTT
  //
 
+ int MQTT::_instances = 0;
+
  MQTT::MQTT() {
      _construct(DEFAULT_CLIENT_ID);
  }
@@ -116,75 +158,291 @@ static void on_subscribe(struct mosquitto *mosq, void *obj, int mid, int qos_cou
      _console_log_enable = false;
      _qos = 0;
      _retain = MQTT_RETAIN_DEFAULT;
+     _retainPolicy = MQTT_RETAIN_POLICY_TAG;
+     _name = clientID;
+     _queued = 0;
+     _maxQueued = MQTT_MAX_QUEUED_DEFAULT;
+     _dropped = 0;
+     _rxDropped = 0;
+     _protocolVersion = MQTT_PROTOCOL_V311;
+     _topicAliasMax = MQTT_TOPIC_ALIAS_MAX_DEFAULT;
+     _payloadFormat = MQTT_PAYLOAD_TEXT;
+     _bytesSent = 0;
      connectionStatusCallback = NULL;
      topicUpdateCallback = NULL;
-     _mqttBroker.assign( MQTT_BROKER_DEFAULT );
-     _mqttPort = MQTT_BROKER_DEFAULT_PORT;
      _mqttKeepalive = MQTT_BROKER_DEFAULT_KEEPALIVE;
-
-     // initialise library
-     mosquitto_lib_init();
-     int major, minor, revision, result;
-     result = mosquitto_lib_version(&major, &minor, &revision);
-     printf("mosquitto library V%d.%d.%d (%d)\n", major, minor, revision, result);
-     syslog(LOG_INFO, "mosquitto library V%d.%d.%d (%d)", major, minor, revision, result);
-
-     // create new mqtt
-     _mosq = mosquitto_new(clientID, false, this);  // "this" provides a link from calllback to class instance
-     if (_mosq == NULL) {
-         syslog(LOG_ERR,"Class MQTT - mosquitto_new returned NULL");
-         throw runtime_error("Class MQTT - mosquitto_new returned NULL");
+     _mosq = NULL;
+     _active = -1;
+     _roundIndex = 0;
+     _nextAttemptTime = 0;
+     _backoff_ms = 0;
+     _backoffMin_ms = MQTT_BACKOFF_MIN_DEFAULT;
+     _backoffMax_ms = MQTT_BACKOFF_MAX_DEFAULT;
+     _failoverDelay_ms = MQTT_FAILOVER_DELAY_DEFAULT;
+     _connectTimeout_ms = MQTT_CONNECT_TIMEOUT_DEFAULT;
+     addBroker(MQTT_BROKER_DEFAULT, MQTT_BROKER_DEFAULT_PORT, 0);
+     srandom(time(NULL) ^ getpid());     // reconnect jitter differs between processes
+
+     // initialise library once per process, all links share it
+     if (_instances++ == 0) {
+         mosquitto_lib_init();
+         int major, minor, revision, result;
+         result = mosquitto_lib_version(&major, &minor, &revision);
+         printf("mosquitto library V%d.%d.%d (%d)\n", major, minor, revision, result);
+         syslog(LOG_INFO, "mosquitto library V%d.%d.%d (%d)", major, minor, revision, result);
      }
 
-     // start mqtt processing loop in own thread
-     result = mosquitto_loop_start(_mosq);
-     if (result != MOSQ_ERR_SUCCESS) {
-         syslog(LOG_ERR, "Class MQTT - mosquitto_loop_start failed");
-         throw runtime_error("Class MQTT - mosquitto_loop_start failed");
-     }
+     // create one mosquitto instance per connection slot
+     // the processing loop thread is started for each connection attempt
+     for (int i = 0; i < MQTT_CONNECT_SLOTS; i++) {
+         _slot[i].state = MQTT_SLOT_IDLE;
+         _slot[i].broker = -1;
+         _slot[i].startTime = 0;
+         _slot[i].aliasMax = 0;
+         _slot[i].mosq = mosquitto_new(clientID, false, this);  // "this" provides a link from calllback to class instance
+         if (_slot[i].mosq == NULL) {
+             syslog(LOG_ERR,"Class MQTT - mosquitto_new returned NULL");
+             throw runtime_error("Class MQTT - mosquitto_new returned NULL");
+         }
 
-     // set callback functions
-     mosquitto_connect_callback_set(_mosq, on_connect);
-     mosquitto_disconnect_callback_set(_mosq, on_disconnect);
-     mosquitto_publish_callback_set(_mosq, on_publish);
-     mosquitto_message_callback_set(_mosq, on_message);
-     mosquitto_log_callback_set(_mosq, on_log);
-     mosquitto_subscribe_callback_set(_mosq, on_subscribe);
+         // set callback functions
+         mosquitto_connect_callback_set(_slot[i].mosq, on_connect);
+         mosquitto_connect_v5_callback_set(_slot[i].mosq, on_connect_v5);
+         mosquitto_disconnect_callback_set(_slot[i].mosq, on_disconnect);
+         mosquitto_publish_callback_set(_slot[i].mosq, on_publish);
+         mosquitto_message_callback_set(_slot[i].mosq, on_message);
+         mosquitto_log_callback_set(_slot[i].mosq, on_log);
+         mosquitto_subscribe_callback_set(_slot[i].mosq, on_subscribe);
+     }
  }
 
  MQTT::~MQTT() {
      //printf("%s - Connected: %d\n", __func__, connected);
-     if (_connected) mosquitto_disconnect(_mosq) ;
-     //mosquitto_loop_stop(_mosq, false);
-     mosquitto_loop_stop(_mosq, true); // Note: must be true or this will block
-     if (_mosq != NULL) {
-         mosquitto_destroy(_mosq);
-         _mosq = NULL;
+     for (int i = 0; i < MQTT_CONNECT_SLOTS; i++) {
+         _stop_slot(i);
+         if (_slot[i].mosq != NULL) {
+             mosquitto_destroy(_slot[i].mosq);
+             _slot[i].mosq = NULL;
+         }
      }
-     mosquitto_lib_cleanup();
+     if (--_instances == 0) mosquitto_lib_cleanup();
  }
 
 #pragma mark Connecting
 
-void MQTT::connect(void) {
-    char strbuf[255];
-    // connect to mqtt server
-    int result = mosquitto_connect_async(_mosq, _mqttBroker.c_str(), _mqttPort, _mqttKeepalive);
-    if (result != MOSQ_ERR_SUCCESS) {
-        sprintf(strbuf, "%s - mosquitto_connect failed: %s [%d]\n", __func__, strerror(result), result);
-        syslog(LOG_ERR, "mosquitto_connect failed: %s [%d]", strerror(result), result);
-        throw runtime_error(strbuf);
+int MQTT::connect(void) {
+    if (_brokers.empty()) {
+        syslog(LOG_ERR, "%s - no mqtt broker configured", __func__);
+        return -1;
     }
-    //printf ("%s\n", __func__);
+    _roundIndex = 0;
+    _nextAttemptTime = 0;
+    process();
+    return 0;
 }
 
 void MQTT::disconnect(void) {
-    if (_connected) mosquitto_disconnect(_mosq) ;
+    for (int i = 0; i < MQTT_CONNECT_SLOTS; i++) {
+        _stop_slot(i);
+    }
+    _active = -1;
+    _mosq = NULL;
+    _connected = false;
+    _nextAttemptTime = INT64_MAX;       // no reconnect until connect() is called
+}
+
+void MQTT::process(void) {
+    int64_t now = monotonic_ms();
+    int i, inProgress = 0, newest = -1, oldest = -1, slot = -1;
+
+    _process_rx();
+
+    // active connection lost?
+    if (_active >= 0) {
+        if (_slot[_active].state == MQTT_SLOT_CONNECTED) return;
+        _connected = false;
+        if (connectionStatusCallback != NULL) {
+            (*connectionStatusCallback) (this, _connected);  // broker() still reports the lost broker
+        }
+        _stop_slot(_active);
+        _active = -1;
+        _mosq = NULL;
+        _roundIndex = 0;            // start again with the preferred broker
+        _nextAttemptTime = now;
+    }
+
+    for (i = 0; i < MQTT_CONNECT_SLOTS; i++) {
+        switch (_slot[i].state) {
+        case MQTT_SLOT_FAILED:
+        case MQTT_SLOT_LOST:
+            syslog(LOG_INFO, "mqtt connection to %s failed after %lldms", _brokers[_slot[i].broker].host.c_str(), (long long)(now - _slot[i].startTime));
+            _stop_slot(i);
+            break;
+        case MQTT_SLOT_CONNECTED:
+            if (_active >= 0) break;
+            // first successful attempt becomes the active connection
+            _active = i;
+            _mosq = _slot[i].mosq;
+            _queued = 0;
+            _topicAlias.clear();        // aliases are only valid for one connection
+            _connected = true;
+            _backoff_ms = 0;
+            break;
+        case MQTT_SLOT_CONNECTING:
+            if ((now - _slot[i].startTime) >= _connectTimeout_ms) {
+                syslog(LOG_INFO, "mqtt connection to %s timed out", _brokers[_slot[i].broker].host.c_str());
+                _stop_slot(i);
+            }
+            break;
+        default:
+            break;
+        }
+    }
+
+    if (_active >= 0) {
+        // abandon remaining attempts
+        for (i = 0; i < MQTT_CONNECT_SLOTS; i++) {
+            if (i != _active) _stop_slot(i);
+        }
+        if (_console_log_enable) {
+            printf("%s: connected to %s\n", __func__, broker());
+        }
+        if (connectionStatusCallback != NULL) {
+            (*connectionStatusCallback) (this, _connected);
+        }
+        return;
+    }
+
+    if (now < _nextAttemptTime) return;
+
+    for (i = 0; i < MQTT_CONNECT_SLOTS; i++) {
+        if (_slot[i].state == MQTT_SLOT_CONNECTING) {
+            inProgress++;
+            if ((newest < 0) || (_slot[i].startTime > _slot[newest].startTime)) newest = i;
+            if ((oldest < 0) || (_slot[i].startTime < _slot[oldest].startTime)) oldest = i;
+        } else if (slot < 0) {
+            slot = i;               // idle slot
+        }
+    }
+
+    if (_roundIndex >= (int)_brokers.size()) {
+        // all brokers tried, wait for remaining attempts then back off
+        if (inProgress == 0) _schedule_retry(now);
+        return;
+    }
+
+    // start next broker if nothing is in progress or the newest
+    // attempt is still waiting (e.g. timeout in OS network stack)
+    if ((inProgress > 0) && ((now - _slot[newest].startTime) < _failoverDelay_ms)) return;
+    if (slot < 0) {
+        _stop_slot(oldest);         // no free slot, give up oldest attempt
+        slot = oldest;
+    }
+    _start_attempt(slot, _roundIndex++);
+}
+
+/**
+ * start asynchronous connection attempt
+ * @returns 0 on success, -1 on failure
+ */
+int MQTT::_start_attempt(int slot, int brokerIdx) {
+    mqtt_broker *b = &_brokers[brokerIdx];
+    _slot[slot].broker = brokerIdx;
+    _slot[slot].startTime = monotonic_ms();
+    _slot[slot].aliasMax = 0;
+    if (_console_log_enable) {
+        printf("%s: connecting to %s:%d\n", __func__, b->host.c_str(), b->port);
+    }
+    int result = mosquitto_connect_async(_slot[slot].mosq, b->host.c_str(), b->port, _mqttKeepalive);
+    if (result != MOSQ_ERR_SUCCESS) {
+        // e.g. name resolution failure, try next broker on next call
+        syslog(LOG_ERR, "mosquitto_connect %s failed: %s [%d]", b->host.c_str(), mosquitto_strerror(result), result);
+        fprintf(stderr, "%s - mosquitto_connect %s failed: %s [%d]\n", __func__, b->host.c_str(), mosquitto_strerror(result), result);
+        _slot[slot].state = MQTT_SLOT_IDLE;
+        return -1;
+    }
+    _slot[slot].state = MQTT_SLOT_CONNECTING;
+    // start mqtt processing loop in own thread
+    result = mosquitto_loop_start(_slot[slot].mosq);
+    if (result != MOSQ_ERR_SUCCESS) {
+        syslog(LOG_ERR, "%s - mosquitto_loop_start failed: %s", __func__, mosquitto_strerror(result));
+        _slot[slot].state = MQTT_SLOT_IDLE;
+        return -1;
+    }
+    return 0;
+}
+
+/**
+ * hand received messages to the topic update callback
+ * runs on the thread calling process()
+ */
+void MQTT::_process_rx(void) {
+    mqtt_rx_message rx;
+    struct mosquitto_message message;
+    for (int i = 0; i < MQTT_CONNECT_SLOTS; i++) {
+        while (_slot[i].rx.pop(&rx)) {
+            if (topicUpdateCallback == NULL) continue;
+            message.mid = rx.mid;
+            message.topic = rx.topic;
+            message.payload = rx.payload;
+            message.payloadlen = rx.payloadlen;
+            message.qos = rx.qos;
+            message.retain = rx.retain;
+            (*topicUpdateCallback) (&message);
+        }
+    }
+}
+
+/**
+ * change slot state if it has the expected state
+ * an attempt abandoned by process() (state idle) is not changed by a late callback
+ * @returns true if the state was changed
+ */
+bool MQTT::_set_state(int slot, int expected, int newState) {
+    return _slot[slot].state.compare_exchange_strong(expected, newState);
+}
+
+/**
+ * stop connection or attempt on slot and its loop thread
+ */
+void MQTT::_stop_slot(int slot) {
+    if (_slot[slot].mosq == NULL) return;
+    if (_slot[slot].state == MQTT_SLOT_IDLE) return;
+    _slot[slot].state = MQTT_SLOT_IDLE;
+    mosquitto_disconnect(_slot[slot].mosq);
+    mosquitto_loop_stop(_slot[slot].mosq, true); // Note: must be true or this will block
+}
+
+/**
+ * schedule the next round through the broker list
+ * exponential backoff with jitter, the delay is between 50% and 100% of the backoff
+ */
+void MQTT::_schedule_retry(int64_t now) {
+    int delay;
+    if (_backoff_ms == 0) {
+        _backoff_ms = _backoffMin_ms;
+    } else {
+        _backoff_ms = (_backoff_ms > _backoffMax_ms / 2) ? _backoffMax_ms : _backoff_ms * 2;
+    }
+    delay = (_backoff_ms / 2) + (random() % (_backoff_ms / 2 + 1));
+    _nextAttemptTime = now + delay;
+    _roundIndex = 0;
+    syslog(LOG_INFO, "mqtt reconnect scheduled in %dms", delay);
+    if (_console_log_enable) {
+        printf("%s: reconnect in %dms\n", __func__, delay);
+    }
+}
+
+int MQTT::_slot_index(struct mosquitto *m) {
+    for (int i = 0; i < MQTT_CONNECT_SLOTS; i++) {
+        if (_slot[i].mosq == m) return i;
+    }
+    return -1;
 }
 
 #pragma mark Operation
 
-void MQTT::registerConnectionCallback(void (*callback) (bool)) {
+void MQTT::registerConnectionCallback(void (*callback) (MQTT*, bool)) {
     connectionStatusCallback = callback;
 }
 
@@ -193,22 +451,122 @@ void MQTT::registerTopicUpdateCallback(void (*callback) (const struct mosquitto_
 }
 
 int MQTT::publish(const char* topic, const char* format, float value, bool pubRetain) {
-    int messageid = 0;
+    uint8_t buf[MQTT_FIXED_PAYLOAD_MAX];
+    if (_payloadFormat == MQTT_PAYLOAD_FIXED) {
+        return publish_binary(topic, buf, fixed_encode(value, format_decimals(format), buf), pubRetain);
+    }
+    sprintf(_pub_buf, format, value);
+    return publish_payload(topic, _pub_buf, pubRetain);
+}
+
+int MQTT::publish_payload(const char* topic, const char* payload, bool pubRetain) {
+    return publish_binary(topic, payload, strlen(payload), pubRetain);
+}
+
+int MQTT::publish_binary(const char* topic, const void* payload, int len, bool pubRetain) {
+    int messageid = 0, result, alias = 0, propertyLen = -1;
+    bool established = false;
+    mosquitto_property *props = NULL;
     if (!_connected) {
         fprintf(stderr, "%s: Not Connected!\n", __func__);
         return -1;
+    }
+    // never block on a slow connection, drop instead
+    if (_queued >= _maxQueued) {
+        _dropped++;
+        return -1;
+    }
+    if (_retainPolicy == MQTT_RETAIN_POLICY_ALWAYS) pubRetain = true;
+    else if (_retainPolicy == MQTT_RETAIN_POLICY_NEVER) pubRetain = false;
+    //printf ("%s: %s %s\n", __func__, topic, payload);
+    if (_protocolVersion == MQTT_PROTOCOL_V5) {
+        alias = _topic_alias(topic, &established);
+        propertyLen = 0;
+        if (alias > 0) {
+            mosquitto_property_add_int16(&props, MQTT_PROP_TOPIC_ALIAS, alias);
+            propertyLen = 3;        // identifier + 16 bit value
+        }
+        // once the alias is established the topic is omitted
+        result = mosquitto_publish_v5(_mosq, &messageid, established ? NULL : topic, len, payload, _qos, pubRetain, props);
+        mosquitto_property_free_all(&props);
     } else {
-        //printf ("%s: %s\n", __func__, topic);
+        result = mosquitto_publish(_mosq, &messageid, topic, len, payload, _qos, pubRetain);
     }
-    sprintf(_pub_buf, format, value);
-    //printf ("%s: %s %s\n", __func__, topic, _pub_buf);
-    int result = mosquitto_publish(_mosq, &messageid, topic, strlen(_pub_buf), (const char *) _pub_buf, _qos, pubRetain);
     if (result != MOSQ_ERR_SUCCESS) {
         fprintf(stderr, "%s: %s [%s]\n", __func__, mosquitto_strerror(result), topic);
+        if ((alias > 0) && !established) _topicAlias.erase(topic);     // broker doesn't know the alias
+        return -1;
     }
+    _queued++;      // decremented when mosquitto has sent the message
+    _bytesSent += publish_packet_size(established ? 0 : strlen(topic), len, _qos, propertyLen);
     return messageid;
 }
 
+/**
+ * get topic alias for a topic on the active MQTT v5 connection
+ * a new alias is assigned while the broker's limit permits
+ * @param established: set to true if the broker already knows the alias
+ * @returns: alias, 0 if no alias is used
+ */
+int MQTT::_topic_alias(const char *topic, bool *established) {
+    int limit;
+    std::map<std::string, int>::iterator it = _topicAlias.find(topic);
+    *established = false;
+    if (it != _topicAlias.end()) {
+        *established = true;
+        return it->second;
+    }
+    limit = _slot[_active].aliasMax;
+    if (_topicAliasMax < limit) limit = _topicAliasMax;
+    if ((int)_topicAlias.size() >= limit) return 0;
+    int alias = _topicAlias.size() + 1;
+    _topicAlias[topic] = alias;     // first publish carries topic and alias
+    return alias;
+}
+
+int MQTT::fixed_encode(float value, int decimals, uint8_t *buf) {
+    long long mantissa;
+    int len;
+    if (decimals < 0) decimals = 0;
+    if (decimals > 9) decimals = 9;
+    if (!isfinite(value)) {
+        buf[0] = 0;
+        return 1;
+    }
+    // reduce resolution until the value fits into 32 bit
+    for (;;) {
+        mantissa = llround((double)value * pow(10.0, decimals));
+        if (((mantissa >= INT32_MIN) && (mantissa <= INT32_MAX)) || (decimals == 0)) break;
+        decimals--;
+    }
+    if (mantissa > INT32_MAX) mantissa = INT32_MAX;
+    if (mantissa < INT32_MIN) mantissa = INT32_MIN;
+    if ((mantissa >= INT8_MIN) && (mantissa <= INT8_MAX)) len = 1;
+    else if ((mantissa >= INT16_MIN) && (mantissa <= INT16_MAX)) len = 2;
+    else len = 4;
+    buf[0] = decimals;
+    for (int i = 0; i < len; i++) {
+        buf[len - i] = (uint8_t)(mantissa >> (i * 8));
+    }
+    return len + 1;
+}
+
+int MQTT::format_decimals(const char *format) {
+    const char *p = strchr(format, '%');
+    if (p == NULL) return 0;
+    while ((*p != 0) && (*p != '.') && (strchr("diufFeEgG", *p) == NULL)) p++;
+    if (*p == '.') return atoi(p + 1);
+    if ((*p == 'd') || (*p == 'i') || (*p == 'u')) return 0;
+    return 6;       // printf default precision
+}
+
+int MQTT::publish_packet_size(int topicLen, int payloadLen, int qos, int propertyLen) {
+    int remaining = 2 + topicLen + payloadLen;
+    if (qos > 0) remaining += 2;        // packet identifier
+    if (propertyLen >= 0) remaining += varint_size(propertyLen) + propertyLen;
+    return 1 + varint_size(remaining) + remaining;
+}
+
 int MQTT::clear_retained_message(const char* topic) {
     int messageid = 0;
     if (!_connected) {
@@ -222,7 +580,9 @@ int MQTT::clear_retained_message(const char* topic) {
     int result = mosquitto_publish(_mosq, &messageid, topic, 0, "", _qos, true);
     if (result != MOSQ_ERR_SUCCESS) {
         fprintf(stderr, "%s: %s [%s]\n", __func__, mosquitto_strerror(result), topic);
+        return -1;
     }
+    _queued++;      // completion is counted by publish_callback like any publish
     return messageid;
 }
 
@@ -254,22 +614,114 @@ void MQTT::setConsoleLog(bool enable) {
 }
 
 int MQTT::setBroker(const char *newBroker) {
-    _mqttBroker = newBroker;
+    clearBrokers();
+    return addBroker(newBroker, MQTT_BROKER_DEFAULT_PORT, 0);
+}
+
+int MQTT::addBroker(const char *host, unsigned int port, int priority) {
+    mqtt_broker b;
+    if ((host == NULL) || (strlen(host) == 0)) return -1;
+    b.host = host;
+    b.port = (port == 0) ? MQTT_BROKER_DEFAULT_PORT : port;
+    b.priority = priority;
+    _brokers.push_back(b);
+    std::stable_sort(_brokers.begin(), _brokers.end(), broker_priority_less);
     return 0;
 }
 
+void MQTT::clearBrokers(void) {
+    _brokers.clear();
+}
+
+void MQTT::setReconnectBackoff(int min_s, int max_s) {
+    _backoffMin_ms = (min_s < 1) ? 1000 : min_s * 1000;
+    _backoffMax_ms = (max_s * 1000 < _backoffMin_ms) ? _backoffMin_ms : max_s * 1000;
+}
+
+void MQTT::setFailover(int failoverDelay_ms, int connectTimeout_s) {
+    _failoverDelay_ms = (failoverDelay_ms < 0) ? 0 : failoverDelay_ms;
+    _connectTimeout_ms = (connectTimeout_s < 1) ? 1000 : connectTimeout_s * 1000;
+}
+
+const mqtt_broker* MQTT::_current_broker(void) {
+    if ((_active >= 0) && (_slot[_active].broker >= 0))
+        return &_brokers[_slot[_active].broker];
+    if (_brokers.empty()) return NULL;
+    return &_brokers[0];
+}
+
 const char* MQTT::broker(void) {
-    return _mqttBroker.c_str();
+    const mqtt_broker *b = _current_broker();
+    return (b == NULL) ? "" : b->host.c_str();
 }
 
 unsigned int MQTT::port(void) {
-    return _mqttPort;
+    const mqtt_broker *b = _current_broker();
+    return (b == NULL) ? 0 : b->port;
 }
 
 bool MQTT::isConnected(void) {
     return _connected;
 }
 
+bool MQTT::canPublish(void) {
+    return _connected && (_queued < _maxQueued);
+}
+
+void MQTT::setName(const char *newName) {
+    if (newName != NULL) _name = newName;
+}
+
+const char* MQTT::name(void) {
+    return _name.c_str();
+}
+
+void MQTT::setRetainPolicy(int policy) {
+    _retainPolicy = policy;
+}
+
+void MQTT::setMaxQueued(int maxQueued) {
+    _maxQueued = (maxQueued < 1) ? 1 : maxQueued;
+}
+
+int MQTT::queued(void) {
+    return _queued;
+}
+
+unsigned long MQTT::dropped(void) {
+    return _dropped;
+}
+
+unsigned long MQTT::rxDropped(void) {
+    return _rxDropped;
+}
+
+int MQTT::setProtocolVersion(int version) {
+    if ((version != MQTT_PROTOCOL_V311) && (version != MQTT_PROTOCOL_V5)) return -1;
+    for (int i = 0; i < MQTT_CONNECT_SLOTS; i++) {
+        if (mosquitto_int_option(_slot[i].mosq, MOSQ_OPT_PROTOCOL_VERSION, version) != MOSQ_ERR_SUCCESS)
+            return -1;
+    }
+    _protocolVersion = version;
+    return 0;
+}
+
+int MQTT::protocolVersion(void) {
+    return _protocolVersion;
+}
+
+void MQTT::setTopicAliasMax(int aliasMax) {
+    _topicAliasMax = (aliasMax < 0) ? 0 : aliasMax;
+}
+
+void MQTT::setPayloadFormat(int format) {
+    _payloadFormat = format;
+}
+
+unsigned long long MQTT::bytesSent(void) {
+    return _bytesSent;
+}
+
 int MQTT::setRetain(bool newRetain) {
 	_retain = newRetain;
 	return 0;
@@ -290,13 +742,22 @@ void MQTT::message_callback(struct mosquitto *m, const struct mosquitto_message
 		fprintf(stderr, "%s (null)\n", message->topic);
 	}
 	*/
-	if (topicUpdateCallback != NULL) {
-		(*topicUpdateCallback) (message);
-		//fprintf(stderr, "%s - topicUpdateCallback done %s\n", __func__, message->topic);
+	// runs on the mosquitto thread, the callback is made from process()
+	mqtt_rx_message rx;
+	int slot = _slot_index(m);
+	if (slot < 0) return;
+	if ((strlen(message->topic) >= sizeof(rx.topic)) || (message->payloadlen > MQTT_RX_PAYLOAD_MAX)) {
+		_rxDropped++;
+		return;
 	}
-//	else {
-//		fprintf(stderr, "%s - topicUpdateCallback is NULL\n", __func__);
-//	}
+	strcpy(rx.topic, message->topic);
+	memcpy(rx.payload, message->payload, message->payloadlen);
+	rx.payload[message->payloadlen] = 0;
+	rx.payloadlen = message->payloadlen;
+	rx.mid = message->mid;
+	rx.qos = message->qos;
+	rx.retain = message->retain;
+	if (!_slot[slot].rx.push(rx)) _rxDropped++;
 }
 
 void MQTT::log_callback(struct mosquitto *m, int level, const char *str) {
@@ -312,30 +773,40 @@ void MQTT::subscribe_callback(struct mosquitto *m, int mid, int qos_count, const
 
 void MQTT::publish_callback(struct mosquitto *m, int mid) {
     //fprintf(stderr, "%s: %d\n", __func__, mid );
+    if ((m == _mosq.load()) && (_queued > 0)) _queued--;
 }
 
 void MQTT::connect_callback(struct mosquitto *m, int result) {
      //printf("%s: %s\n", __func__ , mosquitto_connack_string(result) );
+     int slot = _slot_index(m);
+     if (slot < 0) return;
      if (result == MOSQ_ERR_SUCCESS) {
-         _connected = true;
-         if (_console_log_enable) {
+         // processed in process(), unless the attempt was abandoned
+         if (_set_state(slot, MQTT_SLOT_CONNECTING, MQTT_SLOT_CONNECTED) && _console_log_enable) {
              printf("%s: connection success\n", __func__);
          }
      } else {
+         if (!_set_state(slot, MQTT_SLOT_CONNECTING, MQTT_SLOT_FAILED)) return;
          syslog(LOG_ERR, "%s", mosquitto_connack_string(result));
          fprintf(stderr, "%s: %s\n", __func__ , mosquitto_connack_string(result) );
      }
-     if (connectionStatusCallback != NULL) {
-         (*connectionStatusCallback) (_connected);
-     }
+}
+
+void MQTT::connect_v5_callback(struct mosquitto *m, int result, const mosquitto_property *props) {
+     uint16_t aliasMax = 0;
+     int slot = _slot_index(m);
+     if ((slot < 0) || (result != MOSQ_ERR_SUCCESS)) return;
+     // no property means the broker doesn't accept topic aliases
+     mosquitto_property_read_int16(props, MQTT_PROP_TOPIC_ALIAS_MAXIMUM, &aliasMax, false);
+     _slot[slot].aliasMax = aliasMax;
 }
 
 void MQTT::disconnect_callback(struct mosquitto *m, int rc) {
      //fprintf(stderr, "%s: %s\n", __func__, mosquitto_strerror(rc) );
-     _connected = false;
-     if (connectionStatusCallback != NULL) {
-         (*connectionStatusCallback) (_connected);
-     }
+     int slot = _slot_index(m);
+     if (slot < 0) return;
+     if (!_set_state(slot, MQTT_SLOT_CONNECTED, MQTT_SLOT_LOST))
+         _set_state(slot, MQTT_SLOT_CONNECTING, MQTT_SLOT_FAILED);
  }
 
  /*********************
@@ -5,6 +5,11 @@
   The MQTT class encapsulates the mosquitto connection used for publishing
   and receiving data via the MQTT protocol from a broker.
 
+  Threading: mosquitto callbacks run on the mosquitto loop thread of each
+  connection slot. They only change the atomic slot state or push received
+  messages onto the slot's lock-free queue. All other members are owned by
+  the thread calling process(), which also makes the registered callbacks.
+
  -----------------------------------------------------------------------------
  */
 
@@ -13,9 +18,58 @@
 
 //#include <time.h>
 
+#include <stdint.h>
+#include <time.h>
 #include <mosquitto.h>
 
+#include <atomic>
+#include <map>
 #include <string>
+#include <vector>
+
+#include "spscqueue.h"
+
+#define MQTT_CONNECT_SLOTS 2		// parallel connection attempts during failover
+#define MQTT_RX_QUEUE_SIZE 32       // received messages waiting for process()
+#define MQTT_RX_TOPIC_MAX 128       // longest topic of a received message
+#define MQTT_RX_PAYLOAD_MAX 32      // longest payload of a received message
+
+// retain policy of a connection
+#define MQTT_RETAIN_POLICY_TAG 0	// use retain setting of the published tag
+#define MQTT_RETAIN_POLICY_ALWAYS 1
+#define MQTT_RETAIN_POLICY_NEVER 2
+
+// payload format of publish()
+#define MQTT_PAYLOAD_TEXT 0         // value formatted with the tag's printf format
+#define MQTT_PAYLOAD_FIXED 1        // compact binary fixed point, see fixed_encode()
+#define MQTT_FIXED_PAYLOAD_MAX 5    // bytes
+
+// broker definition, lower priority number is preferred
+struct mqtt_broker {
+    std::string host;
+    unsigned int port;
+    int priority;
+};
+
+// received message, copied from the mosquitto thread to the main loop
+struct mqtt_rx_message {
+    char topic[MQTT_RX_TOPIC_MAX];
+    char payload[MQTT_RX_PAYLOAD_MAX + 1];      // null terminated
+    int payloadlen;
+    int mid;
+    int qos;
+    bool retain;
+};
+
+// mosquitto instance used for one connection attempt
+struct mqtt_slot {
+    struct mosquitto *mosq;
+    std::atomic<int> state;     // MQTT_SLOT_xxx, changed by callbacks
+    int broker;                 // index into broker list
+    int64_t startTime;          // attempt start [ms, CLOCK_MONOTONIC]
+    std::atomic<int> aliasMax;  // topic alias maximum announced by the broker (MQTT v5)
+    SpscQueue<mqtt_rx_message, MQTT_RX_QUEUE_SIZE> rx;    // producer: mosquitto thread
+};
 
 class MQTT {
 public:
@@ -32,9 +86,18 @@ public:
     ~MQTT();
 
     /**
-     * Connect to the MQTT broker
+     * Start connecting to the highest priority MQTT broker
+     * the connection is maintained by process(), failures never throw
+     * @return: 0 on success, -1 if no broker is configured
      */
-    void connect(void);
+    int connect(void);
+
+    /**
+     * Maintain the broker connection, must be called from the main loop
+     * handles failover, parallel connection attempts and reconnect backoff.
+     * Connection status callbacks are made from this function.
+     */
+    void process(void);
 
     /**
      * Disconnect from the MQTT broker
@@ -49,7 +112,7 @@ public:
     /**
      * register callback for connection status change
      */
-    void registerConnectionCallback(void (*callback) (bool));
+    void registerConnectionCallback(void (*callback) (MQTT*, bool));
 
     /**
      * register callback for topic update
@@ -63,6 +126,14 @@ public:
      */
     void connect_callback(struct mosquitto *mosq, int result);
 
+    /**
+     * callback function for MQTT v5 connect, made after connect_callback
+     * @param mosq: pointer to mosquitto structure
+     * @param result: connection result
+     * @param props: CONNACK properties
+     */
+    void connect_v5_callback(struct mosquitto *mosq, int result, const mosquitto_property *props);
+
     /**
      * callback function for disconnect
      * @param mosq: pointer to mosquitto structure
@@ -112,6 +183,25 @@ public:
      */
     int publish(const char* topic, const char* format, float value, bool pubRetain);
 
+    /**
+     * publish a binary payload
+     * @param topic: the topic name to be published
+     * @param payload: payload data
+     * @param len: payload length
+     * @param pubRetain: publish with retain
+     * @return: message ID, can be used for further tracking
+     */
+    int publish_binary(const char* topic, const void* payload, int len, bool pubRetain);
+
+    /**
+     * publish a preformatted payload
+     * @param topic: the topic name to be published
+     * @param payload: null terminated payload string
+     * @param pubRetain: publish with retain
+     * @return: message ID, can be used for further tracking
+     */
+    int publish_payload(const char* topic, const char* payload, bool pubRetain);
+
 	/**
 	 * Clear retained message from mosquitto persistance store
 	 * @param topic: the topic name to be cleared
@@ -133,14 +223,43 @@ public:
     int unsubscribe(const char *topic);
 
     /**
-     * get MQTT broker
+     * set single MQTT broker (replaces broker list)
      * @return: 0 on success, negative number for error
      */
     int setBroker(const char *newBroker);
 
+    /**
+     * add MQTT broker to the failover list
+     * @param host: broker host name or address
+     * @param port: broker port
+     * @param priority: lower number is preferred
+     * @return: 0 on success, negative number for error
+     */
+    int addBroker(const char *host, unsigned int port, int priority);
+
+    /**
+     * remove all brokers from the failover list
+     */
+    void clearBrokers(void);
+
+    /**
+     * set reconnect backoff range
+     * the delay doubles after every failed round through all brokers
+     * @param min_s: initial delay [s]
+     * @param max_s: maximum delay [s]
+     */
+    void setReconnectBackoff(int min_s, int max_s);
+
+    /**
+     * set failover timing
+     * @param failoverDelay_ms: time without connection before the next broker is tried in parallel
+     * @param connectTimeout_s: a connection attempt is abandoned after this time
+     */
+    void setFailover(int failoverDelay_ms, int connectTimeout_s);
+
     /**
      * get MQTT broker
-     * @return: mqtt broker
+     * @return: connected mqtt broker, or highest priority broker if not connected
      */
     const char* broker(void);
 
@@ -157,6 +276,106 @@ public:
      */
     bool isConnected(void);
 
+    /**
+     * check if a message can be published without exceeding the queue limit
+     * @returns: true if connected and the publish queue is not full
+     */
+    bool canPublish(void);
+
+    /**
+     * set connection name (used for logging)
+     */
+    void setName(const char *newName);
+
+    /**
+     * get connection name
+     */
+    const char* name(void);
+
+    /**
+     * set retain policy for publish commands
+     * @param policy: MQTT_RETAIN_POLICY_TAG, _ALWAYS or _NEVER
+     */
+    void setRetainPolicy(int policy);
+
+    /**
+     * set publish queue limit
+     * messages published while the queue is full are dropped
+     * @param maxQueued: maximum number of messages not yet sent to the broker
+     */
+    void setMaxQueued(int maxQueued);
+
+    /**
+     * @returns: number of messages not yet sent to the broker
+     */
+    int queued(void);
+
+    /**
+     * @returns: number of messages dropped due to full queue
+     */
+    unsigned long dropped(void);
+
+    /**
+     * @returns: number of received messages dropped (queue full or too long)
+     */
+    unsigned long rxDropped(void);
+
+    /**
+     * set MQTT protocol version, must be called before connect()
+     * @param version: MQTT_PROTOCOL_V311 or MQTT_PROTOCOL_V5
+     * @return: 0 on success, -1 if the version is not supported
+     */
+    int setProtocolVersion(int version);
+
+    /**
+     * @returns: MQTT protocol version
+     */
+    int protocolVersion(void);
+
+    /**
+     * set number of topic aliases used on a MQTT v5 connection
+     * the broker's topic alias maximum is never exceeded
+     * @param aliasMax: 0 disables topic aliases
+     */
+    void setTopicAliasMax(int aliasMax);
+
+    /**
+     * set payload format for publish()
+     * @param format: MQTT_PAYLOAD_TEXT or MQTT_PAYLOAD_FIXED
+     */
+    void setPayloadFormat(int format);
+
+    /**
+     * @returns: bytes of PUBLISH packets sent since start
+     */
+    unsigned long long bytesSent(void);
+
+    /**
+     * encode value as compact fixed point payload
+     * byte 0 holds the number of decimals n, followed by round(value * 10^n)
+     * as big endian signed integer of 1, 2 or 4 bytes (smallest which fits).
+     * A payload with only byte 0 represents a value which can't be encoded (NaN).
+     * @param decimals: number of decimals [0..9], reduced if the value doesn't fit
+     * @param buf: buffer of at least MQTT_FIXED_PAYLOAD_MAX bytes
+     * @returns: payload length
+     */
+    static int fixed_encode(float value, int decimals, uint8_t *buf);
+
+    /**
+     * get number of decimals from a printf format (e.g. "%.2f" = 2)
+     */
+    static int format_decimals(const char *format);
+
+    /**
+     * calculate size of a PUBLISH packet on the wire
+     * @param topicLen: length of topic, 0 if a topic alias is used
+     * @param payloadLen: length of payload
+     * @param qos: quality of service
+     * @param propertyLen: length of properties for MQTT v5, -1 for MQTT v3.1.1
+     * @returns: packet size [bytes]
+     */
+    static int publish_packet_size(int topicLen, int payloadLen, int qos, int propertyLen);
+
 	/**
 	 * set mqtt retain
 	 * @param newRetain: new retain value
@@ -171,21 +390,53 @@ public:
 	bool getRetain(void);
 
 private:
-    void (*connectionStatusCallback) (bool);     // callback for connection status change
+    void (*connectionStatusCallback) (MQTT*, bool);     // callback for connection status change
     void (*topicUpdateCallback) (const struct mosquitto_message*);     // callback for topic update
     void _construct (const char* clientID);
-
-    struct mosquitto *_mosq;
-    bool _connected;
+    int _slot_index(struct mosquitto *m);
+    int _start_attempt(int slot, int broker);
+    void _stop_slot(int slot);
+    void _schedule_retry(int64_t now);
+    void _process_rx(void);
+    bool _set_state(int slot, int expected, int newState);
+    const mqtt_broker* _current_broker(void);
+    int _topic_alias(const char *topic, bool *established);
+
+    std::atomic<struct mosquitto*> _mosq;    // active connection, NULL if not connected
+    std::atomic<bool> _connected;
     char _pub_buf[100];
-    std::string _mqttBroker;
-    unsigned int _mqttPort;
+    std::vector<mqtt_broker> _brokers;  // sorted by priority
     int _mqttKeepalive;
 
+    mqtt_slot _slot[MQTT_CONNECT_SLOTS];
+    int _active;                // slot of active connection, -1 if not connected
+    int _roundIndex;            // next broker to try in the current round
+    int64_t _nextAttemptTime;   // [ms] start of next round
+    int _backoff_ms;            // current reconnect backoff, 0 after success
+    int _backoffMin_ms;
+    int _backoffMax_ms;
+    int _failoverDelay_ms;
+    int _connectTimeout_ms;
+
     bool _console_log_enable;    // for mosqitto logging
 
     int _qos;        // quality of service [0..2]
     bool _retain;    // retain setting for publish commands
+    int _retainPolicy;          // MQTT_RETAIN_POLICY_xxx
+    std::string _name;          // connection name for logging
+
+    int _protocolVersion;       // MQTT_PROTOCOL_V311 or MQTT_PROTOCOL_V5
+    int _topicAliasMax;         // topic aliases we may use (capped by the broker)
+    std::map<std::string, int> _topicAlias;    // aliases assigned on the active connection
+    int _payloadFormat;         // MQTT_PAYLOAD_xxx
+    unsigned long long _bytesSent;
+
+    std::atomic<int> _queued;   // published messages not yet sent to the broker
+    int _maxQueued;             // publish queue limit
+    unsigned long _dropped;     // messages dropped due to full queue
+    std::atomic<unsigned long> _rxDropped;  // received messages dropped
+
+    static int _instances;      // mosquitto library is initialised for the first instance
 };
 
 #endif /* MQTT_H */
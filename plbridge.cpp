@@ -16,6 +16,7 @@
 
 #include <errno.h>
 #include <fcntl.h>
+#include <math.h>
 #include <signal.h>
 #include <stdarg.h>
 #include <stdbool.h>
@@ -24,11 +25,14 @@
 #include <stdio.h>
 #include <string.h>
 #include <syslog.h>
+#include <sys/resource.h>
 #include <sys/utsname.h>
 #include <time.h>
 #include <unistd.h>
 
+#include <algorithm>
 #include <string>
+#include <vector>
 #include <iostream>
 
 #include <libconfig.h++>
@@ -38,6 +42,14 @@
 #include "pltag.h"
 #include "hardware.h"
 #include "plxx.h"
+#include "plregisters.h"
+#include "samplering.h"
+#include "snapshot.h"
+#include "history.h"
+#include "tsstore.h"
+#include "expression.h"
+#include "energy.h"
+#include "alarm.h"
 #include "plbridge.h"
 
 using namespace std;
@@ -55,7 +67,43 @@ const int version_minor = 0;
 
 #define MQTT_BROKER_DEFAULT "127.0.0.1"
 #define MQTT_CLIENT_ID "plbridge"
-#define MQTT_RECONNECT_INTERVAL 10
+#define MQTT_BACKOFF_MIN 1				// [s] first reconnect delay
+#define MQTT_BACKOFF_MAX 60				// [s] reconnect delay limit
+#define MQTT_FAILOVER_DELAY 2000		// [ms] before next broker is tried in parallel
+#define MQTT_CONNECT_TIMEOUT 30			// [s] abandon connection attempt
+
+#define OFFLINE_RING_SIZE_DEFAULT 100000	// samples stored while broker is unreachable
+#define OFFLINE_REPLAY_RATE_DEFAULT 20		// replayed samples per second
+#define OFFLINE_REPLAY_SUFFIX_DEFAULT "/backlog"
+
+#define RESYNC_RATE_DEFAULT 50				// republished tags per second after reconnect
+#define RESYNC_AGE_SUFFIX_DEFAULT "/age"
+
+#define SNAPSHOT_INTERVAL_DEFAULT 300		// [s] periodic snapshot save
+
+#define BREAKER_THRESHOLD_DEFAULT 3			// consecutive failures before device is marked down
+#define BREAKER_PROBE_MIN_DEFAULT 5			// [s] first probe interval
+#define BREAKER_PROBE_MAX_DEFAULT 60		// [s] probe interval limit
+
+#define DEGRADE_RATE_DEFAULT 20				// [%] failure rate with line errors which degrades the link
+#define DEGRADE_FRAME_GAP_DEFAULT 20		// [ms] maximum inter-frame spacing
+
+#define TX_RECORD_SIZE_DEFAULT 10240		// [kB] transaction log size before rotation
+#define TX_RECORD_FILES_DEFAULT 5			// rotated transaction logs kept
+
+#define HISTORY_START_HOUR_DEFAULT 1		// local hour from which the daily history download is due
+#define HISTORY_LINK_SHARE_DEFAULT 10		// [%] of the link time available for the history download
+#define HISTORY_DAY_OFFSET_DEFAULT 1		// history day 0 is yesterday
+#define HISTORY_SLICE_BYTES 8				// reads per history download step
+#define HISTORY_BUDGET_MAX_US 250000		// link time credit is limited to about one step
+
+#define TIMESERIES_SEGMENT_SIZE_DEFAULT 1024	// [kB] size of a segment file
+#define TIMESERIES_SEGMENTS_DEFAULT 30			// segment files kept
+#define TIMESERIES_FLUSH_INTERVAL_DEFAULT 300	// [s] buffered samples are written at this interval
+
+#define ENERGY_MAX_GAP_DEFAULT 30			// [s] longest interval between current samples which is integrated
+#define ENERGY_SAVE_INTERVAL_DEFAULT 300	// [s] accumulators are saved at this interval
+#define ENERGY_PUBLISH_INTERVAL_DEFAULT 60	// [s] day and total energy are published at this interval
 
 static string cpu_temp_topic = "";
 static string cfgFileName;
@@ -63,12 +111,13 @@ static string execName;
 static string mbSlaveStatusTopic;
 bool exitSignal = false;
 bool debugEnabled = false;
+bool benchmarkMode = false;		// compare publish sizes and exit
+string replayFileName = "";		// replay a transaction log instead of the serial device
+double replaySpeed = 0;			// 0 = as fast as possible, 1 = recorded timing
+string replayBroker = "";			// a replay is only published to this broker (opt-in)
 int plDebugLevel = 1;
 bool mqttDebugEnabled = false;
 bool runningAsDaemon = false;
-time_t mqtt_connect_time = 0;   	// time the connection was initiated
-time_t mqtt_next_connect_time = 0;	// time when next connect is scheduled
-bool mqtt_connection_in_progress = false;
 bool mqtt_retain_default = false;
 std::string processName;
 char *info_label_text;
@@ -77,23 +126,105 @@ updatecycle *updateCycles = NULL;	// array of update cycle definitions
 PLtag *plReadTags = NULL;		// array of all PL read tags
 PLtag *plWriteTags = NULL;		// array of all PL write tags
 int plTagCount = -1;
+int plWriteTagCount = 0;
 uint32_t plTransactionDelay = 0;	// delay between modbus transactions
+float plSerialBudget = 0;			// [transactions/s] limit for adaptive tags, 0 = unlimited
 #define PL_DEVICE_MAX 254			// highest permitted PL device ID
 #define PL_DEVICE_MIN 1				// lowest permitted PL device ID
+#define PL_WRITE_SETTLE_DEFAULT 50		// [ms] settle time before write read back
+#define PL_WRITE_RETRIES_DEFAULT 2		// repeated writes if read back fails
+#define PL_WRITE_STATUS_SUFFIX "/status"	// result of a write request: ok, failed or discarded
 
 Plxx *pl;
+int plDegradeLevel = 0;			// last reported serial link degradation
+bool plDeviceGone = false;		// serial device node removed (USB unplugged)
+circuitbreaker plBreaker = { BREAKER_THRESHOLD_DEFAULT, 0, false, 0, BREAKER_PROBE_MIN_DEFAULT, BREAKER_PROBE_MAX_DEFAULT, 0 };
+TxRecorder txRecorder;			// raw serial transaction log
+TxReplay plReplay;				// recorded session replacing the serial device
+struct timespec replayStartTime;
+
+SampleRing offlineRing;			// samples acquired while broker is unreachable
+string offlineReplaySuffix = OFFLINE_REPLAY_SUFFIX_DEFAULT;
+string offlineDroppedTopic;			// number of samples lost to ring overflow, optional
+bool offlineStored = false;			// samples stored since last ring sync
+
+bool resyncEnabled = false;			// republish last known values after reconnect
+string resyncAgeSuffix = RESYNC_AGE_SUFFIX_DEFAULT;
+
+#define MQTT_LINKS_MAX SAMPLE_RING_LINKS
+mqttlink mqttLinks[MQTT_LINKS_MAX];	// broker connections
+int mqttLinkCount = 0;
+
+string snapshotFileName = "";		// empty if snapshots are not configured
+int snapshotInterval = SNAPSHOT_INTERVAL_DEFAULT;
+time_t snapshotNextSaveTime = 0;
+
+PLhistory plHistory;				// daily history download, optional
+string historyTopic;
+bool historyRetain = true;
+int historyStartHour = HISTORY_START_HOUR_DEFAULT;
+int historyLinkShare = HISTORY_LINK_SHARE_DEFAULT;
+int historyDayOffset = HISTORY_DAY_OFFSET_DEFAULT;
+std::vector<historyfield> historyFields;	// empty: days are published as byte arrays
+long historyBudget_us = 0;			// link time available for the download
+struct timespec historyBudgetTime;	// last budget update
+
+TSStore tsStore;					// local time-series store, optional
+int tsFlushInterval = TIMESERIES_FLUSH_INTERVAL_DEFAULT;
+time_t tsNextFlushTime = 0;
+
+PLtag *derivedTags = NULL;			// tags computed from other tags, optional
+derivedtag *derivedDefs = NULL;
+int derivedTagCount = 0;
+unsigned long tagUpdateSeq = 0;		// incremented for every new tag value
+
+std::vector<EnergyIntegrator> energyIntegrators;	// Ah/Wh accounting, optional
+std::vector<string> energyTopics;	// topic prefix per integrator
+string energyFileName;				// accumulator state file
+string energyFormat = "%.3f";
+bool energyRetain = true;
+int energySaveInterval = ENERGY_SAVE_INTERVAL_DEFAULT;
+int energyPublishInterval = ENERGY_PUBLISH_INTERVAL_DEFAULT;
+time_t energyNextSaveTime = 0;
+time_t energyNextPublishTime = 0;
+
+std::vector<Alarm> alarms;			// alarm rules, optional
+std::vector<alarmdef> alarmDefs;
 
 #pragma mark Proto types
 void subscribe_tags(void);
-void mqtt_connection_status(bool status);
+void mqtt_connection_status(MQTT *m, bool status);
+bool mqtt_config_brokers(Setting& brokerSettings, MQTT *m);
+bool mqtt_any_connected(void);
+bool history_process(void);
+void timeseries_process(void);
+void aggregate_process(void);
+void derived_process(void);
+void energy_process(void);
+void alarm_check(PLtag *tag);
+void alarm_process(void);
+bool alarm_boost_process(int64_t now_ms);
+void alarm_publish_link(MQTT *m);
+void energy_publish_link(MQTT *m);
+time_t pl_time(void);
+int64_t pl_time_ms(void);
+int64_t pl_monotonic_ms(void);
+bool replay_init(void);
 void mqtt_topic_update(const struct mosquitto_message *message);
-void mqtt_subscribe_tags(void);
+void mqtt_subscribe_tags(mqttlink *link);
 void setMainLoopInterval(int newValue);
-bool mqtt_publish_tag(PLtag *tag);
+uint16_t mqtt_publish_tag(PLtag *tag);
 void mqtt_clear_tags(bool publish_noread, bool clear_retain);
+bool pl_write_process(void);
+void offline_store(PLtag *tag, uint16_t links);
+void timeseries_store(PLtag *tag);
+void aggregate_close(PLtag *tag, time_t now);
+bool offline_replay_process(int linkIdx);
+void offline_dropped_process(void);
+void resync_start(mqttlink *link, bool force = false);
+bool resync_process(mqttlink *link);
 
 //TagStore ts;
-MQTT mqtt(MQTT_CLIENT_ID);
 Config cfg;			// config file
 Hardware hw(false);	// no screen
 
@@ -145,8 +276,63 @@ void timespec_diff(struct timespec *start, struct timespec *stop, struct timespe
 	return;
 }
 
+/**
+ * initialise rate limiter
+ * @param rate: messages per second
+ */
+void ratelimit_init(ratelimit *rl, int rate) {
+	rl->rate = (rate < 1) ? 1 : rate;
+	rl->budget = 0;
+	clock_gettime(CLOCK_MONOTONIC, &rl->last);
+}
+
+/**
+ * take one message from the rate limiter budget
+ * the budget accumulates at "rate" per second up to a one second burst
+ * @returns true if a message may be sent now
+ */
+bool ratelimit_take(ratelimit *rl) {
+	struct timespec now, elapsed;
+	if (rl->budget < 1) {
+		clock_gettime(CLOCK_MONOTONIC, &now);
+		timespec_diff(&rl->last, &now, &elapsed);
+		rl->last = now;
+		rl->budget += rl->rate * (elapsed.tv_sec + (elapsed.tv_nsec / 1e9));
+		if (rl->budget > rl->rate) rl->budget = rl->rate;
+		if (rl->budget < 1) return false;
+	}
+	rl->budget -= 1;
+	return true;
+}
+
 #pragma mark -- Config File functions
 
+/**
+ * Read list of MQTT brokers for failover
+ * @return true if success
+ */
+bool mqtt_config_brokers(Setting& brokerSettings, MQTT *m) {
+	string host;
+	int port, priority;
+	int numBrokers = brokerSettings.getLength();
+
+	m->clearBrokers();
+	for (int index = 0; index < numBrokers; index++) {
+		if (!brokerSettings[index].lookupValue("host", host)) {
+			std::cerr << "Error in config file <" << brokerSettings.getPath() << "> host missing in entry " << index+1 << std::endl;
+			return false;
+		}
+		if (!brokerSettings[index].lookupValue("port", port)) port = 0;		// default port
+		if (!brokerSettings[index].lookupValue("priority", priority)) priority = index;
+		m->addBroker(host.c_str(), port, priority);
+	}
+	if (numBrokers < 1) {
+		std::cerr << "Error in config file <" << brokerSettings.getPath() << "> is empty" << std::endl;
+		return false;
+	}
+	return true;
+}
+
 /**
  * Read configuration file.
  * @return true if success
@@ -184,15 +370,6 @@ bool readConfig (void)
 		return false;
 	}
 
-	// Read MQTT broker from config
-	try {
-		mqtt.setBroker(cfg.lookup("mqtt.broker"));
-	} catch (const SettingNotFoundException &excp) {
-		mqtt.setBroker(MQTT_BROKER_DEFAULT);
-	} catch (const SettingTypeException &excp) {
-		std::cerr << "Error in config file <" << excp.getPath() << "> is not a string" << std::endl;
-		return false;
-	}
 	return true;
 }
 
@@ -220,71 +397,117 @@ bool cfg_get_str(const std::string &path, std::string &value) {
 
 #pragma mark -- Processing
 
-/*
- * convert double byte values
- * unfortunately there is no standard conversion so this function
- * performs the various format conversions.
- *
+/**
+ * Mark the PL device as down
+ * all read tags are put into noread state and published at once,
+ * further transactions are replaced by a single probe per interval
  */
-int pl_int_conversion(uint8_t lsb_addr, int lsb_val, int msb_val, int *value) {
-	float fValue;
-	switch(lsb_addr) {
-		case 220:	// battery voltage
-		case 237:	// sense voltage
-			fValue = (float)(((msb_val * 256)+lsb_val)+38400)/5.120;    // value in millvolts
-			*value = int(fValue);	// convert to int 
-			break;
-		case 188:	// Internal charge AH
-		case 193:	// External charge AH
-		case 198:	// Internal load AH
-		case 203:	// External load AH
-			*value = (msb_val * 8) + lsb_val;
-			break;
-		default:
-			log(LOG_WARNING, "%s - unable to perfrom conversion for addr: %d", __func__, lsb_addr);
-			return -1;
+void pl_breaker_trip(void) {
+	plBreaker.open = true;
+	plBreaker.probeInterval = plBreaker.probeIntervalMin;
+	plBreaker.nextProbeTime = pl_time() + plBreaker.probeInterval;
+	log(LOG_WARNING, "PL device not responding after %d attempts, marked down", plBreaker.failures);
+	for (int index = 0; index < plTagCount; index++) {
+		plReadTags[index].noreadForce();
+		mqtt_publish_tag(&plReadTags[index]);
 	}
-	return 0;
 }
 
 /**
- * Optional conversion for byte
- * @returns 0 if succesful
+ * Record the result of a PL device transaction
+ * @param success: true if the device responded
  */
-int pl_byte_conversion(uint8_t addr, uint8_t byte_val, int *value) {
-	switch(addr) {
-		case 101:		// rstate (uses only 2 bits)
-			*value = (int)(byte_val & 0x03);		// mask out lower bits
-			return 0;
-			break;
-		default:
-			*value = (int)byte_val;
-			return 0;
+void pl_breaker_result(bool success) {
+	if (success) {
+		plBreaker.failures = 0;
+		return;
 	}
-	return 0;
+	plBreaker.failures++;
+	if (!plBreaker.open && (plBreaker.threshold > 0) && (plBreaker.failures >= plBreaker.threshold))
+		pl_breaker_trip();
 }
 
 /**
- * Read double byte value
- * @returns true for successful read
- * @param lsb_addr
- * @param msb_addr
- * @param *value pointer to integer for read value
+ * Log changes of the serial link degradation
  */
-int pl_read_int(uint8_t lsb_addr, uint8_t msb_addr, int *value) {
-	int retVal = 0;
-	uint8_t msb_val=0, lsb_val=0;
-	int registerIntValue = 0;
+void pl_link_process(void) {
+	plxx_link_stats stats;
+	pl->getLinkStats(&stats);
+	if (stats.degradeLevel == plDegradeLevel) return;
+	log(stats.degradeLevel > plDegradeLevel ? LOG_WARNING : LOG_NOTICE,
+		"PL serial link %s: level %d, frame gap %dms, %lu of %lu transactions failed with line errors",
+		stats.degradeLevel > plDegradeLevel ? "degraded" : "recovered", stats.degradeLevel,
+		stats.frameGap_us / 1000, stats.lineFailures, stats.transactions);
+	plDegradeLevel = stats.degradeLevel;
+}
 
-	retVal = pl->read_RAM(lsb_addr, msb_addr, &lsb_val, &msb_val);
-	if (retVal == 0) {
-		retVal = pl_int_conversion(lsb_addr, lsb_val, msb_val, &registerIntValue);
-		if (retVal == 0) {
-			*value = registerIntValue;
+/**
+ * Suspend polling while the serial device node is missing
+ * the device is marked down at once and probed as soon as the node reappears
+ */
+void pl_hotplug_process(void) {
+	bool present = pl->devicePresent();
+	if (!present && !plDeviceGone) {
+		plDeviceGone = true;
+		log(LOG_WARNING, "PL serial device removed");
+		if (!plBreaker.open) pl_breaker_trip();
+	} else if (present && plDeviceGone) {
+		plDeviceGone = false;
+		log(LOG_NOTICE, "PL serial device present");
+		plBreaker.nextProbeTime = 0;		// probe now
+	}
+}
+
+/**
+ * Probe a PL device which is marked down
+ * the probe is a single byte read of the first read tag
+ * all update cycles are due immediately after the device has recovered
+ * @returns true if a probe was sent
+ */
+bool pl_breaker_process(void) {
+	uint8_t value;
+	time_t now = pl_time();
+
+	if (pl == NULL) return false;
+	pl_link_process();
+	pl_hotplug_process();
+	if (!plBreaker.open || plDeviceGone || (now < plBreaker.nextProbeTime) || (plTagCount < 1)) return false;
+	if (pl->read_RAM((uint8_t)(plReadTags[0].getAddress() & 0xFF), &value) == 0) {
+		plBreaker.open = false;
+		plBreaker.failures = 0;
+		log(LOG_NOTICE, "PL device responding again");
+		for (int index = 0; updateCycles[index].ident >= 0; index++) {
+			updateCycles[index].nextUpdateTime = now;
+			updateCycles[index].nextUpdate_ms = 0;
+		}
+		for (int index = 0; index < plTagCount; index++) {
+			plReadTags[index].nextReadTime = now;
 		}
-		//printf("%s - [%d] [%d] = %f %d\n", __FUNCTION__, msb_addr, lsb_addr, fValue, registerValue);
+		return true;
 	}
-	return retVal;
+	plBreaker.probeInterval *= 2;
+	if (plBreaker.probeInterval > plBreaker.probeIntervalMax) plBreaker.probeInterval = plBreaker.probeIntervalMax;
+	plBreaker.nextProbeTime = now + plBreaker.probeInterval;
+	return true;
+}
+
+/**
+ * Read all elements of a range tag in one sweep
+ * the tag values are replaced only if the whole range was read
+ * @returns 0 if successful, -1 on failure
+ */
+int pl_read_range(PLtag *tag) {
+	uint8_t buf[256];
+	int width = tag->getRangeWidth();
+	std::vector<int> values(tag->getRangeLength());
+
+	if (pl->read_RAM_block((uint8_t)tag->getAddress(), tag->getRangeLength() * width, buf) < 0)
+		return -1;
+	for (size_t i = 0; i < values.size(); i++) {
+		values[i] = (width == 1) ? buf[i] : (buf[i * 2] | (buf[(i * 2) + 1] << 8));
+	}
+	tag->setRangeValues(values);
+	return 0;
 }
 
 /**
@@ -292,35 +515,153 @@ int pl_read_int(uint8_t lsb_addr, uint8_t msb_addr, int *value) {
  * @returns: true if successful read
  */
 bool pl_read_tag(PLtag *tag) {
-	uint8_t registerByteValue;
-	uint8_t lsb_addr, msb_addr;
-	int retVal;
+	uint8_t lsb_val = 0, msb_val = 0;
+	int retVal, raw;
 	int address = tag->getAddress();
-	int registerValue = 0;
+	const pl_register *reg = pl_register_find(address);
+	double filtered;
+	bool due = true;
+
+	if (tag->isAggregate()) aggregate_close(tag, pl_time());	// publish an ended window before the value changes
 
-	// single byte or multi byte address
-	if (address <= 0xFF) { 	// single byte
-		retVal = pl->read_RAM((uint8_t)address, &registerByteValue);
-		pl_byte_conversion((uint8_t)address, registerByteValue, &registerValue);
-		//registerValue = registerByteValue;
+	// range, single byte or double byte register, double byte registers are validated by pl_config_tags
+	if (tag->isRange()) {
+		retVal = pl_read_range(tag);
+	} else if (address <= 0xFF) {
+		retVal = pl->read_RAM((uint8_t)address, &lsb_val);
 	} else {
-		// two byte read - currently only suitable for Voltage reading
-		//printf("%s - %s addr: %d\n", __func__, tag->getTopic(), address);
-		lsb_addr = address & 0XFF;
-		msb_addr = (address & 0xFF00) >> 8;
-		retVal = pl_read_int(lsb_addr, msb_addr, &registerValue);
+		retVal = pl->read_RAM((uint8_t)(address & 0xFF), (uint8_t)(address >> 8), &lsb_val, &msb_val);
 	}
 	//printf("%s - %s: %d\n", __FUNCTION__, tag->getTopic(), registerValue);
 
-	if (retVal == 0) {
-		tag->setValue(registerValue);
+	if (tag->isRange()) {
+		if (retVal != 0) tag->noreadNotify();
+	} else if (retVal == 0) {
+		raw = pl_register_decode(reg, lsb_val, msb_val);
+		if (!tag->isFiltered())
+			tag->setValue(raw);
+		else if ((due = tag->filterValue(raw, &filtered)))
+			tag->setValue(filtered);
 	} else {
 		tag->noreadNotify();
+		tag->filterReset();			// don't mix values from before and after the gap
+	}
+	pl_breaker_result(retVal == 0);
+	if (plBreaker.open) return retVal;		// tripped, noread already published
+	if (!due) return retVal;				// dropped by decimation
+	if (retVal == 0) {
+		tag->updateSeq = ++tagUpdateSeq;
+		tag->updateTime_ms = pl_monotonic_ms();
+	}
+	alarm_check(tag);
+	if (tag->isAggregate() && !tag->isNoread()) {
+		tag->aggregateAdd(pl_time());		// published when the window closes
+	} else {
+		offline_store(tag, mqtt_publish_tag(tag));	// keep for links which are not available
 	}
-	mqtt_publish_tag(tag);
+	timeseries_store(tag);
 	return retVal;
 }
 
+/**
+ * @returns the interval [s] of an update cycle, -1 if the cycle doesn't exist
+ */
+int pl_cycle_interval(int ident) {
+	for (int index = 0; updateCycles[index].ident >= 0; index++) {
+		if (updateCycles[index].ident == ident) return updateCycles[index].interval;
+	}
+	return -1;
+}
+
+/**
+ * @returns number of serial transactions to read a tag
+ */
+int pl_tag_transactions(PLtag *tag) {
+	if (tag->isRange()) return tag->getRangeLength() * tag->getRangeWidth();
+	return (tag->getAddress() <= 0xFF) ? 1 : 2;
+}
+
+/**
+ * @returns the period [s] of an update cycle, -1 if the cycle doesn't exist
+ */
+double pl_cycle_period(int ident) {
+	for (int index = 0; updateCycles[index].ident >= 0; index++) {
+		if (updateCycles[index].ident != ident) continue;
+		if (updateCycles[index].interval_ms > 0) return updateCycles[index].interval_ms / 1000.0;
+		return updateCycles[index].interval;
+	}
+	return -1;
+}
+
+/**
+ * @returns serial load [transactions/s] of all cyclic and adaptive read tags
+ */
+double pl_serial_load(void) {
+	double load = 0;
+	double period;
+
+	for (int index = 0; index < plTagCount; index++) {
+		if (plReadTags[index].isAdaptive())
+			period = plReadTags[index].readInterval;
+		else
+			period = pl_cycle_period(plReadTags[index].updateCycleId());
+		if (period > 0) load += pl_tag_transactions(&plReadTags[index]) / period;
+	}
+	return load;
+}
+
+/**
+ * Read an adaptive tag and adjust its read interval
+ * the interval halves while the value changes by more than the deadband
+ * and grows by a quarter while it is flat, a shorter interval must fit
+ * into the serial budget
+ */
+void pl_adaptive_read(PLtag *tag, time_t now) {
+	bool valid = (tag->getLastUpdateTime() != 0) && !tag->isNoread();
+	float previous = tag->getScaledValue();
+	int interval = tag->readInterval;
+	int newInterval = interval;
+	double tx = pl_tag_transactions(tag);
+	double spare;
+
+	pl_read_tag(tag);
+	if (valid && !tag->isNoread()) {
+		if (fabs(tag->getScaledValue() - previous) > tag->getDeadband()) {
+			newInterval = interval / 2;
+			if (newInterval < tag->getIntervalMin()) newInterval = tag->getIntervalMin();
+			if ((newInterval < interval) && (plSerialBudget > 0)) {
+				spare = plSerialBudget - (pl_serial_load() - (tx / interval));		// budget without this tag
+				if (spare <= 0) newInterval = interval;
+				else if (tx / newInterval > spare) newInterval = (int)ceil(tx / spare);
+				if (newInterval > interval) newInterval = interval;
+			}
+		} else {
+			newInterval = interval + ((interval < 4) ? 1 : interval / 4);
+			if (newInterval > tag->getIntervalMax()) newInterval = tag->getIntervalMax();
+		}
+	}
+	if ((newInterval != interval) && debugEnabled)
+		printf("%s - %s interval %ds -> %ds\n", __func__, tag->getTopic(), interval, newInterval);
+	tag->readInterval = newInterval;
+	tag->nextReadTime = now + newInterval;
+}
+
+/**
+ * process reads of tags with an adaptive interval
+ * @return false if there was nothing to process, otherwise true
+ */
+bool pl_adaptive_process(time_t now) {
+	bool retval = false;
+
+	for (int index = 0; (index < plTagCount) && !plBreaker.open; index++) {
+		if (!plReadTags[index].isAdaptive() || (now < plReadTags[index].nextReadTime)) continue;
+		pl_adaptive_read(&plReadTags[index], now);
+		usleep(plTransactionDelay);
+		retval = true;
+	}
+	return retval;
+}
+
 /**
  * process pl cyclic read update
  * @return false if there was nothing to process, otherwise true
@@ -330,8 +671,9 @@ bool pl_read_process() {
 	int tagIndex = 0;
 	int *tagArray;
 	bool retval = false;
-	PLtag tag;
-	time_t now = time(NULL);
+	time_t now = pl_time();
+	int64_t now_ms = pl_time_ms();
+	bool due;
 
 	while (updateCycles[index].ident >= 0) {
 		// ignore if cycle has no tags to process
@@ -340,16 +682,33 @@ bool pl_read_process() {
 			index++; continue;
 		}
 
-		if (now >= updateCycles[index].nextUpdateTime) {
-			// set next update cycle time
-			updateCycles[index].nextUpdateTime = now + updateCycles[index].interval;
+		if (updateCycles[index].interval_ms > 0) {
+			// sub-second cycle, keeps its rate but doesn't catch up after a delay
+			due = (now_ms >= updateCycles[index].nextUpdate_ms);
+			if (due) {
+				updateCycles[index].nextUpdate_ms += updateCycles[index].interval_ms;
+				if (updateCycles[index].nextUpdate_ms <= now_ms)
+					updateCycles[index].nextUpdate_ms = now_ms + updateCycles[index].interval_ms;
+			}
+		} else {
+			due = (now >= updateCycles[index].nextUpdateTime);
+			if (due) {
+				// set next update cycle time, keep the phase restored from a snapshot
+				if (updateCycles[index].alignedUpdateTime > now) {
+					updateCycles[index].nextUpdateTime = updateCycles[index].alignedUpdateTime;
+				} else {
+					updateCycles[index].nextUpdateTime = now + updateCycles[index].interval;
+				}
+				updateCycles[index].alignedUpdateTime = 0;
+			}
+		}
+		if (due) {
 			// get array for tags
 			tagArray = updateCycles[index].tagArray;
 			if (tagArray != NULL) {
-				// read each tag in the array
+				// read each tag in the array, device down is handled by the probe
 				tagIndex = 0;
-				while (tagArray[tagIndex] >= 0) {
-					tag = plReadTags[tagArray[tagIndex]];
+				while ((tagArray[tagIndex] >= 0) && !plBreaker.open) {
 					pl_read_tag(&plReadTags[tagArray[tagIndex]]);
 					tagIndex++;
 					usleep(plTransactionDelay);
@@ -360,276 +719,1471 @@ bool pl_read_process() {
 		}
 		index++;
 	}
+	if (pl_adaptive_process(now)) retval = true;
+	if (alarm_boost_process(now_ms)) retval = true;
+
+	return retval;
+}
+
+/**
+ * write a single tag to the PL device
+ * bit tags are written as read-modify-write of the output register
+ * @returns 0 if successful, -1 on failure
+ */
+int pl_write_tag(PLtag *tag) {
+	uint8_t address = (uint8_t)tag->getAddress();
+	uint8_t mask;
+	int bit = tag->getBit();
+
+	if (bit < 0)
+		return pl->write_RAM(address, (uint8_t)tag->getIntValue());
+
+	mask = 1 << bit;
+	if (tag->getToggle())
+		return pl->modify_RAM(address, 0xFF, 0, mask);		// toggle bit
+	if (tag->getBoolValue())
+		return pl->modify_RAM(address, 0xFF, mask, 0);		// set bit
+	return pl->modify_RAM(address, ~mask, 0, 0);			// clear bit
+}
+
+/**
+ * publish the result of a write request to <topic>/status on all links
+ */
+void pl_write_status(PLtag *tag, const char *status) {
+	string topic = tag->getTopicString() + PL_WRITE_STATUS_SUFFIX;
+
+	for (int index = 0; index < mqttLinkCount; index++) {
+		if (mqttLinks[index].mqtt->canPublish())
+			mqttLinks[index].mqtt->publish_payload(topic.c_str(), status, false);
+	}
+}
+
+/**
+ * process pending write requests received from MQTT
+ * the latency from MQTT receipt to completed (or verified) write is logged
+ * @return true if a write request was processed
+ */
+bool pl_write_process(void) {
+	int index;
+	bool retval = false;
+	struct timespec requestTime, now, latency;
+	long latency_ms;
+
+	if ((plWriteTags == NULL) || (pl == NULL)) return false;
+
+	for (index = 0; index < plWriteTagCount; index++) {
+		if (!plWriteTags[index].getWritePending()) continue;
+		plWriteTags[index].setWritePending(false);
+		retval = true;
+		if (plBreaker.open) {
+			// don't execute a stale request when the device comes back
+			log(LOG_WARNING, "write discarded, PL device down [%s]", plWriteTags[index].getTopic());
+			pl_write_status(&plWriteTags[index], "discarded");
+			continue;
+		}
+		requestTime = plWriteTags[index].getWriteRequestTime();
+		if (pl_write_tag(&plWriteTags[index]) < 0) {
+			log(LOG_WARNING, "write failed [%s] addr %d", plWriteTags[index].getTopic(), plWriteTags[index].getAddress());
+			pl_breaker_result(false);
+			pl_write_status(&plWriteTags[index], "failed");
+			continue;
+		}
+		pl_breaker_result(true);
+		clock_gettime(CLOCK_MONOTONIC, &now);
+		timespec_diff(&requestTime, &now, &latency);
+		latency_ms = (latency.tv_sec * 1000) + (latency.tv_nsec / 1000000);
+		log(LOG_INFO, "write %s [%s] addr %d completed in %ldms", pl->writeVerify() ? "verified" : "sent",
+			plWriteTags[index].getTopic(), plWriteTags[index].getAddress(), latency_ms);
+		pl_write_status(&plWriteTags[index], "ok");
+	}
+	return retval;
+}
+
+/** Process all variables
+ * @return true if at least one variable was processed
+ * Note: the return value from this function is used
+ * to measure processing time
+ */
+bool process() {
+	bool retval = false;
+	bool connected = mqtt_any_connected();
+	if (connected) {
+		if (pl_write_process()) retval = true;
+	}
+	// continue acquisition while offline if samples can be stored
+	if (connected || offlineRing.isOpen() || tsStore.isOpen() || plReplay.isOpen()) {
+		if (pl_breaker_process()) retval = true;
+		if (pl_read_process()) retval = true;
+		if (history_process()) retval = true;
+		if (offlineStored) {
+			offlineRing.sync();
+			offlineStored = false;
+		}
+		timeseries_process();
+		aggregate_process();
+		derived_process();
+		energy_process();
+		alarm_process();
+	}
+	for (int index = 0; index < mqttLinkCount; index++) {
+		if (!mqttLinks[index].mqtt->isConnected()) continue;
+		if (resync_process(&mqttLinks[index])) retval = true;
+		if (offline_replay_process(index)) retval = true;
+	}
+	offline_dropped_process();
+//	var_process();	// don't want it in time measuring, doesn't take up much time
+	return retval;
+}
+
+bool init_values(void)
+{
+
+	char info1[80], info2[80], info3[80], info4[80];
+
+    // get hardware info
+    hw.get_model_name(info1, sizeof(info1));
+    hw.get_os_name(info2, sizeof(info2));
+    hw.get_kernel_name(info3, sizeof(info3));
+    hw.get_ip_address(info4, sizeof(info4));
+    info_label_text = (char *)malloc(strlen(info1) +strlen(info2) +strlen(info3) +strlen(info4) +5);
+    sprintf(info_label_text, "%s\n%s\n%s\n%s", info1, info2, info3, info4);
+    if (!runningAsDaemon) {
+	    printf(info_label_text);
+        }
+    //printf(info_label_text);
+    return true;
+}
+
+#pragma mark MQTT
+
+/** Initialise the MQTT subscribed (write) tags
+ * @return false on failure
+ */
+bool init_tags(void) {
+	std::string strValue;
+	int numTags, iVal, i;
+	bool bVal;
+
+	if (!cfg.exists("mqtt_tags")) {	// optional
+		log(LOG_NOTICE,"configuration - parameter \"mqtt_tags\" does not exist");
+		return true;
+		}
+
+	Setting& mqttTagsSettings = cfg.lookup("mqtt_tags");
+	numTags = mqttTagsSettings.getLength();
+
+	plWriteTags = new PLtag[numTags+1];
+	plWriteTagCount = 0;
+	//printf("%s - %d mqtt tags found\n", __func__, numTags);
+	for (i=0; i < numTags; i++) {
+		if (!mqttTagsSettings[i].lookupValue("topic", strValue)) {
+			log(LOG_WARNING, "Error in config file, mqtt_tags entry %d topic missing", i+1);
+			continue;
+		}
+		if (!mqttTagsSettings[i].lookupValue("address", iVal) || (iVal < 0) || (iVal > 0xFF)) {
+			log(LOG_WARNING, "Error in config file, mqtt_tags <%s> address missing or invalid", strValue.c_str());
+			continue;
+		}
+		plWriteTags[plWriteTagCount].setTopic(strValue.c_str());
+		plWriteTags[plWriteTagCount].setSlaveId(PL_DEVICE_MIN);
+		plWriteTags[plWriteTagCount].setAddress(iVal);
+		if (mqttTagsSettings[i].lookupValue("bit", iVal))
+			plWriteTags[plWriteTagCount].setBit(iVal);
+		if (mqttTagsSettings[i].lookupValue("ignoreretained", bVal))
+			plWriteTags[plWriteTagCount].setIgnoreRetained(bVal);
+		plWriteTagCount++;
+	}
+	// Mark end of list
+	plWriteTags[plWriteTagCount].setSlaveId(PL_DEVICE_MAX +1);
+	plWriteTags[plWriteTagCount].setUpdateCycleId(-1);
+	//printf("%s - allocated %d tags, last is index %d\n", __func__, i, i-1);
+	return true;
+}
+
+/**
+ * Create and configure one MQTT link
+ * @param settings: the "mqtt" group or an entry of "mqtt_links"
+ * @param defaultName: link name if the config has none
+ * @return false on configuration error
+ */
+bool mqtt_config_link(Setting& settings, const char *defaultName) {
+	string strValue, name;
+	int iValue;
+	bool bValue;
+	int backoffMin = MQTT_BACKOFF_MIN, backoffMax = MQTT_BACKOFF_MAX;
+	int failoverDelay = MQTT_FAILOVER_DELAY, connectTimeout = MQTT_CONNECT_TIMEOUT;
+	mqttlink *link;
+
+	if (mqttLinkCount >= MQTT_LINKS_MAX) {
+		log(LOG_ERR, "Error in config file, more than %d mqtt links", MQTT_LINKS_MAX);
+		return false;
+	}
+	link = &mqttLinks[mqttLinkCount];
+	name = settings.lookupValue("name", strValue) ? strValue : defaultName;
+	// additional links get their own client id, two links to one broker would disconnect each other
+	if (!settings.lookupValue("client_id", link->clientId)) {
+		link->clientId = MQTT_CLIENT_ID;
+		if (mqttLinkCount > 0) link->clientId += "-" + name;
+	}
+	for (int index = 0; index < mqttLinkCount; index++) {
+		if (mqttLinks[index].clientId == link->clientId) {
+			log(LOG_ERR, "Error in config file, mqtt links <%s> and <%s> use the same client_id <%s>",
+				mqttLinks[index].mqtt->name(), name.c_str(), link->clientId.c_str());
+			return false;
+		}
+	}
+	link->mqtt = new MQTT(link->clientId.c_str());
+	link->mqtt->setName(name.c_str());
+	link->mqtt->setConsoleLog(mqttDebugEnabled);
+	link->subscribe = (mqttLinkCount == 0);		// write tags on first link only by default
+	link->resyncPending = false;
+	link->resyncIndex = 0;
+	mqttLinkCount++;
+
+	// broker(s)
+	if (settings.exists("brokers")) {
+		if (!mqtt_config_brokers(settings.lookup("brokers"), link->mqtt))
+			return false;
+	} else if (settings.lookupValue("broker", strValue)) {
+		link->mqtt->setBroker(strValue.c_str());
+	} else {
+		link->mqtt->setBroker(MQTT_BROKER_DEFAULT);
+	}
+	if (settings.lookupValue("retain", strValue)) {
+		if (strValue == "always") link->mqtt->setRetainPolicy(MQTT_RETAIN_POLICY_ALWAYS);
+		else if (strValue == "never") link->mqtt->setRetainPolicy(MQTT_RETAIN_POLICY_NEVER);
+		else link->mqtt->setRetainPolicy(MQTT_RETAIN_POLICY_TAG);
+	}
+	if (settings.lookupValue("max_queued", iValue))
+		link->mqtt->setMaxQueued(iValue);
+	if (settings.lookupValue("subscribe", bValue))
+		link->subscribe = bValue;
+	if (settings.lookupValue("protocol", iValue)) {
+		if (link->mqtt->setProtocolVersion((iValue == 5) ? MQTT_PROTOCOL_V5 : MQTT_PROTOCOL_V311) < 0) {
+			log(LOG_ERR, "MQTT protocol version %d not supported", iValue);
+			return false;
+		}
+	}
+	if (settings.lookupValue("topic_alias_max", iValue))
+		link->mqtt->setTopicAliasMax(iValue);
+	if (settings.lookupValue("payload", strValue)) {
+		link->mqtt->setPayloadFormat((strValue == "fixed") ? MQTT_PAYLOAD_FIXED : MQTT_PAYLOAD_TEXT);
+	}
+	settings.lookupValue("backoff_min", backoffMin);
+	settings.lookupValue("backoff_max", backoffMax);
+	settings.lookupValue("failover_delay", failoverDelay);
+	settings.lookupValue("connect_timeout", connectTimeout);
+	link->mqtt->setReconnectBackoff(backoffMin, backoffMax);
+	link->mqtt->setFailover(failoverDelay, connectTimeout);
+	link->mqtt->registerConnectionCallback(mqtt_connection_status);
+	link->mqtt->registerTopicUpdateCallback(mqtt_topic_update);
+	return true;
+}
+
+/**
+ * Initialise the MQTT links and connect to the brokers
+ * the "mqtt" group defines the first link, "mqtt_links" optional further links
+ */
+bool mqtt_init(void) {
+	bool bValue;
+	char linkName[20];
+	if (!runningAsDaemon) {
+		if (cfg.lookupValue("mqtt.debug", bValue)) {
+			mqttDebugEnabled = bValue;
+			if (mqttDebugEnabled) printf("%s - mqtt debug enabled\n", __func__);
+		}
+	}
+	if (cfg.lookupValue("mqtt.retain_default", bValue))
+		mqtt_retain_default = bValue;
+
+	try {
+		if (!mqtt_config_link(cfg.exists("mqtt") ? cfg.lookup("mqtt") : cfg.getRoot(), "mqtt"))
+			return false;
+		if (cfg.exists("mqtt_links")) {
+			Setting& linkSettings = cfg.lookup("mqtt_links");
+			for (int index = 0; index < linkSettings.getLength(); index++) {
+				snprintf(linkName, sizeof(linkName), "link%d", index+1);
+				if (!mqtt_config_link(linkSettings[index], linkName))
+					return false;
+			}
+		}
+	} catch (const SettingTypeException &excp) {
+		log(LOG_ERR, "Error in config file <%s> is wrong type", excp.getPath());
+		return false;
+	}
+
+	// a recorded session must not appear as live data on the configured brokers
+	if (!replayFileName.empty()) {
+		for (int index = 0; index < mqttLinkCount; index++) {
+			mqttLinks[index].mqtt->disconnect();		// no connection attempts
+		}
+		if (replayBroker.empty()) {
+			log(LOG_INFO, "PL replay is not published, use -p<broker> to publish it");
+			return true;
+		}
+		log(LOG_INFO, "PL replay is published to broker %s only", replayBroker.c_str());
+		mqttLinks[0].mqtt->setBroker(replayBroker.c_str());
+		return (mqttLinks[0].mqtt->connect() >= 0);
+	}
+	for (int index = 0; index < mqttLinkCount; index++) {
+		if (mqttDebugEnabled)
+			printf("%s - attempting to connect to mqtt broker %s.\n", __func__, mqttLinks[index].mqtt->broker());
+		if (mqttLinks[index].mqtt->connect() < 0) return false;
+	}
+	return true;
+}
+
+/**
+ * @returns true if at least one link is connected
+ */
+bool mqtt_any_connected(void) {
+	for (int index = 0; index < mqttLinkCount; index++) {
+		if (mqttLinks[index].mqtt->isConnected()) return true;
+	}
+	return false;
+}
+
+/**
+ * Subscribe tags to MQTT broker
+ * Iterate over tag store and process every "subscribe" tag
+ */
+void mqtt_subscribe_tags(mqttlink *link) {
+	//printf("%s - Start\n", __func__);
+	if (!link->subscribe) return;
+	for (int index = 0; index < plWriteTagCount; index++) {
+		//printf("%s: %s\n", __func__, plWriteTags[index].getTopic());
+		link->mqtt->subscribe(plWriteTags[index].getTopic());
+	}
+	//printf("%s - Done\n", __func__);
+}
+
+/**
+ * callback function for MQTT
+ * MQTT notifies a change in connection status by calling this function
+ * from MQTT::process(). Reconnects and broker failover are handled by MQTT.
+ * This function is registered with MQTT during initialisation
+ */
+void mqtt_connection_status(MQTT *m, bool status) {
+	mqttlink *link = NULL;
+	//printf("%s - %d\n", __func__, status);
+	for (int index = 0; index < mqttLinkCount; index++) {
+		if (mqttLinks[index].mqtt == m) link = &mqttLinks[index];
+	}
+	if (link == NULL) return;
+	// subscribe tags when connection is online
+	if (status) {
+		log(LOG_INFO, "Connected to MQTT broker [%s] (%s)", m->broker(), m->name());
+		m->setRetain(mqtt_retain_default);
+		mqtt_subscribe_tags(link);
+		resync_start(link);
+		alarm_publish_link(m);
+		energy_publish_link(m);
+	} else {
+		log(LOG_WARNING, "Disconnected from MQTT broker [%s] (%s)", m->broker(), m->name());
+	}
+	//printf("%s - done\n", __func__);
+}
+
+/**
+ * callback function for MQTT
+ * MQTT notifies when a subscribed topic has received an update
+ * called from MQTT::process() on the main loop thread
+ * @param topic: topic string
+ * @param value: value as a string
+ * Note: do not store the pointers "topic" & "value", they will be
+ * destroyed after this function returns
+ */
+void mqtt_topic_update(const struct mosquitto_message *message) {
+	char payload[32];
+	int len, index;
+	struct timespec now;
+	PLtag *tp = NULL;
+
+	//printf("%s - %s\n", __func__, message->topic);
+	clock_gettime(CLOCK_MONOTONIC, &now);
+	for (index = 0; index < plWriteTagCount; index++) {
+		if (strcmp(plWriteTags[index].getTopic(), message->topic) == 0) {
+			tp = &plWriteTags[index];
+			break;
+		}
+	}
+	if (tp == NULL) {
+		fprintf(stderr, "%s: <%s> not a write tag\n", __func__, message->topic);
+		return;
+	}
+	if ((message->payload == NULL) || (message->payloadlen < 1)) return;
+	if (message->retain && tp->getIgnoreRetained()) return;
+
+	// payload is not null terminated
+	len = message->payloadlen < (int)sizeof(payload) - 1 ? message->payloadlen : (int)sizeof(payload) - 1;
+	memcpy(payload, message->payload, len);
+	payload[len] = 0;
+
+	// a retained bit command would be applied again on every resubscribe
+	if (message->retain && (tp->getBit() >= 0)) {
+		log(LOG_WARNING, "retained bit command ignored [%s]", message->topic);
+		return;
+	}
+
+	tp->setToggle((payload[0] == 't') || (payload[0] == 'T'));
+	if (!tp->getToggle())
+		tp->setValue(atof(payload));
+	tp->setWriteRequestTime(&now);
+	tp->setWritePending(true);		// write is performed in main loop
+}
+
+/**
+ * Compare the size of PUBLISH packets for all read tags (command line option -b)
+ * every tag is read once from the PL device, nothing is published.
+ * MQTT v5 sizes are for an established topic alias (steady state).
+ */
+void mqtt_benchmark(void) {
+	uint8_t fixed[MQTT_FIXED_PAYLOAD_MAX];
+	char text[100];
+	int textLen, fixedLen, topicLen, size[4];
+	long total[4] = {0, 0, 0, 0};
+	float value;
+	PLtag *tag;
+
+	printf("%-40s %8s %8s %8s %8s\n", "topic", "v3 text", "v3 fixed", "v5 text", "v5 fixed");
+	for (int index = 0; index < plTagCount; index++) {
+		tag = &plReadTags[index];
+		if (tag->getTopicString().empty()) continue;
+		pl_read_tag(tag);
+		value = tag->isNoread() ? tag->getNoreadValue() : tag->getScaledValue();
+		textLen = snprintf(text, sizeof(text), tag->getFormat(), value);
+		fixedLen = MQTT::fixed_encode(value, MQTT::format_decimals(tag->getFormat()), fixed);
+		if (tag->isRange()) {		// array payloads are always text
+			textLen = tag->getRangePayload().length();
+			fixedLen = textLen;
+		}
+		topicLen = tag->getTopicString().length();
+		size[0] = MQTT::publish_packet_size(topicLen, textLen, 0, -1);
+		size[1] = MQTT::publish_packet_size(topicLen, fixedLen, 0, -1);
+		size[2] = MQTT::publish_packet_size(0, textLen, 0, 3);		// topic alias property
+		size[3] = MQTT::publish_packet_size(0, fixedLen, 0, 3);
+		printf("%-40s %8d %8d %8d %8d\n", tag->getTopic(), size[0], size[1], size[2], size[3]);
+		for (int i = 0; i < 4; i++) total[i] += size[i];
+	}
+	printf("%-40s %8ld %8ld %8ld %8ld\n", "total [bytes]", total[0], total[1], total[2], total[3]);
+	if (total[0] > 0) {
+		printf("%-40s %7ld%% %7ld%% %7ld%% %7ld%%\n", "relative to v3 text", 100L, total[1] * 100 / total[0],
+			total[2] * 100 / total[0], total[3] * 100 / total[0]);
+	}
+}
+
+/**
+ * Publish the current tag value, an array payload for range tags
+ */
+void mqtt_publish_tag_value(MQTT *m, PLtag *tag) {
+	if (tag->isRange())
+		m->publish_payload(tag->getTopic(), tag->getRangePayload().c_str(), tag->getPublishRetain());
+	else
+		m->publish(tag->getTopic(), tag->getFormat(), tag->getScaledValue(), tag->getPublishRetain());
+}
+
+/**
+ * Publish tag to one MQTT link
+ * @param m: link connection
+ * @param tag: PLtag to publish
+ */
+void mqtt_publish_tag_link(MQTT *m, PLtag *tag) {
+	// Publish value if read was OK
+	if (!tag->isNoread()) {
+		mqtt_publish_tag_value(m, tag);
+		//printf("%s - %s \n", __FUNCTION__, tag->getTopic());
+		return;
+	}
+	//printf("%s - NoRead: %s \n", __FUNCTION__, tag->getTopic());
+	// Handle Noread
+	if (!tag->noReadIgnoreExceeded()) return;		// ignore noread, do nothing
+	// noreadignore is exceeded, need to take action
+	switch (tag->getNoreadAction()) {
+	case 0:	// publish null value
+		m->clear_retained_message(tag->getTopic());
+		break;
+	case 1:	// publish noread value
+		m->publish(tag->getTopic(), tag->getFormat(), tag->getNoreadValue(), tag->getPublishRetain());
+		break;
+	default:
+		// do nothing (default, -1)
+		break;
+	}
+}
+
+/**
+ * Publish tag to all MQTT links
+ * links which are not connected or have a full publish queue are skipped
+ * @param tag: PLtag to publish
+ * @returns mask of links the tag could not be published to
+ */
+uint16_t mqtt_publish_tag(PLtag *tag) {
+	uint16_t missed = 0;
+	if (tag->getTopicString().empty()) return 0;	// don't publish if topic is empty
+	for (int index = 0; index < mqttLinkCount; index++) {
+		if (!mqttLinks[index].mqtt->canPublish()) {
+			missed |= (1 << index);
+			continue;
+		}
+		mqtt_publish_tag_link(mqttLinks[index].mqtt, tag);
+	}
+	return missed;
+}
+
+/**
+ * Publish noread value to all tags (normally done on program exit)
+ * @param publish_noread: publish the "noread" value of the tag
+ * @param clear_retain: clear retained value from broker's persistance store
+ */
+void mqtt_clear_tags(bool publish_noread = true, bool clear_retain = true) {
+
+	int index = 0, tagIndex = 0;
+	int *tagArray;
+	PLtag *plTag;
+	//printf("%s", __func__);
+
+	// Iterate over pl tag array
+	//mqtt.setRetain(false);
+	while (updateCycles[index].ident >= 0) {
+		// ignore if cycle has no tags to process
+		if (updateCycles[index].tagArray == NULL) {
+			index++; continue;
+		}
+		// get array for tags
+		tagArray = updateCycles[index].tagArray;
+		// read each tag in the array
+		tagIndex = 0;
+		while (tagArray[tagIndex] >= 0) {
+			plTag = &plReadTags[tagArray[tagIndex]];
+			for (int link = 0; link < mqttLinkCount; link++) {
+				if (!mqttLinks[link].mqtt->isConnected()) continue;
+				if (publish_noread)
+					mqttLinks[link].mqtt->publish(plTag->getTopic(), plTag->getFormat(), plTag->getNoreadValue(), plTag->getPublishRetain());
+					//mqtt_publish_tag(mbTag, true);			// publish noread value
+				if (clear_retain)
+					mqttLinks[link].mqtt->clear_retained_message(plTag->getTopic());	// clear retained status
+			}
+			tagIndex++;
+		}
+		index++;
+	}	// while 
+
+	// Iterate over local tags (e.g. CPU temp)
+/*
+	Tag *tag = ts.getFirstTag();
+	while (tag != NULL) {
+		if (tag->isPublish()) {
+			mqtt.clear_retained_message(tag->getTopic());
+		}
+		tag = ts.getNextTag();
+	}
+*/
+}
+
+#pragma mark Offline
+
+/**
+ * hash of the read tag configuration
+ * used to discard offline rings and snapshots written with a different tag list
+ */
+uint32_t tag_config_hash(void) {
+	uint32_t hash = 2166136261u;		// FNV-1a
+	const char *str;
+	for (int index = 0; index < plTagCount; index++) {
+		str = plReadTags[index].getTopic();
+		while (*str) {
+			hash = (hash ^ (uint8_t)*str++) * 16777619u;
+		}
+		hash = (hash ^ plReadTags[index].getAddress()) * 16777619u;
+	}
+	return hash;
+}
+
+
+/**
+ * initialise offline acquisition (optional)
+ * @returns false for configuration error, otherwise true
+ */
+bool offline_init(void) {
+	string fileName;
+	int size = OFFLINE_RING_SIZE_DEFAULT;
+	int replayRate = OFFLINE_REPLAY_RATE_DEFAULT;
+
+	if (!cfg.exists("offline")) return true;		// optional
+	if (!cfg_get_str("offline.file", fileName)) return false;
+	cfg.lookupValue("offline.size", size);
+	cfg.lookupValue("offline.replay_rate", replayRate);
+	cfg.lookupValue("offline.replay_suffix", offlineReplaySuffix);
+	cfg.lookupValue("offline.dropped_topic", offlineDroppedTopic);
+	for (int index = 0; index < mqttLinkCount; index++) {
+		ratelimit_init(&mqttLinks[index].replayLimit, replayRate);
+	}
+
+	if (offlineRing.open(fileName.c_str(), size, tag_config_hash()) < 0) {
+		log(LOG_ERR, "Unable to open offline ring <%s>", fileName.c_str());
+		return false;
+	}
+	log(LOG_INFO, "Offline ring <%s> %d samples, %d pending replay", fileName.c_str(), size, offlineRing.count());
+	return true;
+}
+
+/**
+ * store a tag value which could not be published
+ * @param links: mask of links which did not receive the value
+ */
+void offline_store(PLtag *tag, uint16_t links) {
+	struct timespec now;
+	if (!offlineRing.isOpen() || (links == 0)) return;
+	if (tag->isNoread() || tag->getTopicString().empty() || tag->isRange()) return;	// ring holds single values
+	clock_gettime(CLOCK_REALTIME, &now);
+	offlineRing.append(tag - plReadTags, tag->getScaledValue(), ((int64_t)now.tv_sec * 1000) + (now.tv_nsec / 1000000), links);
+	offlineStored = true;
+}
+
+/**
+ * replay stored samples to one link at a limited rate while connected
+ * samples are published to <topic><replay_suffix> as "<timestamp>,<value>"
+ * the timestamp is the original sample time in seconds with ms resolution
+ * @param linkIdx: index of the link in mqttLinks
+ * @returns true if samples were replayed
+ */
+bool offline_replay_process(int linkIdx) {
+	sample_record rec;
+	char payload[80];
+	int len;
+	bool retval = false;
+	mqttlink *link = &mqttLinks[linkIdx];
+
+	if (!offlineRing.isOpen()) return false;
+	while (link->mqtt->canPublish() && offlineRing.peek(linkIdx, &rec) && ratelimit_take(&link->replayLimit)) {
+		if ((int)rec.tagIndex >= plTagCount) {
+			offlineRing.pop(linkIdx);
+			continue;
+		}
+		PLtag *tag = &plReadTags[rec.tagIndex];
+		len = snprintf(payload, sizeof(payload), "%lld.%03d,", (long long)(rec.timestamp_ms / 1000), (int)(rec.timestamp_ms % 1000));
+		snprintf(payload + len, sizeof(payload) - len, tag->getFormat(), rec.value);
+		// the sample stays in the ring until it has been published
+		if (link->mqtt->publish_payload((tag->getTopicString() + offlineReplaySuffix).c_str(), payload, false) < 0) break;
+		offlineRing.pop(linkIdx);
+		retval = true;
+	}
+	if (retval) offlineRing.sync();
+	return retval;
+}
+
+/**
+ * report samples lost to ring overflow once a link is available
+ * the count is published to offline.dropped_topic and restarts after the report
+ */
+void offline_dropped_process(void) {
+	uint32_t dropped;
+	bool published = false;
+
+	if (!offlineRing.isOpen() || ((dropped = offlineRing.dropped()) == 0)) return;
+	for (int index = 0; index < mqttLinkCount; index++) {
+		if (!mqttLinks[index].mqtt->canPublish()) continue;
+		if (offlineDroppedTopic.empty() ||
+			(mqttLinks[index].mqtt->publish(offlineDroppedTopic.c_str(), "%.0f", dropped, false) >= 0)) published = true;
+	}
+	if (!published) return;
+	log(LOG_WARNING, "Offline ring overflow, %u samples lost", dropped);
+	offlineRing.resetDropped();
+	offlineRing.sync();
+}
+
+#pragma mark Time series
+
+/**
+ * open the local time-series store (optional)
+ * every read tag is a column, columns are numbered like the read tags
+ * @returns false for configuration error, otherwise true
+ */
+bool timeseries_init(void) {
+	string dirName;
+	int segmentSize = TIMESERIES_SEGMENT_SIZE_DEFAULT;
+	int segments = TIMESERIES_SEGMENTS_DEFAULT;
+
+	if (!cfg.exists("timeseries")) return true;		// optional
+	if (!cfg_get_str("timeseries.dir", dirName)) return false;
+	cfg.lookupValue("timeseries.segment_size", segmentSize);
+	cfg.lookupValue("timeseries.segments", segments);
+	cfg.lookupValue("timeseries.flush_interval", tsFlushInterval);
+	if (tsFlushInterval < 1) tsFlushInterval = TIMESERIES_FLUSH_INTERVAL_DEFAULT;
+
+	if (tsStore.open(dirName.c_str(), (uint32_t)segmentSize * 1024, segments) < 0) {
+		log(LOG_ERR, "Unable to open time-series store in <%s>", dirName.c_str());
+		return false;
+	}
+	for (int index = 0; index < plTagCount; index++) {
+		tsStore.addColumn(plReadTags[index].getTopic());
+	}
+	tsNextFlushTime = time(NULL) + tsFlushInterval;
+	log(LOG_INFO, "Time-series store <%s> %d segments of %dkB, written every %ds", dirName.c_str(), segments,
+		segmentSize, tsFlushInterval);
+	return true;
+}
+
+/**
+ * add the value of a tag to the time-series store
+ */
+void timeseries_store(PLtag *tag) {
+	struct timespec now;
+	ts_sample sample;
+	if (!tsStore.isOpen()) return;
+	if (tag->isNoread() || tag->getTopicString().empty() || tag->isRange()) return;	// store holds single values
+	clock_gettime(CLOCK_REALTIME, &now);
+	sample.time_ms = ((int64_t)now.tv_sec * 1000) + (now.tv_nsec / 1000000);
+	sample.value = tag->getScaledValue();
+	tsStore.append(tag - plReadTags, sample);
+}
+
+/**
+ * write the buffered samples to the store at the flush interval
+ */
+void timeseries_process(void) {
+	time_t now = time(NULL);
+	if (!tsStore.isOpen() || (now < tsNextFlushTime)) return;
+	tsStore.flush();
+	tsNextFlushTime = now + tsFlushInterval;
+}
+
+#pragma mark Aggregation
+
+/**
+ * publish the aggregates of an ended window
+ * <topic> receives the last value, <topic>/min, /max and /mean the aggregates
+ * @param now: time which ends the window
+ */
+void aggregate_close(PLtag *tag, time_t now) {
+	tagaggregate agg;
+	string topic = tag->getTopicString();
+	uint16_t missed = 0;
+	MQTT *m;
+
+	if (!tag->aggregateClose(now, &agg) || topic.empty()) return;
+	for (int index = 0; index < mqttLinkCount; index++) {
+		m = mqttLinks[index].mqtt;
+		if (!m->canPublish()) {
+			missed |= (1 << index);
+			continue;
+		}
+		m->publish((topic + "/min").c_str(), tag->getFormat(), agg.min, tag->getPublishRetain());
+		m->publish((topic + "/max").c_str(), tag->getFormat(), agg.max, tag->getPublishRetain());
+		m->publish((topic + "/mean").c_str(), tag->getFormat(), (float)(agg.sum / agg.count), tag->getPublishRetain());
+		m->publish(tag->getTopic(), tag->getFormat(), agg.last, tag->getPublishRetain());
+	}
+	offline_store(tag, missed);		// the tag value is still the last value of the window
+}
+
+/**
+ * close the windows which have ended, also if no sample arrives (e.g. device down)
+ */
+void aggregate_process(void) {
+	time_t now = pl_time();
+	for (int index = 0; index < plTagCount; index++) {
+		if (plReadTags[index].isAggregate()) aggregate_close(&plReadTags[index], now);
+	}
+}
+
+#pragma mark Derived tags
+
+/**
+ * resolve a tag name in an expression
+ * read tags and the derived tags configured so far can be used
+ */
+PLtag *derived_lookup(const char *name) {
+	for (int index = 0; index < plTagCount; index++) {
+		if (plReadTags[index].getName() == name) return &plReadTags[index];
+	}
+	for (int index = 0; index < derivedTagCount; index++) {
+		if (derivedTags[index].getName() == name) return &derivedTags[index];
+	}
+	return NULL;
+}
+
+/**
+ * configure tags which are computed from other tags (optional)
+ * the expressions are compiled once, a derived tag can use the derived tags listed before it
+ * @returns false for configuration error, otherwise true
+ */
+bool derived_init(void) {
+	string strValue, expression;
+	float fValue;
+	bool bValue;
+	int numTags;
+
+	if (!cfg.exists("derived")) return true;		// optional
+	Setting& derivedSettings = cfg.lookup("derived");
+	numTags = derivedSettings.getLength();
+	derivedTags = new PLtag[numTags + 1];
+	derivedDefs = new derivedtag[numTags + 1];
+	for (int index = 0; index < numTags; index++) {
+		PLtag *tag = &derivedTags[derivedTagCount];
+		derivedtag *def = &derivedDefs[derivedTagCount];
+		if (!derivedSettings[index].lookupValue("topic", strValue) ||
+			!derivedSettings[index].lookupValue("expression", expression)) {
+			log(LOG_ERR, "Config error - derived tag %d needs topic and expression", index + 1);
+			return false;
+		}
+		tag->setTopic(strValue.c_str());
+		tag->setPublishRetain(mqtt_retain_default);
+		if (derivedSettings[index].lookupValue("name", strValue)) tag->setName(strValue.c_str());
+		if (derivedSettings[index].lookupValue("retain", bValue)) tag->setPublishRetain(bValue);
+		if (derivedSettings[index].lookupValue("format", strValue)) tag->setFormat(strValue.c_str());
+		def->deadband = 0;
+		if (derivedSettings[index].lookupValue("deadband", fValue)) def->deadband = fabs(fValue);
+		def->published = false;
+		def->publishedValue = 0;
+		def->inputSeq = 0;
+		def->expression = new Expression();
+		if (def->expression->compile(expression.c_str(), derived_lookup) < 0) {
+			log(LOG_ERR, "Config error - derived tag <%s>: %s in \"%s\"", tag->getTopic(),
+				def->expression->error().c_str(), expression.c_str());
+			return false;
+		}
+		derivedTagCount++;
+	}
+	log(LOG_INFO, "%d derived tags", derivedTagCount);
+	return true;
+}
+
+/**
+ * evaluate the derived tags whose inputs have new values
+ * a value is published if it differs from the last published value by more than the deadband
+ */
+void derived_process(void) {
+	unsigned long inputSeq;
+	double value;
+
+	for (int index = 0; index < derivedTagCount; index++) {
+		PLtag *tag = &derivedTags[index];
+		derivedtag *def = &derivedDefs[index];
+		const std::vector<PLtag *> &inputs = def->expression->inputs();
+
+		inputSeq = 0;
+		for (size_t i = 0; i < inputs.size(); i++) {
+			if (inputs[i]->updateSeq > inputSeq) inputSeq = inputs[i]->updateSeq;
+		}
+		if (inputSeq <= def->inputSeq) continue;		// no new input value
+		def->inputSeq = inputSeq;
+		if (!def->expression->evaluate(&value)) continue;
+		tag->setValue(value);
+		tag->updateSeq = ++tagUpdateSeq;		// derived tags listed later see the new value
+		tag->updateTime_ms = pl_monotonic_ms();
+		alarm_check(tag);
+		if (def->published && (fabs(value - def->publishedValue) <= def->deadband)) continue;
+		mqtt_publish_tag(tag);
+		def->published = true;
+		def->publishedValue = value;
+	}
+}
+
+#pragma mark Energy
+
+/**
+ * restore the accumulators from the state file
+ */
+void energy_load(void) {
+	char line[256];
+	FILE *fp = fopen(energyFileName.c_str(), "r");
+	int restored = 0;
+
+	if (fp == NULL) return;			// first run
+	while (fgets(line, sizeof(line), fp) != NULL) {
+		for (size_t index = 0; index < energyIntegrators.size(); index++) {
+			if (energyIntegrators[index].restore(line)) restored++;
+		}
+	}
+	fclose(fp);
+	log(LOG_INFO, "Energy accumulators restored for %d of %d integrators", restored, (int)energyIntegrators.size());
+}
+
+/**
+ * save the accumulators, the state file is replaced atomically
+ */
+void energy_save(void) {
+	string tmpName = energyFileName + ".tmp";
+	FILE *fp;
+	bool ok;
+
+	if (energyIntegrators.empty() || energyFileName.empty()) return;
+	fp = fopen(tmpName.c_str(), "w");
+	if (fp == NULL) {
+		log(LOG_WARNING, "Unable to save energy accumulators to <%s>", tmpName.c_str());
+		return;
+	}
+	for (size_t index = 0; index < energyIntegrators.size(); index++) {
+		energyIntegrators[index].save(fp);
+	}
+	ok = (ferror(fp) == 0);
+	if (fclose(fp) != 0) ok = false;
+	if (!ok || (rename(tmpName.c_str(), energyFileName.c_str()) != 0)) {
+		log(LOG_WARNING, "Unable to save energy accumulators to <%s>", energyFileName.c_str());
+		unlink(tmpName.c_str());
+	}
+}
+
+/**
+ * configure the energy integrators (optional)
+ * @returns false for configuration error, otherwise true
+ */
+bool energy_init(void) {
+	string name, topic, current, counter, voltage;
+	double maxGap, rollover;
+	PLtag *input, *voltageTag;
+	int numIntegrators;
+
+	if (!cfg.exists("energy")) return true;		// optional
+	if (!cfg_get_str("energy.file", energyFileName)) return false;
+	cfg.lookupValue("energy.save_interval", energySaveInterval);
+	cfg.lookupValue("energy.publish_interval", energyPublishInterval);
+	cfg.lookupValue("energy.format", energyFormat);
+	cfg.lookupValue("energy.retain", energyRetain);
+	if (energySaveInterval < 1) energySaveInterval = ENERGY_SAVE_INTERVAL_DEFAULT;
+	if (energyPublishInterval < 1) energyPublishInterval = ENERGY_PUBLISH_INTERVAL_DEFAULT;
+	if (!cfg.exists("energy.integrators")) return true;
+
+	Setting& integratorSettings = cfg.lookup("energy.integrators");
+	numIntegrators = integratorSettings.getLength();
+	energyIntegrators.resize(numIntegrators);
+	for (int index = 0; index < numIntegrators; index++) {
+		EnergyIntegrator *integrator = &energyIntegrators[index];
+		if (!integratorSettings[index].lookupValue("name", name) || !integratorSettings[index].lookupValue("topic", topic)) {
+			log(LOG_ERR, "Config error - energy integrator %d needs name and topic", index + 1);
+			return false;
+		}
+		// input tags are referred to by tag name, like in derived tags
+		voltageTag = NULL;
+		if (integratorSettings[index].lookupValue("voltage", voltage) && ((voltageTag = derived_lookup(voltage.c_str())) == NULL)) {
+			log(LOG_ERR, "Config error - energy integrator <%s>: unknown tag <%s>", name.c_str(), voltage.c_str());
+			return false;
+		}
+		if (integratorSettings[index].lookupValue("current", current)) {
+			if ((input = derived_lookup(current.c_str())) == NULL) {
+				log(LOG_ERR, "Config error - energy integrator <%s>: unknown tag <%s>", name.c_str(), current.c_str());
+				return false;
+			}
+			maxGap = ENERGY_MAX_GAP_DEFAULT;
+			integratorSettings[index].lookupValue("max_gap", maxGap);
+			integrator->setCurrent(name.c_str(), input, voltageTag, maxGap);
+		} else if (integratorSettings[index].lookupValue("counter", counter)) {
+			if ((input = derived_lookup(counter.c_str())) == NULL) {
+				log(LOG_ERR, "Config error - energy integrator <%s>: unknown tag <%s>", name.c_str(), counter.c_str());
+				return false;
+			}
+			rollover = 0;
+			integratorSettings[index].lookupValue("rollover", rollover);
+			integrator->setCounter(name.c_str(), input, voltageTag, rollover);
+		} else {
+			log(LOG_ERR, "Config error - energy integrator <%s> needs a current or counter tag", name.c_str());
+			return false;
+		}
+		energyTopics.push_back(topic);
+	}
+	energy_load();
+	energyNextSaveTime = time(NULL) + energySaveInterval;
+	energyNextPublishTime = 0;		// publish restored values right away
+	log(LOG_INFO, "%d energy integrators, state <%s>", numIntegrators, energyFileName.c_str());
+	return true;
+}
+
+/**
+ * publish the accumulators of an integrator to a link
+ * @param yesterday: include the totals of the previous day
+ */
+void energy_publish(MQTT *m, int index, bool yesterday) {
+	const energy_totals &totals = energyIntegrators[index].totals();
+	const char *format = energyFormat.c_str();
+
+	if (yesterday) {
+		m->publish((energyTopics[index] + "/yesterday_ah").c_str(), format, (float)totals.prevDayAh, energyRetain);
+		m->publish((energyTopics[index] + "/yesterday_wh").c_str(), format, (float)totals.prevDayWh, energyRetain);
+	}
+	m->publish((energyTopics[index] + "/day_ah").c_str(), format, (float)totals.dayAh, energyRetain);
+	m->publish((energyTopics[index] + "/day_wh").c_str(), format, (float)totals.dayWh, energyRetain);
+	m->publish((energyTopics[index] + "/total_ah").c_str(), format, (float)totals.totalAh, energyRetain);
+	m->publish((energyTopics[index] + "/total_wh").c_str(), format, (float)totals.totalWh, energyRetain);
+}
+
+/**
+ * publish all accumulators to a link which (re)connected
+ * so a link which was down at the day change gets the previous day too
+ */
+void energy_publish_link(MQTT *m) {
+	for (size_t index = 0; index < energyIntegrators.size(); index++) {
+		energy_publish(m, (int)index, true);
+	}
+}
+
+/**
+ * integrate new samples, publish and save the accumulators at their intervals
+ * the previous day is published to <topic>/yesterday_ah and /yesterday_wh when the day changes,
+ * the day change is kept until a link is connected
+ */
+void energy_process(void) {
+	int today;
+	time_t now;
+	bool connected, publish, dayChange;
+
+	if (energyIntegrators.empty()) return;
+	today = PLhistory::localDay(pl_time());
+	now = time(NULL);
+	connected = mqtt_any_connected();
+	publish = (now >= energyNextPublishTime) && connected;
+	for (size_t index = 0; index < energyIntegrators.size(); index++) {
+		EnergyIntegrator *integrator = &energyIntegrators[index];
+		integrator->update(today);
+		dayChange = connected && integrator->takeDayChange();
+		if (!publish && !dayChange) continue;
+		for (int link = 0; link < mqttLinkCount; link++) {
+			if (mqttLinks[link].mqtt->canPublish()) energy_publish(mqttLinks[link].mqtt, (int)index, dayChange);
+		}
+	}
+	if (publish) energyNextPublishTime = now + energyPublishInterval;
+	if (now >= energyNextSaveTime) {
+		energy_save();
+		energyNextSaveTime = now + energySaveInterval;
+	}
+}
+
+#pragma mark Alarms
+
+/**
+ * collect the read tags an alarm depends on, derived tags are resolved to their inputs
+ */
+void alarm_boost_tags(PLtag *tag, std::vector<int> &tags) {
+	if ((tag >= &plReadTags[0]) && (tag < &plReadTags[plTagCount])) {
+		if (find(tags.begin(), tags.end(), (int)(tag - plReadTags)) == tags.end())
+			tags.push_back((int)(tag - plReadTags));
+		return;
+	}
+	for (int index = 0; index < derivedTagCount; index++) {
+		if (tag != &derivedTags[index]) continue;
+		const std::vector<PLtag *> &inputs = derivedDefs[index].expression->inputs();
+		for (size_t i = 0; i < inputs.size(); i++) alarm_boost_tags(inputs[i], tags);
+	}
+}
+
+/**
+ * configure the alarm rules (optional)
+ * the rule is "states" if a state list is given, "rate" for rate_high/rate_low, otherwise threshold (high/low)
+ * @returns false for configuration error, otherwise true
+ */
+bool alarm_init(void) {
+	string tagName;
+	double high, low, hysteresis;
+	int debounce_ms, numAlarms;
+	PLtag *tag;
+	std::vector<int> states;
+
+	if (!cfg.exists("alarms")) return true;		// optional
+	Setting& alarmSettings = cfg.lookup("alarms");
+	numAlarms = alarmSettings.getLength();
+	alarms.resize(numAlarms);
+	alarmDefs.resize(numAlarms);
+	for (int index = 0; index < numAlarms; index++) {
+		Alarm *alarm = &alarms[index];
+		alarmdef *def = &alarmDefs[index];
+		if (!alarmSettings[index].lookupValue("name", def->name) || !alarmSettings[index].lookupValue("tag", tagName) ||
+			!alarmSettings[index].lookupValue("topic", def->topic)) {
+			log(LOG_ERR, "Config error - alarm %d needs name, tag and topic", index + 1);
+			return false;
+		}
+		// tags are referred to by name, like in derived tags
+		if ((tag = derived_lookup(tagName.c_str())) == NULL) {
+			log(LOG_ERR, "Config error - alarm <%s>: unknown tag <%s>", def->name.c_str(), tagName.c_str());
+			return false;
+		}
+		if (tag->isRange()) {
+			log(LOG_ERR, "Config error - alarm <%s>: range tag <%s> not supported", def->name.c_str(), tagName.c_str());
+			return false;
+		}
+		high = low = NAN;
+		hysteresis = 0;
+		alarmSettings[index].lookupValue("hysteresis", hysteresis);
+		if (alarmSettings[index].exists("states")) {
+			Setting& stateSettings = alarmSettings[index].lookup("states");
+			states.clear();
+			for (int i = 0; i < stateSettings.getLength(); i++) states.push_back(stateSettings[i]);
+			alarm->setStates(tag, states);
+		} else if (alarmSettings[index].exists("rate_high") || alarmSettings[index].exists("rate_low")) {
+			alarmSettings[index].lookupValue("rate_high", high);
+			alarmSettings[index].lookupValue("rate_low", low);
+			alarm->setRate(tag, high, low, hysteresis);
+		} else {
+			alarmSettings[index].lookupValue("high", high);
+			alarmSettings[index].lookupValue("low", low);
+			if (isnan(high) && isnan(low)) {
+				log(LOG_ERR, "Config error - alarm <%s> needs high/low, rate_high/rate_low or states", def->name.c_str());
+				return false;
+			}
+			alarm->setThreshold(tag, high, low, hysteresis);
+		}
+		debounce_ms = 0;
+		alarmSettings[index].lookupValue("debounce_ms", debounce_ms);
+		alarm->setDebounce((debounce_ms > 0) ? debounce_ms : 0);
+		def->retain = true;
+		alarmSettings[index].lookupValue("retain", def->retain);
+		def->boostInterval_ms = 0;
+		alarmSettings[index].lookupValue("boost_interval_ms", def->boostInterval_ms);
+		if (def->boostInterval_ms < 0) def->boostInterval_ms = 0;
+		def->nextBoost_ms = 0;
+		if (def->boostInterval_ms > 0) alarm_boost_tags(tag, def->boostTags);
+	}
+	log(LOG_INFO, "%d alarms", numAlarms);
+	return true;
+}
 
-	return retval;
+/**
+ * publish the state of an alarm to one link: <topic> 1/0 and <topic>/value at the edge
+ */
+void alarm_publish(MQTT *m, int index) {
+	Alarm *alarm = &alarms[index];
+	alarmdef *def = &alarmDefs[index];
+
+	if (!m->canPublish()) return;
+	m->publish(def->topic.c_str(), "%.0f", alarm->isActive() ? 1 : 0, def->retain);
+	m->publish((def->topic + "/value").c_str(), alarm->getTag()->getFormat(), alarm->getEdgeValue(), def->retain);
 }
 
-/** Process all variables
- * @return true if at least one variable was processed
- * Note: the return value from this function is used
- * to measure processing time
+/**
+ * publish the states of all alarms to a link which (re)connected
  */
-bool process() {
-	bool retval = false;
-	if (mqtt.isConnected()) {
-		if (pl_read_process()) retval = true;
+void alarm_publish_link(MQTT *m) {
+	for (size_t index = 0; index < alarms.size(); index++) {
+		alarm_publish(m, (int)index);
 	}
-//	var_process();	// don't want it in time measuring, doesn't take up much time
-	return retval;
 }
 
-bool init_values(void)
-{
-
-	char info1[80], info2[80], info3[80], info4[80];
+/**
+ * publish an edge at once to all links
+ */
+void alarm_edge_publish(int index, alarm_edge edge) {
+	if (edge == ALARM_EDGE_NONE) return;
+	log((edge == ALARM_EDGE_RAISED) ? LOG_WARNING : LOG_INFO, "Alarm <%s> %s, value %g", alarmDefs[index].name.c_str(),
+		(edge == ALARM_EDGE_RAISED) ? "raised" : "cleared", alarms[index].getEdgeValue());
+	for (int link = 0; link < mqttLinkCount; link++) {
+		alarm_publish(mqttLinks[link].mqtt, index);
+	}
+	if (edge == ALARM_EDGE_RAISED) alarmDefs[index].nextBoost_ms = 0;		// start boosted reads right away
+}
 
-    // get hardware info
-    hw.get_model_name(info1, sizeof(info1));
-    hw.get_os_name(info2, sizeof(info2));
-    hw.get_kernel_name(info3, sizeof(info3));
-    hw.get_ip_address(info4, sizeof(info4));
-    info_label_text = (char *)malloc(strlen(info1) +strlen(info2) +strlen(info3) +strlen(info4) +5);
-    sprintf(info_label_text, "%s\n%s\n%s\n%s", info1, info2, info3, info4);
-    if (!runningAsDaemon) {
-	    printf(info_label_text);
-        }
-    //printf(info_label_text);
-    return true;
+/**
+ * evaluate the alarms of a tag which has been read or computed
+ */
+void alarm_check(PLtag *tag) {
+	for (size_t index = 0; index < alarms.size(); index++) {
+		if (alarms[index].getTag() != tag) continue;
+		alarm_edge_publish((int)index, alarms[index].check(tag->updateTime_ms));
+	}
 }
 
-#pragma mark MQTT
+/**
+ * complete debounce times which ended without a new value
+ */
+void alarm_process(void) {
+	int64_t now_ms;
 
-/** Initialise the tag database (tagstore)
- * @return false on failure
+	if (alarms.empty()) return;
+	now_ms = pl_monotonic_ms();
+	for (size_t index = 0; index < alarms.size(); index++) {
+		alarm_edge_publish((int)index, alarms[index].process(now_ms));
+	}
+}
+
+/**
+ * read the tags of active (or pending) alarms at the boost interval,
+ * in addition to their update cycle
+ * @return false if there was nothing to process, otherwise true
  */
-bool init_tags(void) {
-//	Tag* tp = NULL;
-	std::string strValue;
-//	int numTags, iVal, i;
-//	bool bVal;
+bool alarm_boost_process(int64_t now_ms) {
+	bool retval = false;
 
-//	if (!init_hwtags()) return false;
-	if (!cfg.exists("mqtt_tags")) {	// optional
-		log(LOG_NOTICE,"configuration - parameter \"mqtt_tags\" does not exist");
-		return true;
+	if (plReplay.isOpen()) return false;		// reads are served from the log
+	for (size_t index = 0; (index < alarms.size()) && !plBreaker.open; index++) {
+		alarmdef *def = &alarmDefs[index];
+		if (def->boostTags.empty() || !(alarms[index].isActive() || alarms[index].isPending())) continue;
+		if (now_ms < def->nextBoost_ms) continue;
+		def->nextBoost_ms = now_ms + def->boostInterval_ms;
+		for (size_t i = 0; (i < def->boostTags.size()) && !plBreaker.open; i++) {
+			pl_read_tag(&plReadTags[def->boostTags[i]]);
+			usleep(plTransactionDelay);
 		}
-/*
-	Setting& mqttTagsSettings = cfg.lookup("mqtt_tags");
-	numTags = mqttTagsSettings.getLength();
+		retval = true;
+	}
+	return retval;
+}
 
-	mbWriteTags = new ModbusTag[numTags+1];
-	//printf("%s - %d mqtt tags found\n", __func__, numTags);
-	for (i=0; i < numTags; i++) {
-		if (mqttTagsSettings[i].lookupValue("topic", strValue)) {
-			tp = ts.addTag(strValue.c_str());
-			tp->setSubscribe();
-			tp->registerCallback(modbus_write_request, i);
-			mbWriteTags[i].setTopic(strValue.c_str());
-			if (mqttTagsSettings[i].lookupValue("slaveid", iVal))
-				mbWriteTags[i].setSlaveId(iVal);
-			if (mqttTagsSettings[i].lookupValue("address", iVal))
-				mbWriteTags[i].setAddress(iVal);
-			if (mqttTagsSettings[i].lookupValue("ignoreretained", bVal))
-				mbWriteTags[i].setIgnoreRetained(bVal);
-			if (mqttTagsSettings[i].exists("datatype")) {
-				mqttTagsSettings[i].lookupValue("datatype", strValue);
-				//printf("%s - %s\n", __func__, strValue.c_str());
-				mbWriteTags[i].setDataType(strValue[0]);
-			}
-		}
+#pragma mark Resync
+
+/**
+ * initialise republishing of last known values after reconnect (optional)
+ */
+void resync_init(void) {
+	int rate = RESYNC_RATE_DEFAULT;
+
+	if (cfg.exists("resync")) {		// optional
+		if (!cfg.lookupValue("resync.enabled", resyncEnabled))
+			resyncEnabled = true;
+		cfg.lookupValue("resync.rate", rate);
+		cfg.lookupValue("resync.age_suffix", resyncAgeSuffix);
 	}
-	// Mark end of list
-	mbWriteTags[i].setSlaveId(MODBUS_SLAVE_MAX +1);
-	mbWriteTags[i].setUpdateCycleId(-1);
-	//printf("%s - allocated %d tags, last is index %d\n", __func__, i, i-1);
-*/
-	return true;
+	for (int index = 0; index < mqttLinkCount; index++) {
+		ratelimit_init(&mqttLinks[index].resyncLimit, rate);
+	}
+	if (resyncEnabled)
+		log(LOG_INFO, "Resync after reconnect enabled, %d tags/s", rate);
 }
 
-void mqtt_connect(void) {
-	if (mqttDebugEnabled)
-		printf("%s - attempting to connect to mqtt broker %s.\n", __func__, mqtt.broker());
-	mqtt.connect();
-	mqtt_connection_in_progress = true;
-	mqtt_connect_time = time(NULL);
-	mqtt_next_connect_time = 0;
-	//printf("%s - Done\n", __func__);
+/**
+ * start republishing the last known value of all tags to a link
+ * @param force: republish even if resync after reconnect is not enabled
+ */
+void resync_start(mqttlink *link, bool force) {
+	if (!resyncEnabled && !force) return;
+	link->resyncIndex = 0;
+	link->resyncPending = true;
 }
 
 /**
- * Initialise the MQTT broker and register callbacks
+ * publish last known tag value and sample age in seconds to <topic><age_suffix>
+ * tags in noread state get their noread action instead of the stale value
+ * the serial port is not accessed
  */
-bool mqtt_init(void) {
-	bool bValue;
-	if (!runningAsDaemon) {
-		if (cfg.lookupValue("mqtt.debug", bValue)) {
-			mqttDebugEnabled = bValue;
-			mqtt.setConsoleLog(mqttDebugEnabled);
-			if (mqttDebugEnabled) printf("%s - mqtt debug enabled\n", __func__);
-		}
+void resync_publish_tag(MQTT *m, PLtag *tag, time_t now) {
+	char payload[20];
+	if (tag->getTopicString().empty() || (tag->getLastUpdateTime() == 0)) return;	// never read
+	if (tag->isRange() && tag->getRangePayload().empty()) return;	// range values are not in the snapshot
+	if (tag->isNoread()) {
+		mqtt_publish_tag_link(m, tag);		// noread action of the tag, the last value is stale
+		return;
 	}
-	if (cfg.lookupValue("mqtt.retain_default", bValue))
-		mqtt_retain_default = bValue;
-	mqtt.registerConnectionCallback(mqtt_connection_status);
-	mqtt.registerTopicUpdateCallback(mqtt_topic_update);
-	mqtt_connect();
-	return true;
+	mqtt_publish_tag_value(m, tag);
+	snprintf(payload, sizeof(payload), "%ld", (long)(now - tag->getLastUpdateTime()));
+	m->publish_payload((tag->getTopicString() + resyncAgeSuffix).c_str(), payload, tag->getPublishRetain());
 }
 
 /**
- * Subscribe tags to MQTT broker
- * Iterate over tag store and process every "subscribe" tag
+ * republish last known values to a link in a paced burst
+ * @returns true if tags were published
  */
-void mqtt_subscribe_tags(void) {
-	//printf("%s - Start\n", __func__);
-/*	Tag* tp = ts.getFirstTag();
-	while (tp != NULL) {
-		if (tp->isSubscribe()) {
-			//printf("%s: %s\n", __func__, tp->getTopic());
-			mqtt.subscribe(tp->getTopic());
-		}
-		tp = ts.getNextTag();
+bool resync_process(mqttlink *link) {
+	bool retval = false;
+	time_t now = time(NULL);
+
+	if (!link->resyncPending) return false;
+	while ((link->resyncIndex < plTagCount) && link->mqtt->canPublish() && ratelimit_take(&link->resyncLimit)) {
+		resync_publish_tag(link->mqtt, &plReadTags[link->resyncIndex], now);
+		link->resyncIndex++;
+		retval = true;
 	}
-	//printf("%s - Done\n", __func__);
-*/
+	if (link->resyncIndex >= plTagCount) {
+		link->resyncPending = false;
+		if (debugEnabled)
+			printf("%s - resync complete (%s), %d tags\n", __func__, link->mqtt->name(), plTagCount);
+	}
+	return retval;
 }
 
+#pragma mark Snapshot
+
 /**
- * callback function for MQTT
- * MQTT notifies a change in connection status by calling this function
- * This function is registered with MQTT during initialisation
+ * save snapshot of tag values and cycle phases
  */
-void mqtt_connection_status(bool status) {
-	//printf("%s - %d\n", __func__, status);
-	// subscribe tags when connection is online
-	if (status) {
-		log(LOG_INFO, "Connected to MQTT broker [%s]", mqtt.broker());
-		mqtt_next_connect_time = 0;
-		mqtt_connection_in_progress = false;
-		mqtt.setRetain(mqtt_retain_default);
-		mqtt_subscribe_tags();
-	} else {
-		if (mqtt_connection_in_progress) {
-			mqtt.disconnect();
-			// Note: the timeout is determined by OS network stack
-			unsigned long timeout = time(NULL) - mqtt_connect_time;
-			log(LOG_INFO, "mqtt connection timeout after %lds", timeout);
-			mqtt_connection_in_progress = false;
-		} else {
-			log(LOG_WARNING, "Disconnected from MQTT broker [%s]", mqtt.broker());
-		}
-		if (!exitSignal) {
- 			mqtt_next_connect_time = time(NULL) + MQTT_RECONNECT_INTERVAL;	// current time
- 			log(LOG_INFO, "mqtt reconnect scheduled in %d seconds", MQTT_RECONNECT_INTERVAL);
- 		}
-	}
-	//printf("%s - done\n", __func__);
+void snapshot_write(void) {
+	if (snapshotFileName.empty() || (updateCycles == NULL)) return;
+	if (snapshot_save(snapshotFileName.c_str(), tag_config_hash(), plReadTags, plTagCount, updateCycles) < 0)
+		log(LOG_WARNING, "Unable to save snapshot <%s>", snapshotFileName.c_str());
 }
 
 /**
- * callback function for MQTT
- * MQTT notifies when a subscribed topic has received an update
- * @param topic: topic string
- * @param value: value as a string
- * Note: do not store the pointers "topic" & "value", they will be
- * destroyed after this function returns
+ * restore tag values from snapshot (optional)
+ * restored values are published with their age as soon as the broker is connected
  */
-void mqtt_topic_update(const struct mosquitto_message *message) {
-	//printf("%s - %s %s\n", __func__, topic, value);
-/*	Tag *tp = ts.getTag(message->topic);
-	if (tp == NULL) {
-		fprintf(stderr, "%s: <%s> not  in ts\n", __func__, message->topic);
-	} else {
-		tp->setValueIsRetained(message->retain);
-		if (message->payload != NULL) {
-			tp->setValue((const char*)message->payload);	// This will trigger a callback to modbus_write_request
-		}
-	}*/
+void snapshot_init(void) {
+	int restored;
+	if (!cfg.lookupValue("snapshot.file", snapshotFileName)) return;
+	cfg.lookupValue("snapshot.interval", snapshotInterval);
+	snapshotNextSaveTime = time(NULL) + snapshotInterval;
+	if (updateCycles == NULL) return;
+	restored = snapshot_restore(snapshotFileName.c_str(), tag_config_hash(), plReadTags, plTagCount, updateCycles);
+	if (restored < 0) {
+		log(LOG_NOTICE, "No usable snapshot <%s>", snapshotFileName.c_str());
+		return;
+	}
+	log(LOG_INFO, "Restored %d tag values from snapshot <%s>", restored, snapshotFileName.c_str());
+	for (int index = 0; index < mqttLinkCount; index++) {
+		resync_start(&mqttLinks[index], true);
+	}
 }
 
 /**
- * Publish tag to MQTT
- * @param tag: ModbusTag to publish
- *
+ * periodic snapshot save
  */
+void snapshot_process(void) {
+	if (snapshotFileName.empty()) return;
+	if (time(NULL) < snapshotNextSaveTime) return;
+	snapshotNextSaveTime = time(NULL) + snapshotInterval;
+	snapshot_write();
+}
 
-bool mqtt_publish_tag(PLtag *tag) {
-	if (!mqtt.isConnected()) return false;
-	if (tag->getTopicString().empty()) return true;	// don't publish if topic is empty
-	// Publish value if read was OK
-	if (!tag->isNoread()) {
-		mqtt.publish(tag->getTopic(), tag->getFormat(), tag->getScaledValue(), tag->getPublishRetain());
-		//printf("%s - %s \n", __FUNCTION__, tag->getTopic());
-		return true;
+#pragma mark History
+
+/**
+ * configure the daily history download (optional)
+ */
+bool history_init(void) {
+	string fileName, memory = "eeprom";
+	int start, days, daySize;
+	historyfield field;
+
+	if (!cfg.exists("history")) return true;
+	if (!cfg_get_str("history.cache", fileName) || !cfg_get_str("history.topic", historyTopic) ||
+		!cfg_get_int("history.start", start) || !cfg_get_int("history.days", days) ||
+		!cfg_get_int("history.day_size", daySize)) return false;
+	cfg.lookupValue("history.memory", memory);
+	cfg.lookupValue("history.retain", historyRetain);
+	cfg.lookupValue("history.start_hour", historyStartHour);
+	cfg.lookupValue("history.link_share", historyLinkShare);
+	cfg.lookupValue("history.day_offset", historyDayOffset);
+	if ((historyLinkShare < 1) || (historyLinkShare > 100)) historyLinkShare = HISTORY_LINK_SHARE_DEFAULT;
+	if (cfg.exists("history.fields")) {
+		Setting& fieldSettings = cfg.lookup("history.fields");
+		for (int index = 0; index < fieldSettings.getLength(); index++) {
+			field.width = 1;
+			field.multiplier = 1.0;
+			if (!fieldSettings[index].lookupValue("name", field.name) || !fieldSettings[index].lookupValue("offset", field.offset)) {
+				log(LOG_ERR, "Config error - history field %d needs name and offset", index + 1);
+				return false;
+			}
+			fieldSettings[index].lookupValue("width", field.width);
+			fieldSettings[index].lookupValue("multiplier", field.multiplier);
+			if ((field.offset < 0) || (field.width < 1) || (field.width > 2) || (field.offset + field.width > daySize)) {
+				log(LOG_ERR, "Config error - history field <%s> outside of day", field.name.c_str());
+				return false;
+			}
+			historyFields.push_back(field);
+		}
 	}
-	//printf("%s - NoRead: %s \n", __FUNCTION__, tag->getTopic());
-	// Handle Noread
-	if (!tag->noReadIgnoreExceeded()) return true;		// ignore noread, do nothing
-	// noreadignore is exceeded, need to take action
-	switch (tag->getNoreadAction()) {
-	case 0:	// publish null value
-		mqtt.clear_retained_message(tag->getTopic());
-		break;
-	case 1:	// publish noread value
-		mqtt.publish(tag->getTopic(), tag->getFormat(), tag->getNoreadValue(), tag->getPublishRetain());
-		break;
-	default:
-		// do nothing (default, -1)
-		break;
+	if (plHistory.open(memory == "eeprom", start, days, daySize, fileName.c_str(), mqttLinkCount) < 0) {
+		log(LOG_ERR, "Invalid history region %s %d, %d days x %d bytes", memory.c_str(), start, days, daySize);
+		return false;
 	}
-
+	clock_gettime(CLOCK_MONOTONIC, &historyBudgetTime);
+	log(LOG_INFO, "History %d days x %d bytes at %s %d, cache <%s>, %d%% of link time", days, daySize,
+		memory.c_str(), start, fileName.c_str(), historyLinkShare);
 	return true;
 }
 
 /**
- * Publish noread value to all tags (normally done on program exit)
- * @param publish_noread: publish the "noread" value of the tag
- * @param clear_retain: clear retained value from broker's persistance store
+ * publish new or changed history days to <topic>/<YYYY-MM-DD>
+ * a day is kept in the cache until it was published to every link
  */
-void mqtt_clear_tags(bool publish_noread = true, bool clear_retain = true) {
-
-	int index = 0, tagIndex = 0;
-	int *tagArray;
-	PLtag plTag;
-	//printf("%s", __func__);
-
-	// Iterate over pl tag array
-	//mqtt.setRetain(false);
-	while (updateCycles[index].ident >= 0) {
-		// ignore if cycle has no tags to process
-		if (updateCycles[index].tagArray == NULL) {
-			index++; continue;
+void history_publish(void) {
+	char topic[200], dateStr[20], element[40];
+	string payload;
+	const uint8_t *data;
+	time_t dayTime;
+	struct tm tm;
+	int raw, index;
+
+	if (!mqtt_any_connected()) return;
+	for (int date : plHistory.unpublished()) {
+		for (index = 0; index < mqttLinkCount; index++) {
+			if (mqttLinks[index].mqtt->canPublish() && plHistory.isUnpublished(date, index)) break;
 		}
-		// get array for tags
-		tagArray = updateCycles[index].tagArray;
-		// read each tag in the array
-		tagIndex = 0;
-		while (tagArray[tagIndex] >= 0) {
-			plTag = plReadTags[tagArray[tagIndex]];
-			if (publish_noread) {}
-				mqtt.publish(plTag.getTopic(), plTag.getFormat(), plTag.getNoreadValue(), plTag.getPublishRetain());
-				//mqtt_publish_tag(mbTag, true);			// publish noread value
-			if (clear_retain) {}
-				mqtt.clear_retained_message(plTag.getTopic());	// clear retained status
-			tagIndex++;
+		data = plHistory.day(date);
+		if ((index >= mqttLinkCount) || (data == NULL)) continue;
+		// local day number to date
+		dayTime = (time_t)(date - historyDayOffset) * 86400;
+		gmtime_r(&dayTime, &tm);
+		strftime(dateStr, sizeof(dateStr), "%Y-%m-%d", &tm);
+		snprintf(topic, sizeof(topic), "%s/%s", historyTopic.c_str(), dateStr);
+		payload = historyFields.empty() ? "[" : "{";
+		if (historyFields.empty()) {
+			for (int i = 0; i < plHistory.daySize(); i++) {
+				snprintf(element, sizeof(element), "%s%d", (i > 0) ? "," : "", data[i]);
+				payload += element;
+			}
+			payload += "]";
+		} else {
+			for (size_t i = 0; i < historyFields.size(); i++) {
+				raw = data[historyFields[i].offset];
+				if (historyFields[i].width == 2) raw |= data[historyFields[i].offset + 1] << 8;
+				snprintf(element, sizeof(element), "%s\"%s\":%g", (i > 0) ? "," : "", historyFields[i].name.c_str(),
+					raw * historyFields[i].multiplier);
+				payload += element;
+			}
+			payload += "}";
 		}
-		index++;
-	}	// while 
-
-	// Iterate over local tags (e.g. CPU temp)
-/*
-	Tag *tag = ts.getFirstTag();
-	while (tag != NULL) {
-		if (tag->isPublish()) {
-			mqtt.clear_retained_message(tag->getTopic());
+		for (index = 0; index < mqttLinkCount; index++) {
+			if (!mqttLinks[index].mqtt->canPublish() || !plHistory.isUnpublished(date, index)) continue;
+			if (mqttLinks[index].mqtt->publish_payload(topic, payload.c_str(), historyRetain) >= 0)
+				plHistory.published(date, index);
 		}
-		tag = ts.getNextTag();
 	}
-*/
+}
+
+/**
+ * download the history region in small steps
+ * a step is only taken while the link time credit is positive, the credit
+ * grows with link_share percent of the elapsed time and is reduced by the
+ * time the step took, so the cyclic reads keep the rest of the link time
+ * @returns true if a download step was taken
+ */
+bool history_process(void) {
+	struct timespec now, end;
+	int result, changed;
+
+	if (!plHistory.isOpen() || (pl == NULL)) return false;
+	history_publish();
+	clock_gettime(CLOCK_MONOTONIC, &now);
+	historyBudget_us += (((now.tv_sec - historyBudgetTime.tv_sec) * 1000000) + ((now.tv_nsec - historyBudgetTime.tv_nsec) / 1000)) * historyLinkShare / 100;
+	if (historyBudget_us > HISTORY_BUDGET_MAX_US) historyBudget_us = HISTORY_BUDGET_MAX_US;
+	historyBudgetTime = now;
+	if (plBreaker.open || (historyBudget_us <= 0) || !plHistory.due(pl_time(), historyStartHour)) return false;
+
+	result = plHistory.step(pl, pl_time(), HISTORY_SLICE_BYTES);
+	clock_gettime(CLOCK_MONOTONIC, &end);
+	historyBudget_us -= ((end.tv_sec - now.tv_sec) * 1000000) + ((end.tv_nsec - now.tv_nsec) / 1000);
+	pl_breaker_result(result >= 0);
+	changed = plHistory.takeChanged();
+	if (changed > 0) {
+		log(LOG_INFO, "History download complete, %d new or changed days", changed);
+		history_publish();
+	}
+	return true;
 }
 
 #pragma mark PLxx
 
+/**
+ * start adaptive tags at the interval of their update cycle
+ */
+bool pl_adaptive_init(void) {
+	int interval, count = 0;
+	double load;
+
+	for (int index = 0; index < plTagCount; index++) {
+		PLtag *tag = &plReadTags[index];
+		if (!tag->isAdaptive()) continue;
+		interval = pl_cycle_interval(tag->updateCycleId());
+		if (interval < tag->getIntervalMin()) interval = tag->getIntervalMin();
+		if (interval > tag->getIntervalMax()) interval = tag->getIntervalMax();
+		tag->readInterval = interval;
+		tag->nextReadTime = pl_time();		// first read right away
+		count++;
+	}
+	if (count == 0) return true;
+	cfg.lookupValue("plxx.serial_budget", plSerialBudget);
+	load = pl_serial_load();
+	log(LOG_INFO, "PL %d adaptive tags, serial load %.2f transactions/s", count, load);
+	if ((plSerialBudget > 0) && (load > plSerialBudget))
+		log(LOG_WARNING, "PL serial load exceeds budget of %.2f transactions/s", plSerialBudget);
+	return true;
+}
+
 /**
  * assign tags to update cycles
  * generate arrays of tags assigned ot the same updatecycle
@@ -656,8 +2210,8 @@ bool pl_assign_updatecycles () {
 		plTagIdx = 0;
 		matchCount = 0;
 		while (plReadTags[plTagIdx].updateCycleId() >= 0) {
-			// count tags with cycle id match
-			if (plReadTags[plTagIdx].updateCycleId() == cycleIdent) {
+			// count tags with cycle id match, adaptive tags are scheduled on their own
+			if ((plReadTags[plTagIdx].updateCycleId() == cycleIdent) && !plReadTags[plTagIdx].isAdaptive()) {
 				matchCount++;
 				//cout << cycleIdent <<" " << mbReadTags[mbTagIdx].getAddress() << endl;
 			}
@@ -675,8 +2229,8 @@ bool pl_assign_updatecycles () {
 		plTagIdx = 0;
 		arIndex = 0;
 		while (plReadTags[plTagIdx].updateCycleId() >= 0) {
-			// count tags with cycle id match
-			if (plReadTags[plTagIdx].updateCycleId() == cycleIdent) {
+			// count tags with cycle id match, adaptive tags are scheduled on their own
+			if ((plReadTags[plTagIdx].updateCycleId() == cycleIdent) && !plReadTags[plTagIdx].isAdaptive()) {
 				intArray[arIndex] = plTagIdx;
 				arIndex++;
 			}
@@ -690,7 +2244,7 @@ bool pl_assign_updatecycles () {
 		// next update index
 		updidx++;
 	}
-	return true;
+	return pl_adaptive_init();
 }
 
 /**
@@ -700,10 +2254,18 @@ bool pl_config_tags(Setting& plTagsSettings, uint8_t deviceId) {
 	int tagIndex;
 	int tagAddress;
 	int tagUpdateCycle;
+	int intervalMin, intervalMax;
+	int rangeLength, rangeWidth;
+	int aggregateWindow;
+	int filterLength, decimation;
+	float filterAlpha;
+	tagfilter filter;
 	string strValue;
 	float fValue;
 	int intValue;
 	bool bValue;
+	bool defaultScaling = false;
+	const pl_register *reg;
 
 	int numTags = plTagsSettings.getLength();
 	if (numTags < 1) {
@@ -711,10 +2273,29 @@ bool pl_config_tags(Setting& plTagsSettings, uint8_t deviceId) {
 		return true;		// permissible condition
 	}
 
+	cfg.lookupValue("plxx.default_scaling", defaultScaling);
 	for (tagIndex = 0; tagIndex < numTags; tagIndex++) {
 		if (plTagsSettings[tagIndex].lookupValue("address", tagAddress)) {
+			// double byte registers need a conversion from the register map
+			reg = pl_register_find(tagAddress);
+			if ((tagAddress > 0xFF) && (reg == NULL)) {
+				log(LOG_ERR, "Config error - no conversion for double byte address %d (lsb %d, msb %d)",
+					tagAddress, tagAddress & 0xFF, tagAddress >> 8);
+				return false;
+			}
 			plReadTags[plTagCount].setAddress(tagAddress);
 			plReadTags[plTagCount].setSlaveId(deviceId);
+			// range of consecutive registers, read and published as one array
+			if (plTagsSettings[tagIndex].lookupValue("range", rangeLength)) {
+				rangeWidth = 1;
+				plTagsSettings[tagIndex].lookupValue("width", rangeWidth);
+				if ((tagAddress > 0xFF) || (rangeLength < 1) || ((rangeWidth != 1) && (rangeWidth != 2)) ||
+					(tagAddress + (rangeLength * rangeWidth) > 256)) {
+					log(LOG_ERR, "Config error - invalid range at address %d", tagAddress);
+					return false;
+				}
+				plReadTags[plTagCount].setRange(rangeLength, rangeWidth);
+			}
 		} else {
 			log(LOG_WARNING, "Error in config file, tag address missing");
 			continue;		// skip to next tag
@@ -724,10 +2305,55 @@ bool pl_config_tags(Setting& plTagsSettings, uint8_t deviceId) {
 		}
 		if (plTagsSettings[tagIndex].lookupValue("group", intValue))
 				plReadTags[plTagCount].setGroup(intValue);
+		if (plTagsSettings[tagIndex].lookupValue("name", strValue))		// used in expressions of derived tags
+			plReadTags[plTagCount].setName(strValue.c_str());
+		// adaptive read interval
+		if (plTagsSettings[tagIndex].lookupValue("interval_min", intervalMin) &&
+			plTagsSettings[tagIndex].lookupValue("interval_max", intervalMax) && !plReadTags[plTagCount].isRange()) {
+			fValue = 0;
+			plTagsSettings[tagIndex].lookupValue("deadband", fValue);
+			plReadTags[plTagCount].setAdaptive(intervalMin, intervalMax, fValue);
+		}
+		// filter and decimation of the raw value
+		if (plTagsSettings[tagIndex].lookupValue("filter", strValue)) {
+			filterLength = 5;
+			filterAlpha = 0.2;
+			plTagsSettings[tagIndex].lookupValue("filter_length", filterLength);
+			plTagsSettings[tagIndex].lookupValue("filter_alpha", filterAlpha);
+			if (strValue == "average") filter = TAG_FILTER_AVERAGE;
+			else if (strValue == "ema") filter = TAG_FILTER_EMA;
+			else if (strValue == "median") filter = TAG_FILTER_MEDIAN;
+			else filter = TAG_FILTER_NONE;
+			if ((filter == TAG_FILTER_NONE) || plReadTags[plTagCount].isRange() || (filterLength < 1) ||
+				(filterLength > TAG_FILTER_LENGTH_MAX) || (filterAlpha <= 0) || (filterAlpha > 1)) {
+				log(LOG_ERR, "Config error - invalid filter <%s> at address %d", strValue.c_str(), tagAddress);
+				return false;
+			}
+			plReadTags[plTagCount].setFilter(filter, filterLength, filterAlpha);
+		}
+		if (plTagsSettings[tagIndex].lookupValue("decimate", decimation)) {
+			if ((decimation < 1) || plReadTags[plTagCount].isRange()) {
+				log(LOG_ERR, "Config error - invalid decimation at address %d", tagAddress);
+				return false;
+			}
+			plReadTags[plTagCount].setDecimation(decimation);
+		}
+		// publish window aggregates instead of every sample
+		if (plTagsSettings[tagIndex].lookupValue("aggregate", aggregateWindow)) {
+			if ((aggregateWindow < 1) || plReadTags[plTagCount].isRange()) {
+				log(LOG_ERR, "Config error - invalid aggregate window at address %d", tagAddress);
+				return false;
+			}
+			plReadTags[plTagCount].setAggregate(aggregateWindow);
+		}
 		// is topic present? -> read mqtt related parametrs
 		if (plTagsSettings[tagIndex].lookupValue("topic", strValue)) {
 			plReadTags[plTagCount].setTopic(strValue.c_str());
 			plReadTags[plTagCount].setPublishRetain(mqtt_retain_default);	// set to default
+			if (defaultScaling && (reg != NULL)) {		// scaling from the register map
+				plReadTags[plTagCount].setMultiplier(reg->multiplier);
+				plReadTags[plTagCount].setOffset(reg->offset);
+			}
 			if (plTagsSettings[tagIndex].lookupValue("retain", bValue))		// override default is required
 				plReadTags[plTagCount].setPublishRetain(bValue);
 			if (plTagsSettings[tagIndex].lookupValue("format", strValue))
@@ -823,7 +2449,7 @@ bool pl_config_devices(Setting& plDeviceSettings) {
  * read update cycles from config file
  */
 bool pl_config_updatecycles(Setting& updateCyclesSettings) {
-	int idValue, interval, index;
+	int idValue, interval, interval_ms, index;
 	int numUpdateCycles = updateCyclesSettings.getLength();
 
 	if (numUpdateCycles < 1) {
@@ -840,14 +2466,23 @@ bool pl_config_updatecycles(Setting& updateCyclesSettings) {
 			log(LOG_ERR, "Config error - cycleupdate ID missing in entry %d", index+1);
 			return false;
 		}
+		interval_ms = 0;
 		if (updateCyclesSettings[index].lookupValue("interval", interval)) {
+		} else if (updateCyclesSettings[index].lookupValue("interval_ms", interval_ms) && (interval_ms > 0)) {
+			interval = 0;		// sub-second cycle
 		} else {
 			log(LOG_ERR, "Config error - cycleupdate interval missing in entry %d", index+1);
 			return false;
 		}
 		updateCycles[index].ident = idValue;
 		updateCycles[index].interval = interval;
-		updateCycles[index].nextUpdateTime = time(0) + interval;
+		updateCycles[index].interval_ms = interval_ms;
+		updateCycles[index].nextUpdateTime = pl_time();		// first read right away
+		updateCycles[index].alignedUpdateTime = 0;
+		updateCycles[index].nextUpdate_ms = 0;
+		if ((interval_ms > 0) && (interval_ms < (int)mainloopinterval))
+			log(LOG_WARNING, "Update cycle %d: interval %dms is shorter than the main loop interval %dms",
+				idValue, interval_ms, (int)mainloopinterval);
 		//cout << "Update " << index << " ID " << idValue << " Interval: " << interval << " t:" << updateCycles[index].nextUpdateTime << endl;
 	}
 	// mark end of data
@@ -923,6 +2558,17 @@ bool init_pl()
 	string pl_device;
 	string strValue;
 	int pl_baud = 9600;
+	int settle, retries;
+	int degradeRate, frameGap;
+	int recordSize, recordFiles;
+	std::vector<int> fallbackBaud;
+	bool bValue;
+
+	// replay a recorded session instead of the serial device
+	if (!replayFileName.empty()) {
+		if (!replay_init()) return false;
+		return pl_config() && pl_assign_updatecycles();
+	}
 
 	// check if mobus serial device is configured
 	if (!cfg_get_str("plxx.device", pl_device)) {
@@ -944,12 +2590,140 @@ bool init_pl()
 
 	log(LOG_INFO, "PL connection opened on port %s at %d baud", pl_device.c_str(), pl_baud);
 
+	// circuit breaker for a device which doesn't respond
+	cfg.lookupValue("plxx.breaker_threshold", plBreaker.threshold);
+	cfg.lookupValue("plxx.probe_interval", plBreaker.probeIntervalMin);
+	cfg.lookupValue("plxx.probe_interval_max", plBreaker.probeIntervalMax);
+	if (plBreaker.probeIntervalMin < 1) plBreaker.probeIntervalMin = 1;
+	if (plBreaker.probeIntervalMax < plBreaker.probeIntervalMin) plBreaker.probeIntervalMax = plBreaker.probeIntervalMin;
+
+	// degrade a noisy serial link: more frame spacing, then fallback baud rates
+	degradeRate = DEGRADE_RATE_DEFAULT;
+	frameGap = DEGRADE_FRAME_GAP_DEFAULT;
+	cfg.lookupValue("plxx.degrade_rate", degradeRate);
+	cfg.lookupValue("plxx.max_frame_gap", frameGap);
+	if (cfg.exists("plxx.fallback_baud")) {
+		Setting& baudSettings = cfg.lookup("plxx.fallback_baud");
+		for (int index = 0; index < baudSettings.getLength(); index++) {
+			fallbackBaud.push_back(pl_baudrate(baudSettings[index]));
+		}
+	}
+	pl->setDegradation(degradeRate, frameGap, fallbackBaud);
+
+	// low latency tty mode
+	if (cfg.lookupValue("plxx.low_latency", bValue) && bValue) {
+		pl->setLowLatency(true);
+		log(LOG_INFO, "PL low latency tty mode enabled");
+	}
+
+	// raw serial transaction log
+	if (cfg.lookupValue("plxx.record_file", strValue)) {
+		recordSize = TX_RECORD_SIZE_DEFAULT;
+		recordFiles = TX_RECORD_FILES_DEFAULT;
+		cfg.lookupValue("plxx.record_size", recordSize);
+		cfg.lookupValue("plxx.record_files", recordFiles);
+		if (txRecorder.open(strValue.c_str(), (long)recordSize * 1024, recordFiles) < 0) {
+			log(LOG_WARNING, "PL transaction log <%s> not available", strValue.c_str());
+		} else {
+			pl->setRecorder(&txRecorder);
+			log(LOG_INFO, "PL transactions recorded to <%s>, %dkB x %d files", strValue.c_str(), recordSize, recordFiles);
+		}
+	}
+
+	// USB-serial hotplug detection
+	bValue = true;
+	cfg.lookupValue("plxx.hotplug", bValue);
+	if (bValue && (pl->setHotplug(true) < 0))
+		log(LOG_WARNING, "PL hotplug detection not available for %s", pl_device.c_str());
+
+	// optional verified write mode
+	if (cfg.lookupValue("plxx.write_verify", bValue) && bValue) {
+		if (!cfg.lookupValue("plxx.write_settle", settle)) settle = PL_WRITE_SETTLE_DEFAULT;
+		if (!cfg.lookupValue("plxx.write_retries", retries)) retries = PL_WRITE_RETRIES_DEFAULT;
+		pl->setWriteVerify(true, settle, retries);
+		log(LOG_INFO, "PL verified write enabled, settle %dms, %d retries", settle, retries);
+	}
+
 	if (!pl_config()) return false;
 	if (!pl_assign_updatecycles()) return false;
 
 	return true;
 }
 
+#pragma mark Replay
+
+/**
+ * @returns the time seen by the update cycle scheduler,
+ * during a replay the time line of the recorded session
+ */
+time_t pl_time(void) {
+	if (plReplay.isOpen()) return plReplay.now();
+	return time(NULL);
+}
+
+/**
+ * @returns pl_time() in ms, used by sub-second update cycles
+ */
+int64_t pl_time_ms(void) {
+	struct timespec now;
+	if (plReplay.isOpen()) return plReplay.now_ms();
+	clock_gettime(CLOCK_REALTIME, &now);
+	return ((int64_t)now.tv_sec * 1000) + (now.tv_nsec / 1000000);
+}
+
+/**
+ * @returns monotonic time [ms] for intervals between samples,
+ * during a replay the time line of the recorded session
+ */
+int64_t pl_monotonic_ms(void) {
+	struct timespec now;
+	if (plReplay.isOpen()) return plReplay.now_ms();
+	clock_gettime(CLOCK_MONOTONIC, &now);
+	return ((int64_t)now.tv_sec * 1000) + (now.tv_nsec / 1000000);
+}
+
+/**
+ * load the transaction log and serve all PL transactions from it
+ * the update cycles configured afterwards start on the recording's clock
+ */
+bool replay_init(void) {
+	long count = plReplay.open(replayFileName.c_str(), replaySpeed);
+
+	if (count < 0) {
+		log(LOG_ERR, "Can't load PL transaction log <%s>", replayFileName.c_str());
+		return false;
+	}
+	pl = new Plxx(replayFileName.c_str(), pl_baudrate(9600));
+	pl->setReplay(&plReplay);
+	if (plReplay.fast())
+		log(LOG_INFO, "PL replay of <%s>: %ld transactions over %.0fs, as fast as possible", replayFileName.c_str(), count, plReplay.recordedDuration());
+	else
+		log(LOG_INFO, "PL replay of <%s>: %ld transactions over %.0fs, speed x%.2f", replayFileName.c_str(), count, plReplay.recordedDuration(), replaySpeed);
+	clock_gettime(CLOCK_MONOTONIC, &replayStartTime);
+	return true;
+}
+
+/**
+ * report the resources used for a replay
+ * @param cycles: number of main loop iterations with processing
+ * @param processSum_us: time spent in process()
+ * @param processMax_us: longest process() call
+ */
+void replay_report(unsigned long cycles, unsigned long long processSum_us, useconds_t processMax_us) {
+	struct timespec now, elapsed;
+	struct rusage usage;
+
+	clock_gettime(CLOCK_MONOTONIC, &now);
+	timespec_diff(&replayStartTime, &now, &elapsed);
+	getrusage(RUSAGE_SELF, &usage);
+	log(LOG_INFO, "PL replay %s: %lu transactions replayed, %lu not in recording",
+		plReplay.finished() ? "finished" : "stopped", plReplay.served(), plReplay.mismatches());
+	log(LOG_INFO, "recorded %.1fs replayed in %.1fs, CPU user %.2fs system %.2fs, process() avg %lluus max %uus",
+		plReplay.recordedDuration(), elapsed.tv_sec + (elapsed.tv_nsec / 1e9),
+		usage.ru_utime.tv_sec + (usage.ru_utime.tv_usec / 1e6), usage.ru_stime.tv_sec + (usage.ru_stime.tv_usec / 1e6),
+		(cycles > 0) ? processSum_us / cycles : 0, processMax_us);
+}
+
 #pragma mark Loops
 
 /** 
@@ -986,6 +2760,7 @@ void exit_loop(void)
 		noreadonexit = bValue;
 	if (noreadonexit || clearonexit)
 		mqtt_clear_tags(noreadonexit, clearonexit);
+	snapshot_write();
 	// free allocated memory
 	// arrays of tags in cycleupdates
 	int *ar, idx=0;
@@ -996,7 +2771,28 @@ void exit_loop(void)
 	}
 
 	delete [] updateCycles;
+	if (pl != NULL) {
+		plxx_link_stats stats;
+		pl->getLinkStats(&stats);
+		log(LOG_INFO, "PL link: %lu transactions, %lu failed (%lu with line errors), UART frame %lu parity %lu overrun %lu%s",
+			stats.transactions, stats.failures, stats.lineFailures, stats.frameErrors, stats.parityErrors,
+			stats.overruns + stats.bufOverruns, stats.icountSupported ? "" : " (counters not supported)");
+	}
 	delete pl;
+	txRecorder.close();
+	if (txRecorder.dropped() > 0)
+		log(LOG_WARNING, "PL transaction log: %lu records dropped", txRecorder.dropped());
+	offlineRing.close();
+	tsStore.close();			// writes the buffered samples
+	energy_save();
+	for (int index = 0; index < derivedTagCount; index++) {
+		delete derivedDefs[index].expression;
+	}
+	delete [] derivedDefs;
+	delete [] derivedTags;
+	for (int index = 0; index < mqttLinkCount; index++) {
+		delete mqttLinks[index].mqtt;
+	}
 }
 
 /** 
@@ -1012,6 +2808,8 @@ void main_loop()
 	useconds_t processing_time;
 	useconds_t min_time = 99999999, max_time = 0;
 	useconds_t interval = mainloopinterval * 1000;	// convert ms to us
+	unsigned long processing_count = 0;
+	unsigned long long processing_sum = 0;
 
 	// first call takes a long time (10ms)
 	while (!exitSignal) {
@@ -1034,26 +2832,37 @@ void main_loop()
 			if (processing_time < min_time) {
 				min_time = processing_time;
 			}
+			processing_count++;
+			processing_sum += processing_time;
 			//printf("%s - success (%dus)\n", __func__, processing_time);
 		}
 		// enter loop delay if needed
 		// if cpu_time_used exceeds the mainLoopInterval
 		// then bypass the loop delay
-		if (interval > processing_time) {
+		if (plReplay.isOpen() && plReplay.fast()) {
+			// no loop delay, the replay clock moves on when there is nothing to do
+			if (!processing_success) plReplay.advance(interval);
+		} else if (interval > processing_time) {
 			sleep_usec = interval - processing_time;  // sleep time in us
 			//printf("%s - sleeping for %dus (%dus)\n", __func__, sleep_usec, processing_time);
 			usleep(sleep_usec);
 		}
 
-		if (mqtt_next_connect_time > 0) {
- 			if (time(NULL) >= mqtt_next_connect_time) {
- 				mqtt_connect();
- 			}
- 		}
+		if (!exitSignal) {
+			// reconnect and broker failover
+			for (int index = 0; index < mqttLinkCount; index++) {
+				mqttLinks[index].mqtt->process();
+			}
+		}
+
+		snapshot_process();
 
+		if (plReplay.isOpen() && plReplay.finished()) exitSignal = true;
 	}
 	if (!runningAsDaemon)
 		printf("CPU time for variable processing: %dus - %dus\n", min_time, max_time);
+	if (plReplay.isOpen())
+		replay_report(processing_count, processing_sum, max_time);
 }
 
 /** Display program usage instructions.
@@ -1062,9 +2871,13 @@ void main_loop()
  */
 static void showUsage(void) {
 	cout << "usage:" << endl;
-	cout << execName << "-cCfgFileName -d -h" << endl;
+	cout << execName << "-cCfgFileName -d -b -rLogFile -sSpeed -pBroker -h" << endl;
 	cout << "c = name of config file (.cfg is added automatically)" << endl;
 	cout << "d = enable debug mode" << endl;
+	cout << "b = read all tags once and compare MQTT publish sizes" << endl;
+	cout << "r = replay a PL transaction log (plxx.record_file) instead of the serial device" << endl;
+	cout << "s = replay speed, 1 = recorded timing, 0 = as fast as possible (default)" << endl;
+	cout << "p = publish the replay to this broker, the configured brokers are not used" << endl;
 	cout << "h = show help" << endl;
 }
 
@@ -1093,6 +2906,18 @@ bool parseArguments(int argc, char *argv[]) {
 					debugEnabled = true;
 					printf("Debug enabled\n");
 					break;
+				case 'b':
+					benchmarkMode = true;
+					break;
+				case 'r':
+					replayFileName = std::string(&argv[i][2]);		// path may exceed buffer
+					break;
+				case 's':
+					replaySpeed = atof(&buffer[2]);
+					break;
+				case 'p':
+					replayBroker = std::string(&buffer[2]);
+					break;
 				case 'h':
 					showUsage();
 					retval = false;
@@ -1136,9 +2961,24 @@ int main (int argc, char *argv[])
 	}
 
 	if (!init_tags()) goto exit_fail;
+	if (benchmarkMode) {
+		if (!init_pl() || (pl == NULL)) goto exit_fail;
+		mqtt_benchmark();
+		delete pl;
+		exit(EXIT_SUCCESS);
+	}
 	if (!mqtt_init()) goto exit_fail;
 	if (!init_values()) goto exit_fail;
 	if (!init_pl()) goto exit_fail;
+	if (!derived_init()) goto exit_fail;
+	if (!plReplay.isOpen() && !energy_init()) goto exit_fail;
+	if (!alarm_init()) goto exit_fail;
+	// a replay leaves the offline ring and snapshot files alone
+	if (!plReplay.isOpen() && !offline_init()) goto exit_fail;
+	resync_init();
+	if (!plReplay.isOpen()) snapshot_init();
+	if (!plReplay.isOpen() && !history_init()) goto exit_fail;
+	if (!plReplay.isOpen() && !timeseries_init()) goto exit_fail;
 	usleep(100000);
 	main_loop();
 
@@ -6,14 +6,81 @@
 #ifndef PLBRIDGE_H
 #define PLBRIDGE_H
 
-//#include <time.h>
+#include <stdint.h>
+#include <time.h>
+
+#include <string>
+#include <vector>
 
 struct updatecycle {
 	int	ident;
-	int interval;	// seconds
+	int interval;	// seconds, 0 for a sub-second cycle
+	int interval_ms = 0;			// sub-second cycle interval [ms], 0 = interval in seconds
 	int *tagArray = NULL;
 	int tagArraySize = 0;
 	time_t nextUpdateTime;			// next update time 
+	time_t alignedUpdateTime = 0;	// restored phase, used once after the initial read
+	int64_t nextUpdate_ms = 0;		// next update time of a sub-second cycle [ms]
+};
+
+// paces bursts of messages (e.g. replay, resync)
+struct ratelimit {
+	int rate;						// messages per second
+	double budget;					// messages which may be sent now
+	struct timespec last;			// last budget update (CLOCK_MONOTONIC)
+};
+
+// device level circuit breaker, stops polling a device which doesn't respond
+struct circuitbreaker {
+	int threshold;					// consecutive failures to open the breaker, 0 = disabled
+	int failures;					// consecutive failed transactions
+	bool open;						// device is down, only probes are sent
+	int probeInterval;				// current probe interval [s]
+	int probeIntervalMin;			// [s]
+	int probeIntervalMax;			// [s] probe interval doubles up to this value
+	time_t nextProbeTime;
+};
+
+// decoded field of a history day
+struct historyfield {
+	std::string name;
+	int offset;						// byte offset within the day
+	int width;						// bytes, lsb first
+	float multiplier;
+};
+
+class Expression;
+
+// tag computed from other tags
+struct derivedtag {
+	Expression *expression;
+	float deadband;					// change of the value needed to publish
+	bool published;					// a value has been published
+	double publishedValue;
+	unsigned long inputSeq;			// newest input update which has been evaluated
+};
+
+// publishing and read boost of an alarm
+struct alarmdef {
+	std::string name;
+	std::string topic;
+	bool retain;
+	int boostInterval_ms;			// read interval of the involved tags while active, 0 = no boost
+	int64_t nextBoost_ms;
+	std::vector<int> boostTags;		// index of the involved read tags
+};
+
+class MQTT;
+
+// one broker connection of the bridge, every sample is published to all links
+struct mqttlink {
+	MQTT *mqtt;
+	std::string clientId;			// unique per link, a broker drops a connection with a duplicate id
+	bool subscribe;					// subscribe write tags on this link
+	bool resyncPending;				// republish of last known values in progress
+	int resyncIndex;				// next tag to republish
+	ratelimit resyncLimit;			// pacing of republished tags
+	ratelimit replayLimit;			// pacing of replayed offline samples
 };
 
 
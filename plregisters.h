@@ -0,0 +1,130 @@
+/**
+ * @file plregisters.h
+ *
+ -----------------------------------------------------------------------------
+  Register map of the PL20/40/60 RAM registers with a known encoding.
+  The table is evaluated at compile time, a register which needs a
+  conversion is added as a table row.
+
+  Addresses are given as configured in the tags: single byte registers use
+  the RAM address, double byte registers use msb * 256 + lsb.
+  Double byte registers are identified by the lsb address alone, the msb
+  address is taken from the config (the table msb is the usual one).
+  Single byte registers which are not in the table are read as raw value.
+
+ -----------------------------------------------------------------------------
+ */
+
+#ifndef PLREGISTERS_H
+#define PLREGISTERS_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+// conversion from the register bytes to the tag value
+enum pl_decode {
+	PL_DECODE_RAW,				// byte, or msb * 256 + lsb
+	PL_DECODE_MASK,				// byte & mask
+	PL_DECODE_MILLIVOLT,		// ((msb * 256 + lsb) + 38400) / 5.12 [mV]
+	PL_DECODE_AH				// msb * 8 + lsb [Ah]
+};
+
+struct pl_register {
+	uint8_t address;			// byte or lsb address
+	uint8_t msb;				// usual msb address of a double byte register
+	uint8_t width;				// bytes
+	bool isSigned;				// raw value is two's complement
+	pl_decode decode;
+	uint8_t mask;				// PL_DECODE_MASK only
+	const char *name;
+	const char *unit;			// unit after default scaling
+	float multiplier;			// default scaling of the decoded value
+	float offset;
+};
+
+#define PL_REG16(lsb, msb) (uint16_t)(((msb) << 8) | (lsb))
+
+// sorted by width, then address
+static constexpr pl_register plRegisters[] = {
+	{ 39,  0,   1, false, PL_DECODE_RAW,       0,    "dutycyc", "%",  0.416666, 0 },
+	{ 50,  0,   1, false, PL_DECODE_RAW,       0,    "batv",    "V",  0.1,      0 },
+	{ 52,  0,   1, false, PL_DECODE_RAW,       0,    "battemp", "C",  1,        0 },
+	{ 101, 0,   1, false, PL_DECODE_MASK,      0x03, "rstate",  "",   1,        0 },
+	{ 213, 0,   1, false, PL_DECODE_RAW,       0,    "cint",    "A",  0.1,      0 },
+	{ 188, 189, 2, false, PL_DECODE_AH,        0,    "ciah",    "Ah", 1,        0 },
+	{ 193, 194, 2, false, PL_DECODE_AH,        0,    "ceah",    "Ah", 1,        0 },
+	{ 198, 199, 2, false, PL_DECODE_AH,        0,    "liah",    "Ah", 1,        0 },
+	{ 203, 204, 2, false, PL_DECODE_AH,        0,    "leah",    "Ah", 1,        0 },
+	{ 220, 221, 2, false, PL_DECODE_MILLIVOLT, 0,    "vbat",    "mV", 1,        0 },
+	{ 237, 239, 2, false, PL_DECODE_MILLIVOLT, 0,    "vsen",    "mV", 1,        0 },
+};
+
+static constexpr size_t plRegisterCount = sizeof(plRegisters) / sizeof(plRegisters[0]);
+
+/**
+ * @returns sort key of a table row, width first
+ */
+constexpr int pl_register_key(int width, int address) {
+	return (width << 8) | address;
+}
+
+/**
+ * @returns true if the table is sorted, unique and the widths are 1 or 2 bytes
+ */
+constexpr bool pl_register_table_valid(void) {
+	for (size_t i = 0; i < plRegisterCount; i++) {
+		if ((plRegisters[i].width != 1) && (plRegisters[i].width != 2)) return false;
+		if ((i > 0) && (pl_register_key(plRegisters[i - 1].width, plRegisters[i - 1].address) >=
+			pl_register_key(plRegisters[i].width, plRegisters[i].address))) return false;
+	}
+	return true;
+}
+
+static_assert(pl_register_table_valid(), "plRegisters must be sorted by width and address");
+
+/**
+ * @param address: tag address, a double byte register is found by its lsb address
+ * @returns register definition, NULL if the address is not in the table
+ */
+constexpr const pl_register *pl_register_find(uint16_t address) {
+	int key = pl_register_key((address > 0xFF) ? 2 : 1, address & 0xFF);
+	size_t low = 0, high = plRegisterCount;
+	while (low < high) {
+		size_t mid = (low + high) / 2;
+		int midKey = pl_register_key(plRegisters[mid].width, plRegisters[mid].address);
+		if (midKey == key) return &plRegisters[mid];
+		if (midKey < key) low = mid + 1;
+		else high = mid;
+	}
+	return NULL;
+}
+
+/**
+ * convert the register bytes to the tag value
+ * @param reg: register definition, NULL for a single byte register which is not in the table
+ * @returns the tag value
+ */
+constexpr int pl_register_decode(const pl_register *reg, uint8_t lsb, uint8_t msb) {
+	int raw = 0;
+
+	if (reg == NULL) return lsb;
+	raw = (reg->width == 1) ? lsb : ((msb << 8) | lsb);
+	if (reg->isSigned) raw = (reg->width == 1) ? (int)(int8_t)raw : (int)(int16_t)raw;
+	switch (reg->decode) {
+		case PL_DECODE_MASK:
+			return raw & reg->mask;
+		case PL_DECODE_MILLIVOLT:
+			return (int)((float)(raw + 38400) / 5.120);
+		case PL_DECODE_AH:
+			return (msb * 8) + lsb;
+		default:
+			return raw;
+	}
+}
+
+static_assert(pl_register_decode(pl_register_find(101), 0xFE, 0) == 2, "rstate uses the lower two bits");
+static_assert(pl_register_decode(pl_register_find(PL_REG16(220, 221)), 0, 0) == 7500, "38400 counts are 7.5V");
+static_assert(pl_register_find(PL_REG16(237, 238)) == pl_register_find(PL_REG16(237, 239)), "msb is taken from the config");
+static_assert(pl_register_find(188) == NULL, "a single byte read of a double byte lsb is raw");
+
+#endif /* PLREGISTERS_H */
@@ -19,6 +19,7 @@
 #include <unistd.h>
 #include "pltag.h"
 
+#include <algorithm>
 #include <stdexcept>
 #include <iostream>
 
@@ -41,6 +42,7 @@ using namespace std;
 //
 
 PLtag::PLtag() {
+	this->_seq = 0;
 	this->_value = 0.0;
 	this->_address = 0;
 	this->_group = 0;
@@ -53,14 +55,56 @@ PLtag::PLtag() {
 	this->_noreadaction = -1;	// do nothing
 	this->_noreadignore = 0;
 	this->_noreadcount = 0;
+	this->_lastUpdateTime = 0;
 	this->_ignoreRetained = false;
+	this->_writePending = false;
+	this->_toggle = false;
+	this->_bit = -1;
+	this->_writeRequestTime.tv_sec = 0;
+	this->_writeRequestTime.tv_nsec = 0;
+	this->_adaptive = false;
+	this->_intervalMin = 0;
+	this->_intervalMax = 0;
+	this->_deadband = 0.0;
+	this->_rangeLength = 0;
+	this->_rangeWidth = 1;
+	this->_filter = TAG_FILTER_NONE;
+	this->_filterLength = 1;
+	this->_filterAlpha = 1.0;
+	this->_decimation = 1;
+	this->_aggregateWindow = 0;
+	this->_aggregate.count = 0;
+	this->readInterval = 0;
+	this->nextReadTime = 0;
+	this->updateSeq = 0;
+	this->updateTime_ms = 0;
+	filterReset();
 	//printf("%s - constructor %d %s\\", __func__, this->_slaveId, this->_topic.c_str());
 	//throw runtime_error("Class Tag - forbidden constructor");
 }
 
 PLtag::PLtag(const uint16_t addr) {
 	this->_address = addr;
+	this->_seq = 0;
 	this->_value = 0.0;
+	this->_lastUpdateTime = 0;
+	this->_adaptive = false;
+	this->_intervalMin = 0;
+	this->_intervalMax = 0;
+	this->_deadband = 0.0;
+	this->_rangeLength = 0;
+	this->_rangeWidth = 1;
+	this->_filter = TAG_FILTER_NONE;
+	this->_filterLength = 1;
+	this->_filterAlpha = 1.0;
+	this->_decimation = 1;
+	this->_aggregateWindow = 0;
+	this->_aggregate.count = 0;
+	this->readInterval = 0;
+	this->nextReadTime = 0;
+	this->updateSeq = 0;
+	this->updateTime_ms = 0;
+	filterReset();
 }
 
 PLtag::~PLtag() {
@@ -73,6 +117,10 @@ void PLtag::noreadNotify(void) {
 		_noreadcount++;					// a noreadcount > 0 indicates the tag is in noread state
 }
 
+void PLtag::noreadForce(void) {
+	_noreadcount = _noreadignore + 1;
+}
+
 bool PLtag::isNoread(void) {
 	if (_noreadcount > 0) return true;
 	else return false;
@@ -105,6 +153,16 @@ void PLtag::setTopic(const char *topicStr) {
 	}
 }
 
+void PLtag::setName(const char *nameStr) {
+	if (nameStr != NULL) {
+		_name = nameStr;
+	}
+}
+
+std::string PLtag::getName(void) {
+	return _name;
+}
+
 const char* PLtag::getTopic(void) {
 	return _topic.c_str();
 }
@@ -140,9 +198,20 @@ const char* PLtag::getFormat(void) {
 	return _format.c_str();
 }
 
+/**
+ * seqlock write of value and update time, single writer only
+ */
+void PLtag::_store(double value, time_t updateTime) {
+	unsigned int seq = _seq.load(std::memory_order_relaxed);
+	_seq.store(seq + 1, std::memory_order_relaxed);		// odd: update in progress
+	// release orders the odd sequence before the data for a reader which sees new data
+	_value.store(value, std::memory_order_release);
+	_lastUpdateTime.store(updateTime, std::memory_order_release);
+	_seq.store(seq + 2, std::memory_order_release);
+}
+
 void PLtag::setValue(double newValue) {
-	_value = newValue;
-	_lastUpdateTime = time(NULL);
+	_store(newValue, time(NULL));
 	_noreadcount = 0;
 }
 
@@ -150,10 +219,28 @@ void PLtag::setValue(int newValue) {
 	setValue( (double) newValue );
 }
 
+void PLtag::restoreValue(double value, time_t updateTime) {
+	_store(value, updateTime);
+	_noreadcount = 0;
+}
+
 double PLtag::getValue(void) {
 	return _value;
 }
 
+time_t PLtag::getLastUpdateTime(void) {
+	return _lastUpdateTime;
+}
+
+void PLtag::getSample(double *value, time_t *updateTime) {
+	unsigned int seq;
+	do {
+		seq = _seq.load(std::memory_order_acquire);
+		*value = _value.load(std::memory_order_acquire);
+		*updateTime = _lastUpdateTime.load(std::memory_order_acquire);
+	} while ((seq & 1) || (seq != _seq.load(std::memory_order_relaxed)));	// retry if written meanwhile
+}
+
 int PLtag::getIntValue(void) {
 	return (int)_value;
 }
@@ -187,6 +274,168 @@ int PLtag::updateCycleId(void) {
 	return _updatecycle_id;
 }
 
+void PLtag::setAdaptive(int intervalMin, int intervalMax, float deadband) {
+	_adaptive = true;
+	_intervalMin = (intervalMin < 1) ? 1 : intervalMin;
+	_intervalMax = (intervalMax < _intervalMin) ? _intervalMin : intervalMax;
+	_deadband = (deadband < 0) ? -deadband : deadband;
+}
+
+bool PLtag::isAdaptive(void) {
+	return _adaptive;
+}
+
+int PLtag::getIntervalMin(void) {
+	return _intervalMin;
+}
+
+int PLtag::getIntervalMax(void) {
+	return _intervalMax;
+}
+
+float PLtag::getDeadband(void) {
+	return _deadband;
+}
+
+void PLtag::setRange(int length, int width) {
+	_rangeLength = length;
+	_rangeWidth = width;
+}
+
+bool PLtag::isRange(void) {
+	return _rangeLength > 0;
+}
+
+int PLtag::getRangeLength(void) {
+	return _rangeLength;
+}
+
+int PLtag::getRangeWidth(void) {
+	return _rangeWidth;
+}
+
+void PLtag::setFilter(tagfilter filter, int length, float alpha) {
+	_filter = filter;
+	_filterLength = (length < 1) ? 1 : (length > TAG_FILTER_LENGTH_MAX) ? TAG_FILTER_LENGTH_MAX : length;
+	_filterAlpha = ((alpha <= 0) || (alpha > 1)) ? 1.0 : alpha;
+	filterReset();
+}
+
+void PLtag::setDecimation(int factor) {
+	_decimation = (factor < 1) ? 1 : factor;
+	filterReset();
+}
+
+bool PLtag::isFiltered(void) {
+	return (_filter != TAG_FILTER_NONE) || (_decimation > 1);
+}
+
+void PLtag::filterReset(void) {
+	_filterValues.clear();
+	_filterIndex = 0;
+	_filterSum = 0;
+	_filterState = 0;
+	_decimationCount = 0;
+}
+
+bool PLtag::filterValue(int raw, double *filtered) {
+	size_t middle;
+
+	switch (_filter) {
+	case TAG_FILTER_AVERAGE:
+	case TAG_FILTER_MEDIAN:
+		if ((int)_filterValues.size() < _filterLength) {
+			_filterValues.push_back(raw);
+		} else {
+			_filterSum -= _filterValues[_filterIndex];
+			_filterValues[_filterIndex] = raw;
+		}
+		_filterIndex = (_filterIndex + 1) % _filterLength;
+		_filterSum += raw;
+		if (_filter == TAG_FILTER_AVERAGE) {
+			*filtered = _filterSum / _filterValues.size();
+		} else {
+			_filterSorted = _filterValues;
+			middle = _filterSorted.size() / 2;
+			std::nth_element(_filterSorted.begin(), _filterSorted.begin() + middle, _filterSorted.end());
+			*filtered = _filterSorted[middle];
+		}
+		break;
+	case TAG_FILTER_EMA:
+		if (_filterValues.empty()) {
+			_filterValues.push_back(raw);		// marks the state as initialised
+			_filterState = raw;
+		} else {
+			_filterState += _filterAlpha * (raw - _filterState);
+		}
+		*filtered = _filterState;
+		break;
+	default:
+		*filtered = raw;
+		break;
+	}
+	if (++_decimationCount < _decimation) return false;
+	_decimationCount = 0;
+	return true;
+}
+
+void PLtag::setAggregate(int window) {
+	_aggregateWindow = (window < 1) ? 1 : window;
+	_aggregate.count = 0;
+}
+
+bool PLtag::isAggregate(void) {
+	return _aggregateWindow > 0;
+}
+
+int PLtag::getAggregateWindow(void) {
+	return _aggregateWindow;
+}
+
+void PLtag::aggregateAdd(time_t now) {
+	float value = getScaledValue();
+
+	if (_aggregateWindow < 1) return;
+	if (_aggregate.count == 0) {
+		_aggregate.start = now - (now % _aggregateWindow);
+		_aggregate.min = value;
+		_aggregate.max = value;
+		_aggregate.sum = 0;
+	}
+	if (value < _aggregate.min) _aggregate.min = value;
+	if (value > _aggregate.max) _aggregate.max = value;
+	_aggregate.sum += value;
+	_aggregate.last = value;
+	_aggregate.count++;
+}
+
+bool PLtag::aggregateClose(time_t now, tagaggregate *result) {
+	if ((_aggregate.count == 0) || (now < _aggregate.start + _aggregateWindow)) return false;
+	if (result != NULL) *result = _aggregate;
+	_aggregate.count = 0;
+	return true;
+}
+
+void PLtag::setRangeValues(const std::vector<int> &values) {
+	_rangeValues = values;
+	setValue(values.empty() ? 0 : values[0]);
+}
+
+std::string PLtag::getRangePayload(void) {
+	std::string payload;
+	char element[32];
+
+	if (_rangeValues.empty()) return payload;
+	payload = "[";
+	for (size_t i = 0; i < _rangeValues.size(); i++) {
+		if (i > 0) payload += ",";
+		snprintf(element, sizeof(element), _format.c_str(), (_rangeValues[i] * _multiplier) + _offset);
+		payload += element;
+	}
+	payload += "]";
+	return payload;
+}
+
 void PLtag::setNoreadValue(float newValue) {
 	_noreadvalue = newValue;
 }
@@ -211,6 +460,41 @@ int PLtag::getNoreadIgnore(void) {
 	return _noreadignore;
 }
 
+void PLtag::setWritePending(bool newValue) {
+	_writePending = newValue;
+}
+
+bool PLtag::getWritePending(void) {
+	return _writePending;
+}
+
+void PLtag::setWriteRequestTime(struct timespec *ts) {
+	_writeRequestTime = *ts;
+}
+
+struct timespec PLtag::getWriteRequestTime(void) {
+	return _writeRequestTime;
+}
+
+void PLtag::setBit(int newValue) {
+	if ((newValue < 0) || (newValue > 7))
+		_bit = -1;
+	else
+		_bit = newValue;
+}
+
+int PLtag::getBit(void) {
+	return _bit;
+}
+
+void PLtag::setToggle(bool newValue) {
+	_toggle = newValue;
+}
+
+bool PLtag::getToggle(void) {
+	return _toggle;
+}
+
 /*
 bool PLtag::setDataType(char newType) {
 	switch (newType) {
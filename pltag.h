@@ -2,7 +2,10 @@
  * @file pltag.h
 -----------------------------------------------------------------------------
  Class encapsulates a single PL device Tag unit
- 
+
+ The value and update time are written by the main loop only. They are
+ protected by a seqlock so getSample() returns a consistent pair when called
+ from another thread.
 -----------------------------------------------------------------------------
 */
 
@@ -10,11 +13,35 @@
 #define _PLTAG_H_
 
 #include <stdint.h>
+#include <time.h>
 
+#include <atomic>
 #include <iostream>
 #include <string>
+#include <vector>
+
+// filter applied to the raw value before scaling
+enum tagfilter {
+	TAG_FILTER_NONE,
+	TAG_FILTER_AVERAGE,				// moving average of the last N values
+	TAG_FILTER_EMA,					// exponential smoothing
+	TAG_FILTER_MEDIAN				// median of the last N values (spike rejection)
+};
+
+#define TAG_FILTER_LENGTH_MAX 64	// values kept by average and median filters
+
+// aggregates of one window of an aggregating tag
+struct tagaggregate {
+	time_t start;					// window start
+	int count;						// samples in the window
+	float min;
+	float max;
+	float last;
+	double sum;						// mean = sum / count
+};
 
 class PLtag {
+	void _store(double value, time_t updateTime);
 public:
     /**
      * Empty constructor
@@ -37,6 +64,12 @@ public:
 	 */
 	void noreadNotify(void);
 
+	/**
+	 * Put tag into noread state immediately, noreadignore is bypassed
+	 * (e.g. device is known to be down)
+	 */
+	void noreadForce(void);
+
 	/**
 	 * Get tag noread status
 	 */
@@ -84,11 +117,28 @@ public:
 	void setValue(double newValue);
 
 
+	/**
+	* Restore value and update time (e.g. from a snapshot)
+	*/
+	void restoreValue(double value, time_t updateTime);
+
 	/**
 	* Get value as double
 	*/
 	double getValue(void);
 
+	/**
+	* Get time of last successful update
+	* @return 0 if the tag has never been read
+	*/
+	time_t getLastUpdateTime(void);
+
+	/**
+	* Get value and time of last update as consistent pair
+	* safe to call from any thread
+	*/
+	void getSample(double *value, time_t *updateTime);
+
 	/**
 	* Get value as int
 	* @return value as int
@@ -119,6 +169,106 @@ public:
 	*/
 	int updateCycleId(void);
 
+	/**
+	 * Enable adaptive polling, the read interval follows the rate of change
+	 * @param intervalMin: shortest read interval [s]
+	 * @param intervalMax: longest read interval [s]
+	 * @param deadband: changes of the scaled value within +/- deadband count as flat
+	 */
+	void setAdaptive(int intervalMin, int intervalMax, float deadband);
+
+	/**
+	 * Is tag read at an adaptive interval instead of its update cycle
+	 */
+	bool isAdaptive(void);
+
+	int getIntervalMin(void);
+	int getIntervalMax(void);
+	float getDeadband(void);
+
+	/**
+	 * Make the tag a range tag, a block of consecutive registers starting at
+	 * the tag address which is read and published as one array
+	 * @param length: number of elements
+	 * @param width: bytes per element (1 or 2, lsb first)
+	 */
+	void setRange(int length, int width);
+
+	/**
+	 * Is tag a range tag
+	 */
+	bool isRange(void);
+
+	/**
+	 * Set the filter for raw values
+	 * @param length: number of values for average and median
+	 * @param alpha: weight of a new value for exponential smoothing (0 < alpha <= 1)
+	 */
+	void setFilter(tagfilter filter, int length, float alpha);
+
+	/**
+	 * Only every factor-th filtered value is used (decimation)
+	 */
+	void setDecimation(int factor);
+
+	/**
+	 * Has the tag a filter or decimation
+	 */
+	bool isFiltered(void);
+
+	/**
+	 * Pass a raw value through the filter and decimation
+	 * @param filtered: receives the filtered raw value
+	 * @returns true if the value is due, false if it is dropped by decimation
+	 */
+	bool filterValue(int raw, double *filtered);
+
+	/**
+	 * Clear the filter history (e.g. after a failed read)
+	 */
+	void filterReset(void);
+
+	/**
+	 * Publish the aggregates of a window instead of every sample
+	 * @param window: window length [s], windows are aligned to multiples of the length
+	 */
+	void setAggregate(int window);
+
+	/**
+	 * Is tag published as window aggregates
+	 */
+	bool isAggregate(void);
+
+	int getAggregateWindow(void);
+
+	/**
+	 * Add the scaled value to the open window
+	 * @param now: sample time, starts a window if none is open
+	 */
+	void aggregateAdd(time_t now);
+
+	/**
+	 * Close the open window if it has ended
+	 * @param result: receives the aggregates of the closed window
+	 * @returns true if a window was closed
+	 */
+	bool aggregateClose(time_t now, tagaggregate *result);
+
+	int getRangeLength(void);
+	int getRangeWidth(void);
+
+	/**
+	 * Replace all element values at once (range tags)
+	 * getValue() returns the first element
+	 */
+	void setRangeValues(const std::vector<int> &values);
+
+	/**
+	 * Get the scaled elements as array payload, e.g. "[12.5,13.0]"
+	 * @return empty string if the range has never been read
+	 */
+	std::string getRangePayload(void);
+
 	/**
 	* Get the topic string
 	* @return the topic string
@@ -136,6 +286,12 @@ public:
 	 */
 	void setTopic(const char*);
 
+	/**
+	 * Set/Get the name which refers to the tag in expressions (derived tags)
+	 */
+	void setName(const char*);
+	std::string getName(void);
+
     /**
      * assign mqtt retain value
      */
@@ -259,16 +415,41 @@ public:
 	 * Set write pending
 	 * to indicate that value needs to be written to the slave
 	 */
-//	void setWritePending(bool);
+	void setWritePending(bool);
 
 	/**
 	 * Get write pending
 	 */
-//	bool getWritePending(void);
+	bool getWritePending(void);
+
+	/**
+	 * Set/Get time (CLOCK_MONOTONIC) the write request was received
+	 */
+	void setWriteRequestTime(struct timespec *);
+	struct timespec getWriteRequestTime(void);
+
+	/**
+	 * Set bit number for bit write tags
+	 * @param bit: 0-7 or -1 to write the whole byte
+	 */
+	void setBit(int);
+
+	/**
+	 * Get bit number (-1 if tag is not a bit tag)
+	 */
+	int getBit(void);
+
+	/**
+	 * Set/Get toggle request for bit tags
+	 */
+	void setToggle(bool);
+	bool getToggle(void);
 
 	// public members used to store data which is not used inside this class
-	//int readInterval;                   // seconds between reads
-	//time_t nextReadTime;                // next scheduled read
+	int readInterval;                   // seconds between reads (adaptive tags)
+	time_t nextReadTime;                // next scheduled read (adaptive tags)
+	unsigned long updateSeq;            // sequence of the last new value (inputs of derived tags)
+	int64_t updateTime_ms;              // monotonic time of the last new value [ms]
 	//int publishInterval;                // seconds between publish
 	//time_t nextPublishTime;             // next publish time
 
@@ -276,11 +457,16 @@ private:
 	// All properties of this class are private
 	// Use setters & getters to access these values
 	std::string _topic;				// storage for topic path
+	std::string _name;				// name in expressions, empty if none
 	std::string _format;			// storage for publish format
-	double _value;					// storage for data value
+	std::atomic<unsigned int> _seq;	// seqlock sequence, odd while value is updated
+	std::atomic<double> _value;		// storage for data value
 	bool _publish_retain;           // publish with or without retain
 	bool _write;					// true for write tag, false for read tag
-//	bool _writePending;				// value needs to be written to slave
+	bool _writePending;				// value needs to be written to slave
+	bool _toggle;					// write request is a bit toggle
+	int _bit;						// bit number for bit write tags, -1 = byte
+	struct timespec _writeRequestTime;	// time write request was received
 	bool _ignoreRetained;			// do not write retained value to slave
 	float _multiplier;				// multiplier for scaled value
 	float _offset;					// offset for scaled value
@@ -293,7 +479,26 @@ private:
 	int	_group;						// group tags for single read
 //	uint16_t _rawValue;				// the value of this modbus tag
 	int _updatecycle_id;			// update cycle identifier
-	time_t _lastUpdateTime;			// last update time (change of value)
+	bool _adaptive;					// read interval adapts to the rate of change
+	int _intervalMin;				// adaptive read interval limits [s]
+	int _intervalMax;
+	float _deadband;				// scaled change which counts as a change
+	int _rangeLength;				// elements of a range tag, 0 = single register
+	int _rangeWidth;				// bytes per element
+	std::vector<int> _rangeValues;	// raw element values of the last complete read
+	tagfilter _filter;
+	int _filterLength;				// values kept by average and median
+	float _filterAlpha;				// weight of a new value (EMA)
+	std::vector<double> _filterValues;	// last raw values (ring)
+	std::vector<double> _filterSorted;	// scratch buffer for the median
+	int _filterIndex;				// next ring position
+	double _filterSum;				// sum of the ring values (average)
+	double _filterState;			// smoothed value (EMA)
+	int _decimation;				// use every n-th value
+	int _decimationCount;
+	int _aggregateWindow;			// [s] window length, 0 = publish every sample
+	tagaggregate _aggregate;		// open window, count 0 = no window open
+	std::atomic<time_t> _lastUpdateTime;	// last update time (change of value)
 //	char _dataType;					// i = input, q = output, r = register
 //	time_t _referenceTime;			// time to be used externally only
 
@@ -22,10 +22,16 @@
 #include <stdlib.h>
 #include <stdio.h>
 #include <string.h>
+#include <libgen.h>
+#include <limits.h>
 #include <sys/file.h>
+#include <sys/inotify.h>
+#include <sys/ioctl.h>
+#include <poll.h>
 #include <sys/select.h>
 #include <sys/stat.h>
 #include <unistd.h>
+#include <linux/serial.h>
 
 #include <string>
 #include <stdexcept>
@@ -41,6 +47,11 @@ using namespace std;
 #define PL_CMD_PUSH 87		// Short push or long push
 #define TTY_TIMEOUT_S 1
 #define TTY_TIMEOUT_US 0
+#define WRITE_SETTLE_DEFAULT_MS 50	// time for PL to process a write before read back
+#define WRITE_RETRIES_DEFAULT 2
+#define DEGRADE_WINDOW 20			// transactions per evaluation window
+#define DEGRADE_RECOVER_WINDOWS 10	// clean windows before one degrade step is undone
+#define FRAME_GAP_STEP_US 2000		// first inter-frame spacing step
 
 /*********************
  * MEMBER FUNCTIONS
@@ -58,15 +69,395 @@ Plxx::Plxx(const char* ttyDeviceStr, int baud) {
 	this->_ttyDevice = ttyDeviceStr;
 	this->_ttyBaud = baud;
 	this->_ttyFd = -1;
+	this->_writeVerify = false;
+	this->_writeSettle_us = WRITE_SETTLE_DEFAULT_MS * 1000;
+	this->_writeRetries = WRITE_RETRIES_DEFAULT;
+	this->_inotifyFd = -1;
+	this->_devicePresent = true;
+	memset(&_stats, 0, sizeof(_stats));
+	_stats.baud = baud;
+	this->_icountValid = false;
+	this->_garbled = false;
+	this->_lastFrameEnd.tv_sec = 0;
+	this->_lastFrameEnd.tv_nsec = 0;
+	this->_degradeRate = 0;
+	this->_frameGapMax_us = 0;
+	this->_baudSteps.push_back(baud);
+	this->_baudIndex = 0;
+	this->_windowTransactions = 0;
+	this->_windowFailures = 0;
+	this->_windowLineErrors = 0;
+	this->_cleanWindows = 0;
+	this->_lowLatency = false;
+	this->_recorder = NULL;
+	this->_replay = NULL;
+	memset(&_tx, 0, sizeof(_tx));
 }
 
 Plxx::~Plxx() {
 	_tty_close();
+	setHotplug(false);
 }
 
+/**
+ * watch the serial device node for removal and re-creation (e.g. USB-serial
+ * adapter re-enumerates). While the node is missing transactions fail
+ * immediately and the port is reopened as soon as the node reappears.
+ * @param enable: true to watch the device directory with inotify
+ * @returns 0 if successful, -1 on failure
+ */
+int Plxx::setHotplug(bool enable) {
+	char pathBuf[PATH_MAX];
+
+	if (_inotifyFd >= 0) {
+		close(_inotifyFd);
+		_inotifyFd = -1;
+	}
+	_devicePresent = true;
+	if (!enable) return 0;
+
+	_inotifyFd = inotify_init1(IN_NONBLOCK | IN_CLOEXEC);
+	if (_inotifyFd < 0) {
+		fprintf(stderr, "%s: inotify_init1 failed: %s\n", __func__, strerror(errno));
+		return -1;
+	}
+	strncpy(pathBuf, _ttyDevice.c_str(), sizeof(pathBuf) - 1);
+	pathBuf[sizeof(pathBuf) - 1] = 0;
+	_ttyName = basename(pathBuf);
+	strncpy(pathBuf, _ttyDevice.c_str(), sizeof(pathBuf) - 1);
+	// udev creates and removes device nodes and symlinks in the directory
+	if (inotify_add_watch(_inotifyFd, dirname(pathBuf), IN_CREATE | IN_DELETE | IN_MOVED_FROM | IN_MOVED_TO | IN_ATTRIB) < 0) {
+		fprintf(stderr, "%s: inotify_add_watch %s failed: %s\n", __func__, pathBuf, strerror(errno));
+		close(_inotifyFd);
+		_inotifyFd = -1;
+		return -1;
+	}
+	_devicePresent = (access(_ttyDevice.c_str(), F_OK) == 0);
+	return 0;
+}
+
+/**
+ * configure automatic link degradation
+ * the failure rate is evaluated over windows of DEGRADE_WINDOW transactions.
+ * Only failures which coincide with UART errors or garbled replies count as line
+ * problems, plain timeouts (device off) do not degrade the link.
+ * On a high failure rate the inter-frame spacing is increased first, then the
+ * next fallback baud rate is used. Each step is undone after a number of clean windows.
+ * @param failurePercent: failure rate which degrades the link, 0 = disabled
+ * @param frameGapMax_ms: upper limit of inter-frame spacing
+ * @param fallbackBaud: lower baud rates (speed_t) in order of use, may be empty
+ */
+void Plxx::setDegradation(int failurePercent, unsigned int frameGapMax_ms, const std::vector<int> &fallbackBaud) {
+	_degradeRate = (failurePercent < 0) ? 0 : failurePercent;
+	_frameGapMax_us = frameGapMax_ms * 1000;
+	_baudSteps.resize(1);
+	_baudSteps.insert(_baudSteps.end(), fallbackBaud.begin(), fallbackBaud.end());
+}
+
+/**
+ * get transaction and UART error statistics
+ */
+void Plxx::getLinkStats(plxx_link_stats *stats) {
+	*stats = _stats;
+}
+
+/**
+ * select low latency tty mode
+ * sets ASYNC_LOW_LATENCY (e.g. 1ms FTDI latency timer) where the driver supports it,
+ * reads with VMIN=0/VTIME=0 driven by poll() and skips tcdrain after a request,
+ * the reply wait covers the transmission of the request.
+ * The port is reopened with the new settings on the next transaction and the
+ * round trip time statistics are reset so each mode can be measured separately.
+ */
+void Plxx::setLowLatency(bool enable) {
+	if (enable == _lowLatency) return;
+	if ((_ttyFd >= 0) && !enable) _tty_serial_low_latency(false);
+	_tty_close();
+	_lowLatency = enable;
+	_stats.rttCount = 0;
+	_stats.rttSum_us = 0;
+	_stats.rttMin_us = 0;
+	_stats.rttMax_us = 0;
+	_stats.rttLast_us = 0;
+}
+
+/**
+ * record every transaction to a transaction log
+ * @param recorder: opened recorder, NULL to stop recording
+ */
+void Plxx::setRecorder(TxRecorder *recorder) {
+	_recorder = recorder;
+}
+
+/**
+ * serve all transactions from a recorded session instead of the tty
+ * @param replay: loaded replay, NULL to use the tty
+ */
+void Plxx::setReplay(TxReplay *replay) {
+	_replay = replay;
+}
+
+/**
+ * replay a single transaction, the link statistics are updated as for the tty
+ * @returns 0 if successful, -1 on failure
+ */
+int Plxx::_replay_transaction(unsigned char cmd, unsigned char address, unsigned char value, unsigned char *reply) {
+	bool success = (_replay->transaction(cmd, address, value, reply) == TX_OK);
+	_transaction_done(success);
+	return success ? 0 : -1;
+}
+
+/**
+ * store reply bytes of the transaction in progress
+ */
+void Plxx::_tx_reply(const unsigned char *buf, int len) {
+	struct timespec now;
+	for (int i = 0; (i < len) && (_tx.replyLen < TX_REPLY_MAX); i++) {
+		_tx.reply[_tx.replyLen++] = buf[i];
+	}
+	clock_gettime(CLOCK_MONOTONIC, &now);
+	_tx.recvDelta_us = (((int64_t)now.tv_sec * 1000000) + (now.tv_nsec / 1000)) - _tx.sendTime_us;
+}
+
+/**
+ * hand the completed transaction to the recorder
+ */
+void Plxx::_tx_done(void) {
+	if (_recorder != NULL) _recorder->record(_tx);
+}
+
+/**
+ * set or clear ASYNC_LOW_LATENCY on the open port, errors are not fatal
+ */
+void Plxx::_tty_serial_low_latency(bool enable) {
+	struct serial_struct ss;
+	if (ioctl(_ttyFd, TIOCGSERIAL, &ss) != 0) {
+		if (enable) printf("%s: TIOCGSERIAL not supported on %s\n", __func__, _ttyDevice.c_str());
+		return;
+	}
+	if (enable) ss.flags |= ASYNC_LOW_LATENCY;
+	else ss.flags &= ~ASYNC_LOW_LATENCY;
+	if ((ioctl(_ttyFd, TIOCSSERIAL, &ss) != 0) && enable)
+		printf("%s: ASYNC_LOW_LATENCY not supported on %s\n", __func__, _ttyDevice.c_str());
+}
+
+/**
+ * sample kernel UART error counters of the open port
+ * @returns number of new UART errors since the last sample
+ */
+int Plxx::_uart_sample(void) {
+	struct serial_icounter_struct ic;
+	int now[5], errors = 0;
+
+	if (_ttyFd < 0) return 0;
+	if (ioctl(_ttyFd, TIOCGICOUNT, &ic) != 0) {
+		_stats.icountSupported = false;		// e.g. USB serial driver without counters
+		return 0;
+	}
+	_stats.icountSupported = true;
+	now[0] = ic.frame;
+	now[1] = ic.parity;
+	now[2] = ic.overrun;
+	now[3] = ic.brk;
+	now[4] = ic.buf_overrun;
+	if (_icountValid) {
+		_stats.frameErrors += now[0] - _icountLast[0];
+		_stats.parityErrors += now[1] - _icountLast[1];
+		_stats.overruns += now[2] - _icountLast[2];
+		_stats.breaks += now[3] - _icountLast[3];
+		_stats.bufOverruns += now[4] - _icountLast[4];
+		for (int i = 0; i < 5; i++) errors += now[i] - _icountLast[i];
+	}
+	memcpy(_icountLast, now, sizeof(_icountLast));
+	_icountValid = true;
+	return errors;
+}
+
+/**
+ * account a completed transaction and evaluate link quality
+ */
+void Plxx::_transaction_done(bool success) {
+	int lineErrors = _uart_sample() + (_garbled ? 1 : 0);
+
+	clock_gettime(CLOCK_MONOTONIC, &_lastFrameEnd);
+	_stats.transactions++;
+	if (!success) {
+		_stats.failures++;
+		if (lineErrors > 0) _stats.lineFailures++;
+	}
+	_garbled = false;
+	if (_degradeRate <= 0) return;
+
+	_windowTransactions++;
+	if (!success) _windowFailures++;
+	_windowLineErrors += lineErrors;
+	if (_windowTransactions < DEGRADE_WINDOW) return;
+
+	if ((_windowFailures * 100 >= _degradeRate * _windowTransactions) && (_windowLineErrors > 0)) {
+		_degrade();
+		_cleanWindows = 0;
+	} else if ((_windowFailures == 0) && (_windowLineErrors == 0)) {
+		if (++_cleanWindows >= DEGRADE_RECOVER_WINDOWS) {
+			_recover();
+			_cleanWindows = 0;
+		}
+	} else {
+		_cleanWindows = 0;
+	}
+	_windowTransactions = 0;
+	_windowFailures = 0;
+	_windowLineErrors = 0;
+}
+
+/**
+ * one step towards a more robust link: more spacing, then lower baud
+ */
+void Plxx::_degrade(void) {
+	if (_stats.frameGap_us < _frameGapMax_us) {
+		_stats.frameGap_us = (_stats.frameGap_us == 0) ? FRAME_GAP_STEP_US : _stats.frameGap_us * 2;
+		if (_stats.frameGap_us > _frameGapMax_us) _stats.frameGap_us = _frameGapMax_us;
+	} else if (_baudIndex + 1 < (int)_baudSteps.size()) {
+		_baudIndex++;
+		_stats.frameGap_us = 0;
+		_set_baud(_baudSteps[_baudIndex]);
+	} else {
+		return;		// nothing left to degrade
+	}
+	_stats.degradeLevel++;
+	printf("%s: link degraded to level %d, frame gap %dus, baud step %d\n", __func__, _stats.degradeLevel, _stats.frameGap_us, _baudIndex);
+}
+
+/**
+ * undo one degrade step
+ */
+void Plxx::_recover(void) {
+	if (_stats.degradeLevel == 0) return;
+	if (_stats.frameGap_us > 0) {
+		_stats.frameGap_us = (_stats.frameGap_us <= FRAME_GAP_STEP_US) ? 0 : _stats.frameGap_us / 2;
+	} else if (_baudIndex > 0) {
+		_baudIndex--;
+		_stats.frameGap_us = _frameGapMax_us;
+		_set_baud(_baudSteps[_baudIndex]);
+	}
+	_stats.degradeLevel--;
+	printf("%s: link recovered to level %d, frame gap %dus, baud step %d\n", __func__, _stats.degradeLevel, _stats.frameGap_us, _baudIndex);
+}
+
+/**
+ * change baud rate, applied immediately if the port is open
+ */
+void Plxx::_set_baud(int baud) {
+	_ttyBaud = baud;
+	_stats.baud = baud;
+	if (_ttyFd >= 0) _tty_set_attribs(_ttyFd, _ttyBaud);
+}
+
+/**
+ * check if the serial device node exists
+ * always true if hotplug is not enabled
+ */
+bool Plxx::devicePresent(void) {
+	_hotplug_poll();
+	return _devicePresent;
+}
+
+/**
+ * process pending inotify events for the device node (non blocking)
+ */
+void Plxx::_hotplug_poll(void) {
+	char buf[4096] __attribute__ ((aligned(__alignof__(struct inotify_event))));
+	const struct inotify_event *event;
+	bool changed = false, present;
+	ssize_t len;
+
+	if (_inotifyFd < 0) return;
+	while ((len = read(_inotifyFd, buf, sizeof(buf))) > 0) {
+		for (char *ptr = buf; ptr < buf + len; ptr += sizeof(struct inotify_event) + event->len) {
+			event = (const struct inotify_event *) ptr;
+			if (event->mask & IN_Q_OVERFLOW) changed = true;
+			if ((event->len > 0) && (_ttyName == event->name)) changed = true;
+		}
+	}
+	if (!changed) return;
+
+	present = (access(_ttyDevice.c_str(), F_OK) == 0);		// follows udev symlink
+	if (!present) {
+		if (_devicePresent) printf("%s: %s removed\n", __func__, _ttyDevice.c_str());
+		_tty_close();
+	} else if (_ttyFd < 0) {
+		// reopen and configure right away, also retried on permission change (IN_ATTRIB)
+		if (!_devicePresent) printf("%s: %s present\n", __func__, _ttyDevice.c_str());
+		_tty_open();
+	}
+	_devicePresent = present;
+}
+
+/**
+ * configure verified write mode
+ * @param enable: true to read back every write
+ * @param settleTime_ms: delay between write and read back
+ * @param retries: number of repeated writes if read back does not match
+ */
+void Plxx::setWriteVerify(bool enable, unsigned int settleTime_ms, int retries) {
+	_writeVerify = enable;
+	_writeSettle_us = settleTime_ms * 1000;
+	_writeRetries = (retries < 0) ? 0 : retries;
+}
+
+/**
+ * write single byte value to RAM address
+ * in verified write mode the address is read back after the settle time
+ * and the write is repeated until the value matches or retries are exhausted
+ * @param address: RAM address to write
+ * @param writeValue: byte value to write
+ * @returns 0 if successful, -1 on failure
+ */
 int Plxx::write_RAM(unsigned char address, unsigned char writeValue) {
+	unsigned char readBack;
+	int attempt;
+
+	if (!_writeVerify)
+		return _write_RAM_once(address, writeValue);
+
+	for (attempt = 0; attempt <= _writeRetries; attempt++) {
+		if (_write_RAM_once(address, writeValue) < 0)
+			continue;
+		usleep(_writeSettle_us);
+		if (read_RAM(address, &readBack) < 0)
+			continue;
+		if (readBack == writeValue)
+			return 0;
+		fprintf(stderr, "%s: verify failed addr %d wrote %d read %d (attempt %d)\n", __func__, address, writeValue, readBack, attempt+1);
+	}
+	return -1;
+}
+
+/**
+ * read-modify-write of a single RAM byte
+ * new value = ((old & andMask) | orMask) ^ xorMask
+ * e.g. set bit n: andMask=0xFF orMask=(1<<n), clear: andMask=~(1<<n), toggle: xorMask=(1<<n)
+ * @param newValue: optional pointer to receive the value written
+ * @returns 0 if successful, -1 on failure
+ */
+int Plxx::modify_RAM(unsigned char address, unsigned char andMask, unsigned char orMask, unsigned char xorMask, unsigned char *newValue) {
+	unsigned char value;
+
+	if (read_RAM(address, &value) < 0)
+		return -1;
+	value = ((value & andMask) | orMask) ^ xorMask;
+	if (write_RAM(address, value) < 0)
+		return -1;
+	if (newValue != NULL)
+		*newValue = value;
+	return 0;
+}
+
+int Plxx::_write_RAM_once(unsigned char address, unsigned char writeValue) {
 	struct stat sb;
 
+	if (_replay != NULL) return _replay_transaction(PL_CMD_WR_RAM, address, writeValue, NULL);
+	if (!devicePresent()) return -1;		// device unplugged, don't wait for timeout
+
 	// if serial device is not open ....
 	if (fstat(this->_ttyFd, &sb) != 0) {
 		if (_tty_open() < 0)	// open serial device
@@ -80,9 +471,13 @@ int Plxx::write_RAM(unsigned char address, unsigned char writeValue) {
 //	if (_tty_read(&value) < 0)
 //		goto return_fail;
 
+	_tx_done();
+	_transaction_done(true);
 	return 0;
 
 return_fail:
+	_tx_done();
+	_transaction_done(false);
 	_tty_close();
 	return -1;
 }
@@ -94,8 +489,31 @@ return_fail:
  * @returns 0 if successful, -1 on failure
  */
 int Plxx::read_RAM(unsigned char address, unsigned char *readValue) {
+	return _read(PL_CMD_RD_RAM, address, readValue);
+}
+
+/**
+ * read single byte value from EEPROM address
+ * @param address: EEPROM address of the requested value
+ * @param readValue: pointer to a byte which will hold the value
+ * @returns 0 if successful, -1 on failure
+ */
+int Plxx::read_EEPROM(unsigned char address, unsigned char *readValue) {
+	return _read(PL_CMD_RD_EEPROM, address, readValue);
+}
+
+/**
+ * single byte read transaction
+ * @param cmd: PL_CMD_RD_RAM or PL_CMD_RD_EEPROM
+ */
+int Plxx::_read(unsigned char cmd, unsigned char address, unsigned char *readValue) {
 	unsigned char value;
 	struct stat sb;
+	struct timespec start, end;
+	unsigned int rtt_us;
+
+	if (_replay != NULL) return _replay_transaction(cmd, address, 0, readValue);
+	if (!devicePresent()) return -1;		// device unplugged, don't wait for timeout
 
 	// if serial device is not open ....
 	if (fstat(this->_ttyFd, &sb) != 0) {
@@ -104,16 +522,29 @@ int Plxx::read_RAM(unsigned char address, unsigned char *readValue) {
 			return -1;			// failed to open
 	}
 
-	if (_tty_write(address, PL_CMD_RD_RAM) < 0)
+	clock_gettime(CLOCK_MONOTONIC, &start);
+	if (_tty_write(address, cmd) < 0)
 		goto return_fail;
 
-	if (_tty_read(&value) < 0)
+	if ((_lowLatency ? _tty_read_poll(&value) : _tty_read(&value)) < 0)
 		goto return_fail;
+	clock_gettime(CLOCK_MONOTONIC, &end);
+
+	rtt_us = ((end.tv_sec - start.tv_sec) * 1000000) + ((end.tv_nsec - start.tv_nsec) / 1000);
+	if ((_stats.rttCount == 0) || (rtt_us < _stats.rttMin_us)) _stats.rttMin_us = rtt_us;
+	if (rtt_us > _stats.rttMax_us) _stats.rttMax_us = rtt_us;
+	_stats.rttLast_us = rtt_us;
+	_stats.rttSum_us += rtt_us;
+	_stats.rttCount++;
 
 	*readValue = value;
+	_tx_done();
+	_transaction_done(true);
 	return 0;
 
 return_fail:
+	_tx_done();
+	_transaction_done(false);
 	_tty_close();
 	return -1;
 }
@@ -141,8 +572,24 @@ int Plxx::read_RAM(unsigned char lsb_addr, unsigned char msb_addr, unsigned char
 	return 0;
 }
 
+/**
+ * read consecutive RAM addresses back to back
+ * @param start: first RAM address
+ * @param count: number of bytes, start + count must not exceed 256
+ * @param values: receives count bytes
+ * @returns 0 if successful, -1 on failure (the sweep stops at the first failed read)
+ */
+int Plxx::read_RAM_block(unsigned char start, int count, unsigned char *values) {
+	if ((values == NULL) || (count < 1) || (start + count > 256)) return -1;
+	for (int i = 0; i < count; i++) {
+		if (read_RAM((unsigned char)(start + i), &values[i]) < 0)
+			return -1;
+	}
+	return 0;
+}
+
 int Plxx::_tty_open() {
-	this->_ttyFd = open(this->_ttyDevice.c_str(), O_RDWR | O_NOCTTY | O_SYNC);
+	this->_ttyFd = open(this->_ttyDevice.c_str(), O_RDWR | O_NOCTTY | (_lowLatency ? O_NONBLOCK : O_SYNC));
 	if (_ttyFd < 0) {
 		printf("Error opening %s: %s\n", this->_ttyDevice.c_str(), strerror(errno));
 		return -1;
@@ -159,6 +606,9 @@ int Plxx::_tty_open() {
 		_tty_close(true);
 		return -1;
 	}
+	_icountValid = false;
+	_uart_sample();			// baseline of UART error counters
+	if (_lowLatency) _tty_serial_low_latency(true);
 	//set_mincount(_tty_Fd, 0);                /* set to pure timed read */
 	return 0;
 }
@@ -199,8 +649,13 @@ int Plxx::_tty_set_attribs(int fd, int speed)
     tty.c_oflag &= ~OPOST;
 
     /* fetch bytes as they become available */
-    tty.c_cc[VMIN] = 2;			// wait for 2 bytes (std reply)
-    tty.c_cc[VTIME] = 10;		// wait for 1 second
+    if (_lowLatency) {
+        tty.c_cc[VMIN] = 0;         // read returns immediately, waiting is done by poll()
+        tty.c_cc[VTIME] = 0;
+    } else {
+        tty.c_cc[VMIN] = 2;			// wait for 2 bytes (std reply)
+        tty.c_cc[VTIME] = 10;		// wait for 1 second
+    }
 
     if (tcsetattr(fd, TCSANOW, &tty) != 0) {
         printf("Error from tcsetattr: %s\n", strerror(errno));
@@ -212,17 +667,92 @@ int Plxx::_tty_set_attribs(int fd, int speed)
 int Plxx::_tty_write(unsigned char address, unsigned char cmd, unsigned char value) {
 	int wrLen;
 	unsigned char txbuf[10];
+	struct timespec now;
+	long elapsed_us;
+
+	// inter-frame spacing on a degraded link
+	if (_stats.frameGap_us > 0) {
+		clock_gettime(CLOCK_MONOTONIC, &now);
+		elapsed_us = ((now.tv_sec - _lastFrameEnd.tv_sec) * 1000000) + ((now.tv_nsec - _lastFrameEnd.tv_nsec) / 1000);
+		if ((elapsed_us >= 0) && (elapsed_us < (long)_stats.frameGap_us))
+			usleep(_stats.frameGap_us - elapsed_us);
+	}
 	txbuf[0] = cmd;
 	txbuf[1] = address;
 	txbuf[2] = value;			// used in write operations
 	txbuf[3] = 255 - cmd;		// One's complement
 
+	memset(&_tx, 0, sizeof(_tx));
+	clock_gettime(CLOCK_MONOTONIC, &now);
+	_tx.sendTime_us = ((int64_t)now.tv_sec * 1000000) + (now.tv_nsec / 1000);
+	_tx.cmd = cmd;
+	_tx.address = address;
+	_tx.value = value;
+
 	wrLen = write(this->_ttyFd, txbuf, 4);
 	if (wrLen != 4) {
 		printf("Error from write: %d, %d\n", wrLen, errno);
+		_tx.error = TX_ERR_WRITE;
+		return -1;
+	}
+	// in low latency mode the reply wait (or the next request) follows the queued frame
+	if (!_lowLatency)
+		tcdrain(this->_ttyFd);    /* delay for output */
+	return 0;
+}
+
+/**
+ * read PLxx double byte response in low latency mode
+ * the reply is collected with poll() as bytes arrive
+ * @param value: pointer to read value
+ */
+int Plxx::_tty_read_poll(unsigned char *value) {
+	unsigned char buf[80];
+	struct pollfd pfd;
+	struct timespec deadline, now;
+	int rxlen = 0, rdlen, timeout_ms, result;
+
+	if (value == NULL) return -1;
+	clock_gettime(CLOCK_MONOTONIC, &deadline);
+	deadline.tv_sec += TTY_TIMEOUT_S;
+	pfd.fd = _ttyFd;
+	pfd.events = POLLIN;
+
+	while (rxlen < 2) {
+		clock_gettime(CLOCK_MONOTONIC, &now);
+		timeout_ms = ((deadline.tv_sec - now.tv_sec) * 1000) + ((deadline.tv_nsec - now.tv_nsec) / 1000000);
+		if (timeout_ms <= 0) {
+			fprintf(stderr, "%s: no reply within timeout (%d bytes)\n", __func__, rxlen);
+			_tx_reply(buf, rxlen);
+			_tx.error = TX_ERR_TIMEOUT;
+			return -1;
+		}
+		result = poll(&pfd, 1, timeout_ms);
+		if (result < 0) {
+			if (errno == EINTR) continue;
+			perror("poll()");
+			_tx.error = TX_ERR_READ;
+			return -1;
+		}
+		if (result == 0) continue;		// timeout, checked above
+		rdlen = read(_ttyFd, buf + rxlen, sizeof(buf) - rxlen);
+		if (rdlen < 0) {
+			if ((errno == EAGAIN) || (errno == EINTR)) continue;
+			fprintf(stderr, "Error from read: %d: %s\n", rdlen, strerror(errno));
+			_tx.error = TX_ERR_READ;
+			return -1;
+		}
+		rxlen += rdlen;
+	}
+	_tx_reply(buf, rxlen);
+	if (buf[0] != 200) {
+		fprintf(stderr, "Error response expected:%d received:%d\n", 200, buf[0]);
+		_tx.error = TX_ERR_REPLY;
+		_garbled = true;
+		*value = 0;
 		return -1;
 	}
-	tcdrain(this->_ttyFd);    /* delay for output */
+	*value = buf[1];
 	return 0;
 }
 
@@ -250,10 +780,12 @@ int Plxx::_tty_read(unsigned char *value) {
 
 	if (select_result == -1) {
 		perror("select()");
+		_tx.error = TX_ERR_READ;
 		return -1;
 	}
 	if (!select_result) {
 		perror("No data within timeout.\n");
+		_tx.error = TX_ERR_TIMEOUT;
 		return -1;
 	}
 
@@ -261,17 +793,22 @@ int Plxx::_tty_read(unsigned char *value) {
 		rdlen = read(this->_ttyFd, buf, sizeof(buf) - 1);
 		if (rdlen > 0) {
 			rxlen += rdlen;
+			_tx_reply(buf, rdlen);
 			if  (buf[0] != 200) {
 				fprintf(stderr, "Error response expected:%d received:%d\n", 200, buf[0]);
+				_tx.error = TX_ERR_REPLY;
+				_garbled = true;
 				*value = 0;
 				return -1;
 			}
 			*value = buf[1];
 		} else if (rdlen < 0) {
 			fprintf(stderr, "Error from read: %d: %s\n", rdlen, strerror(errno));
+			_tx.error = TX_ERR_READ;
 			return -1;
 		} else {  /* rdlen == 0 */
 			perror("Timeout from read\n");
+			_tx.error = TX_ERR_TIMEOUT;
 			return -1;
 		}
 	} while (rxlen < 2);
@@ -17,8 +17,13 @@
  *********************/
 #include <stdint.h>
 #include <termios.h>
+#include <time.h>
 //#include <iostream>
 #include <string>
+#include <vector>
+
+#include "txrecorder.h"
+#include "txreplay.h"
 
 /*********************
  *      DEFINES
@@ -29,6 +34,27 @@
  *      TYPEDEFS
  **********************/
 
+// serial link statistics, UART counters are sampled with TIOCGICOUNT
+struct plxx_link_stats {
+	unsigned long transactions;			// read and write transactions
+	unsigned long failures;				// failed transactions
+	unsigned long lineFailures;			// failures with UART errors or a garbled reply
+	unsigned long frameErrors;			// UART counters since the port was opened
+	unsigned long parityErrors;
+	unsigned long overruns;
+	unsigned long breaks;
+	unsigned long bufOverruns;
+	bool icountSupported;				// driver provides UART counters
+	unsigned int frameGap_us;			// current inter-frame spacing
+	int baud;							// current baud rate (speed_t)
+	int degradeLevel;					// 0 = configured link parameters
+	unsigned long rttCount;				// successful read transactions measured
+	unsigned long long rttSum_us;		// round trip time: request write to complete reply
+	unsigned int rttMin_us;
+	unsigned int rttMax_us;
+	unsigned int rttLast_us;
+};
+
 
 /**********************
  *      CLASS
@@ -41,7 +67,20 @@ public:
 	~Plxx();
 	int read_RAM(unsigned char address, unsigned char *readValue);
 	int read_RAM(unsigned char lsb_addr, unsigned char msb_addr, unsigned char *lsb_value, unsigned char *msb_value);
+	int read_RAM_block(unsigned char start, int count, unsigned char *values);
+	int read_EEPROM(unsigned char address, unsigned char *readValue);
 	int write_RAM(unsigned char address, unsigned char writeValue);
+	int modify_RAM(unsigned char address, unsigned char andMask, unsigned char orMask, unsigned char xorMask, unsigned char *newValue = NULL);
+	void setWriteVerify(bool enable, unsigned int settleTime_ms, int retries);
+	bool writeVerify(void) { return _writeVerify; }
+	int setHotplug(bool enable);
+	bool devicePresent(void);
+	void setDegradation(int failurePercent, unsigned int frameGapMax_ms, const std::vector<int> &fallbackBaud);
+	void getLinkStats(plxx_link_stats *stats);
+	void setRecorder(TxRecorder *recorder);
+	void setReplay(TxReplay *replay);
+	void setLowLatency(bool enable);
+	bool lowLatency(void) { return _lowLatency; }
 
 private:
 	int _tty_open();
@@ -49,10 +88,47 @@ private:
 	int _tty_set_attribs(int fd, int speed);
 	int _tty_write(unsigned char address, unsigned char cmd, unsigned char value=0);
 	int _tty_read(unsigned char *value);
+	int _tty_read_poll(unsigned char *value);
+	void _tty_serial_low_latency(bool enable);
+	int _write_RAM_once(unsigned char address, unsigned char writeValue);
+	int _read(unsigned char cmd, unsigned char address, unsigned char *readValue);
+	void _hotplug_poll(void);
+	int _uart_sample(void);
+	void _transaction_done(bool success);
+	void _degrade(void);
+	void _recover(void);
+	void _set_baud(int baud);
+	void _tx_reply(const unsigned char *buf, int len);
+	void _tx_done(void);
+	int _replay_transaction(unsigned char cmd, unsigned char address, unsigned char value, unsigned char *reply);
 
 	std::string _ttyDevice;
 	int _ttyBaud;
 	int _ttyFd;
+	bool _writeVerify;				// read back after write
+	unsigned int _writeSettle_us;	// device settle time before read back
+	int _writeRetries;				// number of retries for failed verify
+	int _inotifyFd;					// watches device directory, -1 if hotplug is disabled
+	std::string _ttyName;			// device name within the watched directory
+	bool _devicePresent;			// device node exists
+
+	plxx_link_stats _stats;
+	int _icountLast[5];				// last UART counters: frame, parity, overrun, brk, buf_overrun
+	bool _icountValid;				// _icountLast holds a baseline for the open port
+	bool _garbled;					// last reply was received but invalid
+	struct timespec _lastFrameEnd;	// end of last transaction (CLOCK_MONOTONIC)
+	int _degradeRate;				// failure rate [%] per window which degrades the link, 0 = off
+	unsigned int _frameGapMax_us;
+	std::vector<int> _baudSteps;	// configured baud followed by fallback rates (speed_t)
+	int _baudIndex;					// index into _baudSteps
+	int _windowTransactions;
+	int _windowFailures;
+	int _windowLineErrors;			// UART errors and garbled replies in the window
+	int _cleanWindows;				// consecutive windows without errors
+	bool _lowLatency;				// non-blocking poll driven reads, no tcdrain
+	TxRecorder *_recorder;			// transaction log, NULL if not recording
+	tx_record _tx;					// transaction in progress
+	TxReplay *_replay;				// serves transactions instead of the tty, NULL = tty
 
 };
 
@@ -29,6 +29,7 @@
 
 #include <iostream>
 #include <string>
+#include <vector>
 
 #include "plxx.h"
 
@@ -43,6 +44,32 @@ static string execName;
 static string ttyDeviceStr = "/dev/ttyUSB0";	// default device
 static int address = 50;						// default address Battery Voltage
 static int ttyBaudrate;							// default baudrate is 9600
+static int readCount = 1;						// number of reads
+static bool lowLatency = false;					// low latency tty mode
+static bool compareModes = false;				// measure round trip time in both modes
+static std::vector<int> addressList;			// addresses given with -a
+static int profileTime = 0;						// [s] volatility profile duration, 0 = off
+static int profileDeadband = 0;					// changes within +/- deadband are noise
+
+#define PROFILE_CHANGES_MIN 3					// changes needed to derive an interval
+
+// update cycle intervals [s] which can be suggested
+static const int profileIntervals[] = { 1, 2, 5, 10, 20, 30, 60, 120, 300, 600, 1800 };
+
+// per address statistics of a volatility profile
+struct profile_stats {
+	int address;
+	unsigned long samples;
+	unsigned long failed;
+	unsigned long changes;			// changes larger than the deadband
+	int value;						// last value
+	int reference;					// value at the last counted change
+	int min;
+	int max;
+	int maxStep;					// largest change between two samples
+	unsigned long stepSum;			// sum of counted changes
+	int suggestedInterval;			// [s]
+};
 
 Plxx *pl;
 
@@ -97,10 +124,17 @@ int getBaudrate(int baud) {
 
 static void showUsage(void) {
 	cout << "usage:" << endl;
-	cout << execName << " -aAddress -pSerialDevice -bBaudrate -h" << endl;
+	cout << execName << " -aAddress -pSerialDevice -bBaudrate -nCount -l -t -PSeconds -dDeadband -h" << endl;
 	cout << "a = Address to read from PL device (e.g 50)[0-255]" << endl;
+	cout << "    a list of addresses for profiling (e.g. 50,52,101 or 0-255)" << endl;
 	cout << "s = Serial device (e.g. /dev/ttyUSB0)" << endl;
 	cout << "b = Baudrate (e.g. 9600) [300|1200|2400|9600]" << endl;
+	cout << "n = Number of reads, round trip time is reported for more than one read" << endl;
+	cout << "l = Low latency tty mode" << endl;
+	cout << "t = Compare round trip time of standard and low latency mode" << endl;
+	cout << "P = Profile how often the addresses change for a number of seconds" << endl;
+	cout << "    and suggest update cycles, all addresses are profiled if -a is not given" << endl;
+	cout << "d = Deadband for profiling, changes within +/- deadband are ignored (default 0)" << endl;
 	cout << "h = Display help" << endl;
 	cout << "default device is /etc/ttyUSB0" << endl;
 	cout << "default baudrate is 9600" << endl;
@@ -108,6 +142,34 @@ static void showUsage(void) {
 }
 
 
+/**
+ * parse a list of addresses and address ranges, e.g. "50,52,100-103"
+ * @returns number of addresses, -1 if the list is invalid
+ */
+int parseAddressList(const char *list) {
+	const char *p = list;
+	char *end;
+	long first, last;
+
+	addressList.clear();
+	while (*p != 0) {
+		first = strtol(p, &end, 10);
+		if ((end == p) || (first < 0) || (first > 255)) return -1;
+		last = first;
+		p = end;
+		if (*p == '-') {
+			last = strtol(p + 1, &end, 10);
+			if ((end == p + 1) || (last < first) || (last > 255)) return -1;
+			p = end;
+		}
+		for (long a = first; a <= last; a++) addressList.push_back((int)a);
+		if (*p == ',') p++;
+		else if (*p != 0) return -1;
+	}
+	if (addressList.empty()) return -1;
+	return (int)addressList.size();
+}
+
 bool parseArguments(int argc, char *argv[]) {
 	char buffer[64];
 	int i, buflen;
@@ -122,8 +184,12 @@ bool parseArguments(int argc, char *argv[]) {
 			if ((buffer[0] == '-') && (buflen >=2)) {
 				switch (buffer[1]) {
 				case 'a':
-					str = std::string(&buffer[2]);
-					address = std::stoi( str );
+					if (parseAddressList(&buffer[2]) < 0) {
+						log(LOG_NOTICE, "invalid address: %s", argv[i]);
+						retval = false;
+						break;
+					}
+					address = addressList[0];
 					break;
 				case 's':
 					ttyDeviceStr = std::string(&buffer[2]);
@@ -132,6 +198,26 @@ bool parseArguments(int argc, char *argv[]) {
 					str = std::string(&buffer[2]);
 					ttyBaudrate = std::stoi( str );
 					break;
+				case 'n':
+					str = std::string(&buffer[2]);
+					readCount = std::stoi( str );
+					if (readCount < 1) readCount = 1;
+					break;
+				case 'l':
+					lowLatency = true;
+					break;
+				case 't':
+					compareModes = true;
+					if (readCount < 2) readCount = 100;
+					break;
+				case 'P':
+					str = std::string(&buffer[2]);
+					profileTime = std::stoi( str );
+					break;
+				case 'd':
+					str = std::string(&buffer[2]);
+					profileDeadband = std::stoi( str );
+					break;
 				case 'h':
 					showUsage();
 					retval = false;
@@ -152,6 +238,138 @@ bool parseArguments(int argc, char *argv[]) {
 }
 
 
+/**
+ * read address readCount times and report round trip time
+ * @returns number of failed reads, -1 if no read was successful
+ */
+int read_timed(bool lowLatencyMode) {
+	unsigned char value = 0;
+	int failed = 0;
+	plxx_link_stats stats;
+
+	pl->setLowLatency(lowLatencyMode);
+	for (int i = 0; i < readCount; i++) {
+		if (pl->read_RAM((unsigned char) address, &value) < 0) failed++;
+	}
+	pl->getLinkStats(&stats);
+	if (stats.rttCount == 0) return -1;
+	printf("%-12s address %d contains %d, %d reads, %d failed, round trip min %uus avg %lluus max %uus\n",
+		lowLatencyMode ? "low latency" : "standard", address, value, readCount, failed,
+		stats.rttMin_us, stats.rttSum_us / stats.rttCount, stats.rttMax_us);
+	return failed;
+}
+
+/**
+ * update cycle for an address, half the mean time between changes,
+ * rounded down to one of the profile intervals
+ */
+int profile_interval(profile_stats *ps, double duration, double sampleInterval) {
+	double interval;
+	int index, count = sizeof(profileIntervals) / sizeof(profileIntervals[0]);
+
+	if (ps->changes < PROFILE_CHANGES_MIN) return profileIntervals[count - 1];	// (nearly) constant
+	interval = duration / ps->changes / 2;
+	if (interval < sampleInterval) interval = sampleInterval;	// changes faster than we can tell
+	for (index = count - 1; index > 0; index--) {
+		if (profileIntervals[index] <= interval) break;
+	}
+	return profileIntervals[index];
+}
+
+/**
+ * sample all addresses round robin at the maximum rate for profileTime seconds,
+ * print change statistics and suggested update cycles
+ * @returns 0 on success, -1 if no read was successful
+ */
+int profile(void) {
+	std::vector<profile_stats> stats;
+	profile_stats *ps;
+	struct timespec start, now;
+	double elapsed = 0, sampleInterval;
+	unsigned char value;
+	unsigned long rounds = 0, total = 0;
+	int step, cycle, lastCycle;
+
+	if (addressList.empty()) parseAddressList("0-255");
+	stats.resize(addressList.size());
+	for (size_t i = 0; i < addressList.size(); i++) {
+		memset(&stats[i], 0, sizeof(profile_stats));
+		stats[i].address = addressList[i];
+		stats[i].value = -1;
+	}
+	signal(SIGINT, sigHandler);		// stop early and report what we have
+	fprintf(stderr, "profiling %d addresses for %ds ...\n", (int)addressList.size(), profileTime);
+
+	clock_gettime(CLOCK_MONOTONIC, &start);
+	while (!exitSignal && (elapsed < profileTime)) {
+		for (size_t i = 0; (i < stats.size()) && !exitSignal; i++) {
+			ps = &stats[i];
+			if (pl->read_RAM((unsigned char)ps->address, &value) < 0) {
+				ps->failed++;
+				continue;
+			}
+			total++;
+			ps->samples++;
+			if (ps->value < 0) {
+				ps->min = ps->max = ps->reference = value;
+			} else {
+				step = abs(value - ps->value);
+				if (step > ps->maxStep) ps->maxStep = step;
+				if (abs(value - ps->reference) > profileDeadband) {
+					ps->changes++;
+					ps->stepSum += abs(value - ps->reference);
+					ps->reference = value;
+				}
+			}
+			if (value < ps->min) ps->min = value;
+			if (value > ps->max) ps->max = value;
+			ps->value = value;
+		}
+		rounds++;
+		clock_gettime(CLOCK_MONOTONIC, &now);
+		elapsed = (now.tv_sec - start.tv_sec) + ((now.tv_nsec - start.tv_nsec) / 1e9);
+	}
+	if (total == 0) return -1;
+
+	sampleInterval = elapsed / rounds;
+	printf("// volatility profile: %d addresses, %.0fs, %lu samples, every address sampled every %.2fs, deadband %d\n",
+		(int)stats.size(), elapsed, total, sampleInterval, profileDeadband);
+	printf("// address  samples  failed  changes  changes/min    min    max  max step  mean step  cycle [s]\n");
+	for (size_t i = 0; i < stats.size(); i++) {
+		ps = &stats[i];
+		if (ps->samples == 0) {
+			printf("// %7d  %7lu  %6lu  no reply\n", ps->address, ps->samples, ps->failed);
+			continue;
+		}
+		ps->suggestedInterval = profile_interval(ps, elapsed, sampleInterval);
+		printf("// %7d  %7lu  %6lu  %7lu  %11.1f  %5d  %5d  %8d  %9.1f  %9d\n", ps->address, ps->samples, ps->failed,
+			ps->changes, ps->changes * 60 / elapsed, ps->min, ps->max, ps->maxStep,
+			(ps->changes > 0) ? (double)ps->stepSum / ps->changes : 0.0, ps->suggestedInterval);
+	}
+
+	// configuration snippet, one update cycle per suggested interval
+	printf("updatecycles = (\n");
+	lastCycle = 0;
+	for (int interval : profileIntervals) {
+		for (size_t i = 0; i < stats.size(); i++) {
+			if ((stats[i].samples == 0) || (stats[i].suggestedInterval != interval)) continue;
+			printf("%s\t{\n\tid = %d;\n\tinterval = %d;\n\t}", (lastCycle > 0) ? ",\n" : "", interval, interval);
+			lastCycle = interval;
+			break;
+		}
+	}
+	printf("\n)\n");
+	printf("tags = (\n");
+	cycle = 0;
+	for (size_t i = 0; i < stats.size(); i++) {
+		if (stats[i].samples == 0) continue;
+		printf("%s\t{\n\taddress = %d;\n\tupdate_cycle = %d;\n\t}", (cycle > 0) ? ",\n" : "", stats[i].address, stats[i].suggestedInterval);
+		cycle++;
+	}
+	printf("\n)\n");
+	return 0;
+}
+
 int main (int argc, char *argv[])
 {
 	unsigned char value;
@@ -168,6 +386,24 @@ int main (int argc, char *argv[])
 
 	pl = new Plxx(ttyDeviceStr.c_str(), getBaudrate(ttyBaudrate));
 
+	if (profileTime > 0) {
+		pl->setLowLatency(lowLatency);
+		if (profile() < 0) goto exit_fail;
+		delete pl;
+		exit(EXIT_SUCCESS);
+	}
+	if (compareModes) {
+		if ((read_timed(false) < 0) || (read_timed(true) < 0)) goto exit_fail;
+		delete pl;
+		exit(EXIT_SUCCESS);
+	}
+	if (readCount > 1) {
+		if (read_timed(lowLatency) < 0) goto exit_fail;
+		delete pl;
+		exit(EXIT_SUCCESS);
+	}
+
+	pl->setLowLatency(lowLatency);
 	if ( pl->read_RAM((unsigned char) address, &value) < 0)
 		goto exit_fail;
 
@@ -0,0 +1,146 @@
+/**
+ * @file plxx_stress.cpp
+ *
+ * https://github.com/helioz2000/pl20
+ *
+ * Stress test of the state shared between the main loop and the mosquitto thread:
+ * the PLtag seqlock (value and update time) and the SPSC queue of received messages.
+ * Build with "make stress SANITIZE=thread" to run it under ThreadSanitizer.
+ */
+
+/*********************
+ *      INCLUDES
+ *********************/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include <atomic>
+#include <iostream>
+#include <string>
+#include <thread>
+
+#include "mqtt.h"
+#include "pltag.h"
+#include "spscqueue.h"
+
+using namespace std;
+
+#define STRESS_ITERATIONS_DEFAULT 1000000
+
+static string execName;
+static long iterations = STRESS_ITERATIONS_DEFAULT;
+
+static void showUsage(void) {
+	cout << "usage:" << endl;
+	cout << execName << " [-n<iterations>] [-h]" << endl;
+	cout << "n: values written / messages queued per test, default " << STRESS_ITERATIONS_DEFAULT << endl;
+	cout << "h: show this help" << endl;
+}
+
+static bool parseArguments(int argc, char *argv[]) {
+	for (int i = 1; i < argc; i++) {
+		if ((argv[i][0] != '-') || (strlen(argv[i]) < 2)) {
+			cerr << "unknown parameter: " << argv[i] << endl;
+			return false;
+		}
+		switch (argv[i][1]) {
+		case 'n':
+			iterations = atol(&argv[i][2]);
+			if (iterations < 1) return false;
+			break;
+		case 'h':
+		default:
+			return false;
+		}
+	}
+	return true;
+}
+
+/**
+ * main loop thread writes value n with update time n, another thread reads samples
+ * a sample with value != time is a torn read, a sample older than the previous one is a lost update
+ * @returns number of errors
+ */
+static long stress_seqlock(void) {
+	PLtag tag;
+	std::atomic<bool> done(false);
+	long errors = 0, reads = 0;
+
+	std::thread reader([&]() {
+		double value, last = 0;
+		time_t updateTime;
+		while (!done.load(std::memory_order_acquire)) {
+			tag.getSample(&value, &updateTime);
+			if ((value != (double)updateTime) || (value < last)) errors++;
+			last = value;
+			reads++;
+		}
+	});
+	for (long n = 1; n <= iterations; n++) {
+		tag.restoreValue((double)n, (time_t)n);
+	}
+	done.store(true, std::memory_order_release);
+	reader.join();
+	printf("seqlock: %ld writes, %ld reads, %ld errors\n", iterations, reads, errors);
+	return errors;
+}
+
+/**
+ * mosquitto thread pushes numbered messages, the main loop pops them
+ * every message must arrive once, in order and with its own topic and payload
+ * @returns number of errors
+ */
+static long stress_queue(void) {
+	static SpscQueue<mqtt_rx_message, MQTT_RX_QUEUE_SIZE> queue;
+	mqtt_rx_message message;
+	char text[32];
+	long errors = 0, full = 0, expected = 0;
+
+	std::thread producer([&]() {
+		mqtt_rx_message msg;
+		memset(&msg, 0, sizeof(msg));
+		for (long n = 0; n < iterations; n++) {
+			snprintf(msg.topic, sizeof(msg.topic), "stress/%ld", n);
+			msg.payloadlen = snprintf(msg.payload, sizeof(msg.payload), "%ld", n);
+			msg.mid = (int)n;
+			while (!queue.push(msg)) {
+				full++;
+				std::this_thread::yield();
+			}
+		}
+	});
+	while (expected < iterations) {
+		if (!queue.pop(&message)) {
+			std::this_thread::yield();
+			continue;
+		}
+		snprintf(text, sizeof(text), "%ld", expected);
+		if ((message.mid != (int)expected) || (strcmp(message.payload, text) != 0) ||
+			(strcmp(message.topic + 7, text) != 0)) errors++;
+		expected++;
+	}
+	producer.join();
+	if (!queue.empty()) errors++;
+	printf("queue: %ld messages, %ld times full, %ld errors\n", iterations, full, errors);
+	return errors;
+}
+
+int main (int argc, char *argv[])
+{
+	long errors;
+	execName = std::string(basename(argv[0]));
+
+	if (!parseArguments(argc, argv)) {
+		showUsage();
+		exit(EXIT_FAILURE);
+	}
+	errors = stress_seqlock();
+	errors += stress_queue();
+	if (errors > 0) {
+		fprintf(stderr, "%s: %ld errors\n", execName.c_str(), errors);
+		exit(EXIT_FAILURE);
+	}
+	exit(EXIT_SUCCESS);
+}
@@ -0,0 +1,172 @@
+/**
+ * @file plxx_tscheck.cpp
+ *
+ * https://github.com/helioz2000/pl20
+ *
+ * Round trip check of the time-series store: samples appended to a store in a
+ * temporary directory must be returned unchanged by a query, across blocks,
+ * segment rotations and a reopen of the store.
+ */
+
+/*********************
+ *      INCLUDES
+ *********************/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+#include <iostream>
+#include <string>
+#include <vector>
+
+#include "tsstore.h"
+
+using namespace std;
+
+#define TSCHECK_SAMPLES_DEFAULT 5000
+#define TSCHECK_SEGMENT_SIZE 16384			// small segments, so the check rotates
+#define TSCHECK_SEGMENTS 1000				// keep all segments
+#define TSCHECK_START_MS 1700000000000LL
+
+static string execName;
+static long sampleCount = TSCHECK_SAMPLES_DEFAULT;
+
+static void showUsage(void) {
+	cout << "usage:" << endl;
+	cout << execName << " [-n<samples>] [-h]" << endl;
+	cout << "n: samples appended per tag, default " << TSCHECK_SAMPLES_DEFAULT << endl;
+	cout << "h: show this help" << endl;
+}
+
+static bool parseArguments(int argc, char *argv[]) {
+	for (int i = 1; i < argc; i++) {
+		if ((argv[i][0] != '-') || (strlen(argv[i]) < 2)) {
+			cerr << "unknown parameter: " << argv[i] << endl;
+			return false;
+		}
+		switch (argv[i][1]) {
+		case 'n':
+			sampleCount = atol(&argv[i][2]);
+			if (sampleCount < 2) return false;
+			break;
+		case 'h':
+		default:
+			return false;
+		}
+	}
+	return true;
+}
+
+/**
+ * sample n of a tag: irregular intervals, repeated, small and large value changes
+ */
+static ts_sample make_sample(int tag, long n) {
+	ts_sample sample;
+	sample.time_ms = TSCHECK_START_MS + (n * 1000) + ((n * 7919) % 250);
+	switch (tag) {
+	case 0: sample.value = (float)((n / 10) * 0.1); break;				// slowly changing
+	case 1: sample.value = (float)((long)((n * 2654435761UL) % 100000) - 50000) / 7.0f; break;	// noisy
+	default: sample.value = (float)tag; break;							// constant
+	}
+	return sample;
+}
+
+static void remove_store(const char *dir) {
+	vector<string> files;
+	TSStore::segments(dir, files);
+	for (size_t i = 0; i < files.size(); i++) unlink(files[i].c_str());
+	rmdir(dir);
+}
+
+/**
+ * query a tag and compare it with the samples which were appended
+ * @returns number of errors
+ */
+static long check_tag(const char *dir, int tag, long count, int64_t from_ms, int64_t until_ms) {
+	vector<ts_sample> samples;
+	ts_sample expected;
+	char name[TS_NAME_LEN];
+	long errors = 0, index = 0;
+
+	snprintf(name, sizeof(name), "check/tag%d", tag);
+	if (TSStore::query(dir, name, from_ms, until_ms, samples) < 0) {
+		fprintf(stderr, "%s: %s can't be read\n", __func__, name);
+		return 1;
+	}
+	for (long n = 0; n < count; n++) {
+		expected = make_sample(tag, n);
+		if ((expected.time_ms < from_ms) || (expected.time_ms > until_ms)) continue;
+		if ((index >= (long)samples.size()) || (samples[index].time_ms != expected.time_ms) ||
+			(memcmp(&samples[index].value, &expected.value, sizeof(float)) != 0)) {
+			if (errors == 0) fprintf(stderr, "%s: %s sample %ld differs\n", __func__, name, n);
+			errors++;
+		}
+		index++;
+	}
+	if (index != (long)samples.size()) {
+		fprintf(stderr, "%s: %s %ld samples expected, %ld returned\n", __func__, name, index, (long)samples.size());
+		errors++;
+	}
+	return errors;
+}
+
+/**
+ * append the first half of the samples, reopen the store, append the rest
+ * @returns number of errors
+ */
+static long check_store(const char *dir) {
+	TSStore store;
+	char name[TS_NAME_LEN];
+	long errors = 0, half = sampleCount / 2;
+	unsigned long rotations = 0;
+	int64_t mid_ms;
+
+	for (int pass = 0; pass < 2; pass++) {
+		if (store.open(dir, TSCHECK_SEGMENT_SIZE, TSCHECK_SEGMENTS) < 0) {
+			fprintf(stderr, "%s: unable to open store in %s\n", __func__, dir);
+			return 1;
+		}
+		for (int tag = 0; tag < 3; tag++) {
+			snprintf(name, sizeof(name), "check/tag%d", tag);
+			store.addColumn(name);
+		}
+		for (long n = (pass == 0) ? 0 : half; n < ((pass == 0) ? half : sampleCount); n++) {
+			for (int tag = 0; tag < 3; tag++) store.append(tag, make_sample(tag, n));
+		}
+		rotations += store.rotations();
+		store.close();
+	}
+	for (int tag = 0; tag < 3; tag++) {
+		errors += check_tag(dir, tag, sampleCount, INT64_MIN, INT64_MAX);
+		// time range in the middle of a block
+		mid_ms = make_sample(tag, sampleCount / 3).time_ms;
+		errors += check_tag(dir, tag, sampleCount, mid_ms, mid_ms + (sampleCount * 100));
+	}
+	printf("tsstore: %ld samples of 3 tags, %lu rotations, %ld errors\n", sampleCount, rotations, errors);
+	return errors;
+}
+
+int main (int argc, char *argv[])
+{
+	char dir[] = "/tmp/plxx_tscheck.XXXXXX";
+	long errors;
+	execName = std::string(basename(argv[0]));
+
+	if (!parseArguments(argc, argv)) {
+		showUsage();
+		exit(EXIT_FAILURE);
+	}
+	if (mkdtemp(dir) == NULL) {
+		fprintf(stderr, "%s: unable to create %s\n", execName.c_str(), dir);
+		exit(EXIT_FAILURE);
+	}
+	errors = check_store(dir);
+	remove_store(dir);
+	if (errors > 0) {
+		fprintf(stderr, "%s: %ld errors\n", execName.c_str(), errors);
+		exit(EXIT_FAILURE);
+	}
+	exit(EXIT_SUCCESS);
+}
@@ -0,0 +1,204 @@
+/**
+ * @file plxx_tsquery.cpp
+ *
+ * https://github.com/helioz2000/pl20
+ *
+ * Query the local time-series store written by plbridge
+ */
+
+/*********************
+ *      INCLUDES
+ *********************/
+
+#include <limits.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#include <algorithm>
+#include <iostream>
+#include <string>
+#include <vector>
+
+#include "tsstore.h"
+
+using namespace std;
+
+static string execName;
+static string storeDir;
+static string tagName;
+static bool listTags = false;
+static int64_t from_ms = LLONG_MIN;
+static int64_t until_ms = LLONG_MAX;
+static int bucketSeconds = 0;					// aggregate interval, 0 = raw samples
+
+static void showUsage(void) {
+	cout << "usage:" << endl;
+	cout << execName << " -d<dir> [-l] [-t<tag>] [-f<time>] [-u<time>] [-a<seconds>] [-h]" << endl;
+	cout << "d: directory of the store (timeseries.dir)" << endl;
+	cout << "l: list the stored tags with sample count and time range" << endl;
+	cout << "t: tag (topic) to query, prints time,value" << endl;
+	cout << "f: from time, seconds since epoch or relative to now e.g. -f-2h (s, m, h, d)" << endl;
+	cout << "u: until time, same format as from time" << endl;
+	cout << "a: aggregate into intervals of <seconds>, prints time,count,min,max,mean,last" << endl;
+	cout << "h: show this help" << endl;
+}
+
+/**
+ * parse a time argument
+ * @returns time [ms], false if the argument is invalid
+ */
+static bool parseTime(const char *str, int64_t *time_ms) {
+	char *end;
+	long long value = strtoll(str, &end, 10);
+	long long unit = 1;
+
+	if (end == str) return false;
+	switch (*end) {
+		case 0: case 's': unit = 1; break;
+		case 'm': unit = 60; break;
+		case 'h': unit = 3600; break;
+		case 'd': unit = 86400; break;
+		default: return false;
+	}
+	if ((*end != 0) && (*(end + 1) != 0)) return false;
+	if (str[0] == '-') value = (long long)time(NULL) + (value * unit);		// relative to now
+	else if (*end != 0) return false;
+	*time_ms = (int64_t)value * 1000;
+	return true;
+}
+
+static const char *timeText(int64_t time_ms) {
+	static char str[40];
+	time_t sec = (time_t)(time_ms / 1000);
+	struct tm tm;
+
+	localtime_r(&sec, &tm);
+	strftime(str, sizeof(str), "%Y-%m-%d %H:%M:%S", &tm);
+	snprintf(str + strlen(str), sizeof(str) - strlen(str), ".%03d", (int)(time_ms % 1000));
+	return str;
+}
+
+static bool parseArguments(int argc, char *argv[]) {
+	string str;
+
+	for (int i = 1; i < argc; i++) {
+		if ((argv[i][0] != '-') || (strlen(argv[i]) < 2)) {
+			cerr << "unknown parameter: " << argv[i] << endl;
+			return false;
+		}
+		str = std::string(&argv[i][2]);
+		switch (argv[i][1]) {
+		case 'd':
+			storeDir = str;
+			break;
+		case 'l':
+			listTags = true;
+			break;
+		case 't':
+			tagName = str;
+			break;
+		case 'f':
+		case 'u':
+			if (!parseTime(str.c_str(), (argv[i][1] == 'f') ? &from_ms : &until_ms)) {
+				cerr << "invalid time: " << argv[i] << endl;
+				return false;
+			}
+			break;
+		case 'a':
+			bucketSeconds = atoi(str.c_str());
+			if (bucketSeconds < 1) {
+				cerr << "invalid interval: " << argv[i] << endl;
+				return false;
+			}
+			break;
+		case 'h':
+		default:
+			return false;
+		}
+	}
+	return !storeDir.empty() && (listTags || !tagName.empty());
+}
+
+static bool compareTime(const ts_sample &a, const ts_sample &b) {
+	return a.time_ms < b.time_ms;
+}
+
+/**
+ * print count, time range and value range of every stored tag
+ */
+static void printTags(void) {
+	vector<string> names;
+	vector<ts_sample> samples;
+	float minValue, maxValue;
+
+	TSStore::names(storeDir.c_str(), names);
+	printf("tag,samples,first,last,min,max\n");
+	for (size_t index = 0; index < names.size(); index++) {
+		if (TSStore::query(storeDir.c_str(), names[index].c_str(), from_ms, until_ms, samples) <= 0) continue;
+		stable_sort(samples.begin(), samples.end(), compareTime);
+		minValue = maxValue = samples[0].value;
+		for (size_t i = 0; i < samples.size(); i++) {
+			minValue = min(minValue, samples[i].value);
+			maxValue = max(maxValue, samples[i].value);
+		}
+		printf("%s,%lu,", names[index].c_str(), (unsigned long)samples.size());
+		printf("%s,", timeText(samples.front().time_ms));
+		printf("%s,%g,%g\n", timeText(samples.back().time_ms), minValue, maxValue);
+	}
+}
+
+/**
+ * print the samples of a tag, or one line per interval with the aggregates
+ */
+static void printSamples(vector<ts_sample> &samples) {
+	int64_t bucket_ms = (int64_t)bucketSeconds * 1000;
+	int64_t start_ms;
+	size_t first, index;
+	float minValue, maxValue;
+	double sum;
+
+	if (bucket_ms == 0) {
+		printf("time,value\n");
+		for (index = 0; index < samples.size(); index++) {
+			printf("%s,%g\n", timeText(samples[index].time_ms), samples[index].value);
+		}
+		return;
+	}
+	printf("time,count,min,max,mean,last\n");
+	for (first = 0; first < samples.size(); first = index) {
+		start_ms = samples[first].time_ms - (((samples[first].time_ms % bucket_ms) + bucket_ms) % bucket_ms);
+		minValue = maxValue = samples[first].value;
+		sum = 0;
+		for (index = first; (index < samples.size()) && (samples[index].time_ms < start_ms + bucket_ms); index++) {
+			minValue = min(minValue, samples[index].value);
+			maxValue = max(maxValue, samples[index].value);
+			sum += samples[index].value;
+		}
+		printf("%s,%lu,%g,%g,%g,%g\n", timeText(start_ms), (unsigned long)(index - first), minValue, maxValue,
+			sum / (index - first), samples[index - 1].value);
+	}
+}
+
+int main (int argc, char *argv[])
+{
+	vector<ts_sample> samples;
+	execName = std::string(basename(argv[0]));
+
+	if (!parseArguments(argc, argv)) {
+		showUsage();
+		exit(EXIT_FAILURE);
+	}
+	if (listTags) {
+		printTags();
+		exit(EXIT_SUCCESS);
+	}
+	if (TSStore::query(storeDir.c_str(), tagName.c_str(), from_ms, until_ms, samples) < 0) {
+		fprintf(stderr, "no time-series store in %s\n", storeDir.c_str());
+		exit(EXIT_FAILURE);
+	}
+	stable_sort(samples.begin(), samples.end(), compareTime);		// blocks of a segment are ordered by write time
+	printSamples(samples);
+	exit(EXIT_SUCCESS);
+}
@@ -0,0 +1,103 @@
+/**
+ * @file plxx_txdump.cpp
+ *
+ * https://github.com/helioz2000/pl20
+ *
+ * Print a PL transaction log written by TxRecorder as text
+ */
+
+/*********************
+ *      INCLUDES
+ *********************/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#include <iostream>
+#include <string>
+
+#include "txrecorder.h"
+
+using namespace std;
+
+static string execName;
+
+static void showUsage(void) {
+	cout << "usage:" << endl;
+	cout << execName << " logfile [logfile ...]" << endl;
+	cout << "prints one line per transaction:" << endl;
+	cout << "time, command, address, value, reply time [us], reply bytes, result" << endl;
+}
+
+static const char *errorText(int error) {
+	switch (error) {
+		case TX_OK: return "ok";
+		case TX_ERR_WRITE: return "write error";
+		case TX_ERR_TIMEOUT: return "timeout";
+		case TX_ERR_REPLY: return "bad reply";
+		case TX_ERR_READ: return "read error";
+		default: return "unknown";
+	}
+}
+
+/**
+ * dump one log file
+ * @returns 0 on success, -1 on failure
+ */
+static int dumpFile(const char *fileName) {
+	tx_log_header header;
+	tx_record rec;
+	FILE *fp;
+	int64_t wall_us;
+	time_t sec;
+	struct tm tm;
+	char timeStr[40], replyStr[4 * TX_REPLY_MAX + 1];
+	unsigned long count = 0;
+
+	fp = fopen(fileName, "rb");
+	if (fp == NULL) {
+		fprintf(stderr, "unable to open %s\n", fileName);
+		return -1;
+	}
+	if ((fread(&header, sizeof(header), 1, fp) != 1) || (header.magic != TX_LOG_MAGIC) ||
+		(header.version != TX_LOG_VERSION) || (header.recordSize != sizeof(tx_record))) {
+		fprintf(stderr, "%s is not a transaction log\n", fileName);
+		fclose(fp);
+		return -1;
+	}
+	printf("# %s\n", fileName);
+	while (fread(&rec, sizeof(rec), 1, fp) == 1) {
+		// monotonic send time to wall clock time
+		wall_us = header.realtime_us + (rec.sendTime_us - header.monotonic_us);
+		sec = wall_us / 1000000;
+		localtime_r(&sec, &tm);
+		strftime(timeStr, sizeof(timeStr), "%Y-%m-%d %H:%M:%S", &tm);
+		replyStr[0] = 0;
+		for (int i = 0; i < rec.replyLen; i++) {
+			snprintf(replyStr + strlen(replyStr), sizeof(replyStr) - strlen(replyStr), "%s%d", (i > 0) ? "," : "", rec.reply[i]);
+		}
+		printf("%s.%06d cmd %3d addr %3d value %3d rtt %7u reply [%s] %s\n", timeStr, (int)(wall_us % 1000000),
+			rec.cmd, rec.address, rec.value, rec.recvDelta_us, replyStr, errorText(rec.error));
+		count++;
+	}
+	printf("# %lu transactions\n", count);
+	fclose(fp);
+	return 0;
+}
+
+int main (int argc, char *argv[])
+{
+	int retval = EXIT_SUCCESS;
+	execName = std::string(basename(argv[0]));
+
+	if ((argc < 2) || (strcmp(argv[1], "-h") == 0)) {
+		showUsage();
+		exit(EXIT_FAILURE);
+	}
+	for (int i = 1; i < argc; i++) {
+		if (dumpFile(argv[i]) < 0) retval = EXIT_FAILURE;
+	}
+	exit(retval);
+}
@@ -0,0 +1,180 @@
+/**
+ * @file samplering.cpp
+ *
+ */
+
+/*********************
+ *      INCLUDES
+ *********************/
+#include <errno.h>
+#include <fcntl.h>
+#include <stddef.h>
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include "samplering.h"
+
+using namespace std;
+
+/*********************
+ * MEMBER FUNCTIONS
+ *********************/
+
+SampleRing::SampleRing() {
+	_fd = -1;
+	_mapSize = 0;
+	_header = NULL;
+	_records = NULL;
+}
+
+SampleRing::~SampleRing() {
+	close();
+}
+
+int SampleRing::open(const char *fileName, uint32_t capacity, uint32_t configHash) {
+	struct stat sb;
+	void *map;
+	bool reuse = false;
+
+	if ((fileName == NULL) || (capacity < 1)) return -1;
+	close();
+	_fileName = fileName;
+	_mapSize = sizeof(sample_ring_header) + ((size_t)capacity * sizeof(sample_record));
+
+	_fd = ::open(fileName, O_RDWR | O_CREAT, 0644);
+	if (_fd < 0) {
+		fprintf(stderr, "%s: unable to open %s: %s\n", __func__, fileName, strerror(errno));
+		return -1;
+	}
+	if (fstat(_fd, &sb) != 0) goto open_fail;
+	if ((size_t)sb.st_size != _mapSize) {
+		if (ftruncate(_fd, _mapSize) != 0) {
+			fprintf(stderr, "%s: unable to size %s: %s\n", __func__, fileName, strerror(errno));
+			goto open_fail;
+		}
+	} else {
+		reuse = true;
+	}
+
+	map = mmap(NULL, _mapSize, PROT_READ | PROT_WRITE, MAP_SHARED, _fd, 0);
+	if (map == MAP_FAILED) {
+		fprintf(stderr, "%s: mmap %s failed: %s\n", __func__, fileName, strerror(errno));
+		goto open_fail;
+	}
+	_header = (sample_ring_header *)map;
+	_records = (sample_record *)((char *)map + sizeof(sample_ring_header));
+
+	// keep the samples of a previous run if the file is compatible
+	if (reuse && (_header->magic == SAMPLE_RING_MAGIC) && (_header->version == SAMPLE_RING_VERSION) &&
+		(_header->capacity == capacity) && (_header->configHash == configHash) &&
+		(_header->tailSeq <= _header->headSeq) && ((_header->headSeq - _header->tailSeq) <= capacity)) {
+		return 0;
+	}
+	memset(_header, 0, sizeof(sample_ring_header));
+	_header->magic = SAMPLE_RING_MAGIC;
+	_header->version = SAMPLE_RING_VERSION;
+	_header->capacity = capacity;
+	_header->configHash = configHash;
+	sync();
+	return 0;
+
+open_fail:
+	::close(_fd);
+	_fd = -1;
+	return -1;
+}
+
+void SampleRing::close(void) {
+	if (_header != NULL) {
+		msync(_header, _mapSize, MS_SYNC);
+		munmap(_header, _mapSize);
+		_header = NULL;
+		_records = NULL;
+	}
+	if (_fd >= 0) {
+		::close(_fd);
+		_fd = -1;
+	}
+}
+
+bool SampleRing::isOpen(void) {
+	return (_header != NULL);
+}
+
+void SampleRing::append(uint16_t tagIndex, float value, int64_t timestamp_ms, uint16_t pending) {
+	sample_record *rec;
+	if ((_header == NULL) || (pending == 0)) return;
+	if ((_header->headSeq - _header->tailSeq) >= _header->capacity) {
+		_header->tailSeq++;			// ring full, overwrite oldest sample
+		_header->dropped++;
+	}
+	rec = &_records[_header->headSeq % _header->capacity];
+	rec->timestamp_ms = timestamp_ms;
+	rec->value = value;
+	rec->tagIndex = tagIndex;
+	rec->pending = pending;
+	_header->headSeq++;
+}
+
+bool SampleRing::peek(int link, sample_record *rec) {
+	uint64_t *seq;
+	sample_record *r;
+	uint16_t bit = 1 << link;
+
+	if ((_header == NULL) || (link < 0) || (link >= SAMPLE_RING_LINKS)) return false;
+	seq = &_header->linkSeq[link];
+	if (*seq < _header->tailSeq) *seq = _header->tailSeq;		// samples lost to overflow
+	while (*seq < _header->headSeq) {
+		r = &_records[*seq % _header->capacity];
+		if (r->pending & bit) {
+			*rec = *r;
+			return true;
+		}
+		(*seq)++;				// not for this link
+	}
+	return false;
+}
+
+void SampleRing::pop(int link) {
+	uint64_t *seq;
+
+	if ((_header == NULL) || (link < 0) || (link >= SAMPLE_RING_LINKS)) return;
+	seq = &_header->linkSeq[link];
+	if ((*seq < _header->tailSeq) || (*seq >= _header->headSeq)) return;	// overwritten meanwhile
+	_records[*seq % _header->capacity].pending &= ~(1 << link);
+	(*seq)++;
+	_trim();
+}
+
+/**
+ * remove samples from the tail which are done for all links
+ */
+void SampleRing::_trim(void) {
+	while ((_header->tailSeq < _header->headSeq) && (_records[_header->tailSeq % _header->capacity].pending == 0)) {
+		_header->tailSeq++;
+	}
+}
+
+uint32_t SampleRing::count(void) {
+	if (_header == NULL) return 0;
+	return (uint32_t)(_header->headSeq - _header->tailSeq);
+}
+
+uint32_t SampleRing::dropped(void) {
+	if (_header == NULL) return 0;
+	return _header->dropped;
+}
+
+void SampleRing::resetDropped(void) {
+	if (_header == NULL) return;
+	_header->dropped = 0;
+}
+
+void SampleRing::sync(void) {
+	if (_header == NULL) return;
+	msync(_header, _mapSize, MS_ASYNC);
+}
@@ -0,0 +1,126 @@
+/**
+ * @file samplering.h
+ *
+ -----------------------------------------------------------------------------
+  The SampleRing class provides a bounded, memory mapped ring file for
+  samples which could not be published (e.g. broker unreachable).
+  The ring file survives a process restart. When the ring is full the
+  oldest sample is overwritten.
+  Each sample carries a mask of the links (broker connections) which still
+  need it. Every link has its own replay cursor, so a link which stays
+  offline does not hold back the replay to the other links.
+
+ -----------------------------------------------------------------------------
+ */
+
+#ifndef SAMPLERING_H
+#define SAMPLERING_H
+
+#include <stdint.h>
+
+#include <string>
+
+#define SAMPLE_RING_MAGIC 0x504C5252		// "PLRR"
+#define SAMPLE_RING_VERSION 2
+#define SAMPLE_RING_LINKS 8				// max number of links (bits in pending mask)
+
+/**
+ * a single stored sample (16 bytes)
+ */
+struct sample_record {
+	int64_t timestamp_ms;		// wall clock time of the sample [ms]
+	float value;				// scaled value
+	uint16_t tagIndex;			// index of the tag in the read tag array
+	uint16_t pending;			// mask of links which have not received the sample
+};
+
+/**
+ * ring file header, located at the start of the file
+ */
+struct sample_ring_header {
+	uint32_t magic;
+	uint32_t version;
+	uint32_t capacity;			// number of records in the ring
+	uint32_t configHash;		// hash of the tag configuration which wrote the ring
+	uint32_t dropped;			// records overwritten because the ring was full
+	uint32_t reserved;
+	uint64_t headSeq;			// sequence number of the next record written
+	uint64_t tailSeq;			// sequence number of the oldest record
+	uint64_t linkSeq[SAMPLE_RING_LINKS];	// next record to replay per link
+};
+
+class SampleRing {
+public:
+	SampleRing();
+	~SampleRing();
+
+	/**
+	 * open (or create) the ring file
+	 * an existing file is reused if capacity and configHash match
+	 * @param fileName: ring file path
+	 * @param capacity: number of records
+	 * @param configHash: identifies the tag configuration
+	 * @returns 0 on success, -1 on failure
+	 */
+	int open(const char *fileName, uint32_t capacity, uint32_t configHash);
+
+	/**
+	 * sync and unmap the ring file
+	 */
+	void close(void);
+
+	/**
+	 * @returns true if the ring file is open
+	 */
+	bool isOpen(void);
+
+	/**
+	 * append a sample, overwrites the oldest sample if the ring is full
+	 * @param pending: mask of links which need the sample
+	 */
+	void append(uint16_t tagIndex, float value, int64_t timestamp_ms, uint16_t pending);
+
+	/**
+	 * get the next sample to replay for a link, the sample stays in the ring
+	 * @param link: link number [0..SAMPLE_RING_LINKS-1]
+	 * @returns false if there is nothing to replay for the link
+	 */
+	bool peek(int link, sample_record *rec);
+
+	/**
+	 * mark the sample returned by peek() as done for the link
+	 * samples which are done for all links are removed from the ring
+	 */
+	void pop(int link);
+
+	/**
+	 * @returns number of samples stored
+	 */
+	uint32_t count(void);
+
+	/**
+	 * @returns number of samples lost due to ring overflow
+	 */
+	uint32_t dropped(void);
+
+	/**
+	 * restart the count of samples lost due to ring overflow
+	 */
+	void resetDropped(void);
+
+	/**
+	 * schedule write back of modified pages to the file
+	 */
+	void sync(void);
+
+private:
+	void _trim(void);
+
+	std::string _fileName;
+	int _fd;
+	size_t _mapSize;
+	sample_ring_header *_header;
+	sample_record *_records;
+};
+
+#endif /* SAMPLERING_H */
@@ -0,0 +1,120 @@
+/**
+ * @file snapshot.cpp
+ *
+ */
+
+/*********************
+ *      INCLUDES
+ *********************/
+#include <errno.h>
+#include <stddef.h>
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+
+#include <string>
+
+#include "snapshot.h"
+
+using namespace std;
+
+/*********************
+ * GLOBAL FUNCTIONS
+ *********************/
+
+int snapshot_save(const char *fileName, uint32_t configHash, PLtag *tags, int tagCount, updatecycle *cycles) {
+	snapshot_header header;
+	snapshot_tag tagEntry;
+	snapshot_cycle cycleEntry;
+	string tmpName = string(fileName) + ".tmp";
+	FILE *fp;
+	int index;
+	time_t updateTime;
+
+	memset(&header, 0, sizeof(header));
+	header.magic = SNAPSHOT_MAGIC;
+	header.version = SNAPSHOT_VERSION;
+	header.configHash = configHash;
+	header.tagCount = tagCount;
+	header.saveTime = time(NULL);
+	for (index = 0; cycles[index].ident >= 0; index++) ;
+	header.cycleCount = index;
+
+	fp = fopen(tmpName.c_str(), "wb");
+	if (fp == NULL) {
+		fprintf(stderr, "%s: unable to open %s: %s\n", __func__, tmpName.c_str(), strerror(errno));
+		return -1;
+	}
+	if (fwrite(&header, sizeof(header), 1, fp) != 1) goto save_fail;
+	for (index = 0; index < tagCount; index++) {
+		tags[index].getSample(&tagEntry.value, &updateTime);
+		tagEntry.updateTime = updateTime;
+		if (fwrite(&tagEntry, sizeof(tagEntry), 1, fp) != 1) goto save_fail;
+	}
+	for (index = 0; index < (int)header.cycleCount; index++) {
+		cycleEntry.ident = cycles[index].ident;
+		cycleEntry.interval = cycles[index].interval;
+		cycleEntry.nextUpdateTime = cycles[index].nextUpdateTime;
+		if (fwrite(&cycleEntry, sizeof(cycleEntry), 1, fp) != 1) goto save_fail;
+	}
+	if (fclose(fp) != 0) {
+		unlink(tmpName.c_str());
+		return -1;
+	}
+	// replace previous snapshot in one step
+	if (rename(tmpName.c_str(), fileName) != 0) {
+		fprintf(stderr, "%s: unable to rename %s: %s\n", __func__, tmpName.c_str(), strerror(errno));
+		unlink(tmpName.c_str());
+		return -1;
+	}
+	return 0;
+
+save_fail:
+	fprintf(stderr, "%s: write to %s failed\n", __func__, tmpName.c_str());
+	fclose(fp);
+	unlink(tmpName.c_str());
+	return -1;
+}
+
+int snapshot_restore(const char *fileName, uint32_t configHash, PLtag *tags, int tagCount, updatecycle *cycles) {
+	snapshot_header header;
+	snapshot_tag tagEntry;
+	snapshot_cycle cycleEntry;
+	time_t now = time(NULL);
+	time_t next;
+	FILE *fp;
+	int index, cycleIdx, restored = 0;
+
+	fp = fopen(fileName, "rb");
+	if (fp == NULL) return -1;
+	if ((fread(&header, sizeof(header), 1, fp) != 1) || (header.magic != SNAPSHOT_MAGIC) ||
+		(header.version != SNAPSHOT_VERSION) || (header.configHash != configHash) ||
+		((int)header.tagCount != tagCount)) {
+		fclose(fp);
+		return -1;
+	}
+	for (index = 0; index < tagCount; index++) {
+		if (fread(&tagEntry, sizeof(tagEntry), 1, fp) != 1) break;
+		if (tagEntry.updateTime == 0) continue;		// tag was never read
+		tags[index].restoreValue(tagEntry.value, (time_t)tagEntry.updateTime);
+		restored++;
+	}
+	// restore the phase of matching update cycles
+	for (index = 0; index < (int)header.cycleCount; index++) {
+		if (fread(&cycleEntry, sizeof(cycleEntry), 1, fp) != 1) break;
+		for (cycleIdx = 0; cycles[cycleIdx].ident >= 0; cycleIdx++) {
+			if ((cycles[cycleIdx].ident != cycleEntry.ident) || (cycles[cycleIdx].interval != cycleEntry.interval))
+				continue;
+			if (cycles[cycleIdx].interval < 1) break;
+			next = (time_t)cycleEntry.nextUpdateTime;
+			if (next <= now)	// roll forward to the next update after now
+				next += ((now - next) / cycles[cycleIdx].interval + 1) * cycles[cycleIdx].interval;
+			cycles[cycleIdx].alignedUpdateTime = next;
+			break;
+		}
+	}
+	fclose(fp);
+	return restored;
+}
@@ -0,0 +1,62 @@
+/**
+ * @file snapshot.h
+ *
+ -----------------------------------------------------------------------------
+  Compact binary snapshot of tag values and update cycle phases.
+  The snapshot is saved periodically and on exit and restored at startup
+  to publish the last known values immediately after a restart.
+
+ -----------------------------------------------------------------------------
+ */
+
+#ifndef SNAPSHOT_H
+#define SNAPSHOT_H
+
+#include <stdint.h>
+
+#include "pltag.h"
+#include "plbridge.h"
+
+#define SNAPSHOT_MAGIC 0x504C534E		// "PLSN"
+#define SNAPSHOT_VERSION 1
+
+struct snapshot_header {
+	uint32_t magic;
+	uint32_t version;
+	uint32_t configHash;		// hash of the tag configuration
+	uint32_t tagCount;
+	uint32_t cycleCount;
+	uint32_t reserved;
+	int64_t saveTime;			// time the snapshot was written
+};
+
+struct snapshot_tag {
+	double value;				// last known raw value
+	int64_t updateTime;			// time of last successful read, 0 = never read
+};
+
+struct snapshot_cycle {
+	int32_t ident;
+	int32_t interval;
+	int64_t nextUpdateTime;
+};
+
+/**
+ * write snapshot file (atomic replace)
+ * @param fileName: snapshot file path
+ * @param configHash: identifies the tag configuration
+ * @param tags: array of tags
+ * @param tagCount: number of tags in array
+ * @param cycles: update cycle array, terminated by ident < 0
+ * @returns 0 on success, -1 on failure
+ */
+int snapshot_save(const char *fileName, uint32_t configHash, PLtag *tags, int tagCount, updatecycle *cycles);
+
+/**
+ * restore tag values and cycle phases from snapshot file
+ * the snapshot is ignored if it was written with a different configuration
+ * @returns number of restored tags, -1 if no usable snapshot exists
+ */
+int snapshot_restore(const char *fileName, uint32_t configHash, PLtag *tags, int tagCount, updatecycle *cycles);
+
+#endif /* SNAPSHOT_H */
@@ -0,0 +1,60 @@
+/**
+ * @file spscqueue.h
+ *
+ -----------------------------------------------------------------------------
+  SpscQueue is a bounded lock-free queue for exactly one producer thread
+  and one consumer thread. It is used to hand events from the mosquitto
+  loop thread to the main loop without locking either side.
+  Items are copied, T must be trivially copyable.
+
+ -----------------------------------------------------------------------------
+ */
+
+#ifndef SPSCQUEUE_H
+#define SPSCQUEUE_H
+
+#include <atomic>
+
+template <typename T, unsigned int N>
+class SpscQueue {
+public:
+	SpscQueue() : _head(0), _tail(0) {}
+
+	/**
+	 * add item to the queue (producer thread only)
+	 * @returns false if the queue is full
+	 */
+	bool push(const T &item) {
+		unsigned int head = _head.load(std::memory_order_relaxed);
+		if ((head - _tail.load(std::memory_order_acquire)) >= N) return false;
+		_buf[head % N] = item;
+		_head.store(head + 1, std::memory_order_release);	// publish item to consumer
+		return true;
+	}
+
+	/**
+	 * remove oldest item from the queue (consumer thread only)
+	 * @returns false if the queue is empty
+	 */
+	bool pop(T *item) {
+		unsigned int tail = _tail.load(std::memory_order_relaxed);
+		if (tail == _head.load(std::memory_order_acquire)) return false;
+		*item = _buf[tail % N];
+		_tail.store(tail + 1, std::memory_order_release);	// release slot to producer
+		return true;
+	}
+
+	/**
+	 * @returns true if the queue is empty (approximate if called by the producer)
+	 */
+	bool empty(void) {
+		return _tail.load(std::memory_order_acquire) == _head.load(std::memory_order_acquire);
+	}
+
+private:
+	T _buf[N];
+	std::atomic<unsigned int> _head;	// written by producer
+	std::atomic<unsigned int> _tail;	// written by consumer
+};
+
+#endif /* SPSCQUEUE_H */
@@ -0,0 +1,463 @@
+/**
+ * @file tsstore.cpp
+ *
+ */
+
+/*********************
+ *      INCLUDES
+ *********************/
+#include <dirent.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include <algorithm>
+
+#include "tsstore.h"
+
+using namespace std;
+
+/*********************
+ *      DEFINES
+ *********************/
+#define TS_SEGMENT_MIN (sizeof(ts_segment_header) + sizeof(ts_block_header) + TS_BLOCK_BYTES)
+
+/*********************
+ * STATIC FUNCTIONS
+ *********************/
+
+static void put_varint(vector<uint8_t> &buf, int64_t value) {
+	uint64_t zz = ((uint64_t)value << 1) ^ (uint64_t)(value >> 63);		// zigzag
+	while (zz >= 0x80) {
+		buf.push_back((uint8_t)(zz | 0x80));
+		zz >>= 7;
+	}
+	buf.push_back((uint8_t)zz);
+}
+
+/**
+ * @returns bytes consumed, 0 if the varint is incomplete
+ */
+static int get_varint(const uint8_t *buf, const uint8_t *end, int64_t *value) {
+	uint64_t zz = 0;
+	int shift = 0;
+	const uint8_t *p = buf;
+
+	while ((p < end) && (shift < 64)) {
+		zz |= (uint64_t)(*p & 0x7F) << shift;
+		if ((*p++ & 0x80) == 0) {
+			*value = (int64_t)(zz >> 1) ^ -(int64_t)(zz & 1);
+			return (int)(p - buf);
+		}
+		shift += 7;
+	}
+	return 0;
+}
+
+static string segment_name(const string &dir, uint32_t sequence) {
+	char name[32];
+	snprintf(name, sizeof(name), "/ts-%06u.seg", sequence);
+	return dir + name;
+}
+
+/**
+ * @returns sequence number of a segment file name, 0 if it is not a segment
+ */
+static uint32_t segment_sequence(const char *fileName) {
+	unsigned int sequence = 0;
+	char tail[8];
+	if (sscanf(fileName, "ts-%u.%7s", &sequence, tail) != 2) return 0;
+	if (strcmp(tail, "seg") != 0) return 0;
+	return sequence;
+}
+
+/**
+ * read the header and the committed blocks of a segment
+ * @returns 0 on success, -1 if the file is not a segment
+ */
+static int read_segment(const char *fileName, ts_segment_header *header, vector<uint8_t> &data) {
+	FILE *fp = fopen(fileName, "rb");
+	bool ok;
+
+	if (fp == NULL) return -1;
+	ok = (fread(header, sizeof(*header), 1, fp) == 1) && (header->magic == TS_SEGMENT_MAGIC) &&
+		(header->version == TS_SEGMENT_VERSION) && (header->used >= sizeof(*header)) && (header->used <= header->size);
+	if (ok) {
+		data.resize(header->used - sizeof(*header));
+		ok = data.empty() || (fread(data.data(), data.size(), 1, fp) == 1);
+	}
+	fclose(fp);
+	return ok ? 0 : -1;
+}
+
+/*********************
+ * MEMBER FUNCTIONS
+ *********************/
+
+TSStore::TSStore() {
+	_segmentSize = 0;
+	_maxSegments = 0;
+	_sequence = 0;
+	_fd = -1;
+	_header = NULL;
+	_rotations = 0;
+}
+
+TSStore::~TSStore() {
+	close();
+}
+
+int TSStore::open(const char *dir, uint32_t segmentSize, int maxSegments) {
+	vector<string> files;
+
+	if (dir == NULL) return -1;
+	close();
+	_dir = dir;
+	_segmentSize = (segmentSize < TS_SEGMENT_MIN) ? TS_SEGMENT_MIN : segmentSize;
+	_maxSegments = (maxSegments < 1) ? 1 : maxSegments;
+	_rotations = 0;
+
+	segments(dir, files);
+	if (!files.empty()) {
+		_sequence = segment_sequence(basename(files.back().c_str()));
+		if (_open_segment(_sequence, false) == 0) return 0;		// continue in the newest segment
+	}
+	return _rotate();
+}
+
+void TSStore::close(void) {
+	if (_header != NULL) {
+		flush();
+		_close_segment();
+	}
+}
+
+int TSStore::addColumn(const char *name) {
+	ts_column col;
+	col.name = (name == NULL) ? "" : name;
+	if (col.name.length() >= TS_NAME_LEN) col.name.resize(TS_NAME_LEN - 1);
+	col.count = 0;
+	col.firstTime_ms = 0;
+	col.prevTime_ms = 0;
+	col.prevDelta_ms = 0;
+	col.prevBits = 0;
+	col.segmentTag = -1;
+	col.payload.reserve(TS_BLOCK_BYTES);
+	_columns.push_back(col);
+	return (int)_columns.size() - 1;
+}
+
+void TSStore::append(int column, const ts_sample &sample) {
+	int64_t time_ms = sample.time_ms;
+	float value = sample.value;
+	ts_column *col;
+	uint32_t bits, diff;
+	int64_t delta;
+	int trailing, length;
+
+	if ((_header == NULL) || (column < 0) || (column >= (int)_columns.size())) return;
+	col = &_columns[column];
+	if (col->count == 0) {
+		col->firstTime_ms = time_ms;
+		col->prevTime_ms = time_ms;
+		col->prevDelta_ms = 0;
+		col->prevBits = 0;
+	}
+
+	// time: delta of delta
+	delta = time_ms - col->prevTime_ms;
+	put_varint(col->payload, delta - col->prevDelta_ms);
+	col->prevDelta_ms = delta;
+	col->prevTime_ms = time_ms;
+
+	// value: XOR with the previous value, control byte (trailing zero bytes << 4 | length) and the bytes which differ
+	memcpy(&bits, &value, sizeof(bits));
+	diff = bits ^ col->prevBits;
+	col->prevBits = bits;
+	trailing = 0;
+	length = 0;
+	if (diff != 0) {
+		while ((diff & 0xFF) == 0) {
+			diff >>= 8;
+			trailing++;
+		}
+		for (uint32_t rest = diff; rest != 0; rest >>= 8) length++;
+	}
+	col->payload.push_back((uint8_t)((trailing << 4) | length));
+	for (int i = 0; i < length; i++) {
+		col->payload.push_back((uint8_t)(diff >> (8 * i)));
+	}
+	col->count++;
+
+	if ((col->count >= TS_BLOCK_SAMPLES) || (col->payload.size() + TS_SAMPLE_MAX_BYTES > TS_BLOCK_BYTES))
+		_write_block(col);
+}
+
+void TSStore::flush(void) {
+	bool written = false;
+
+	if (_header == NULL) return;
+	for (size_t index = 0; index < _columns.size(); index++) {
+		if (_columns[index].count == 0) continue;
+		_write_block(&_columns[index]);
+		written = true;
+	}
+	if (written) msync(_header, _segmentSize, MS_ASYNC);
+}
+
+unsigned long TSStore::buffered(void) {
+	unsigned long count = 0;
+	for (size_t index = 0; index < _columns.size(); index++) {
+		count += _columns[index].count;
+	}
+	return count;
+}
+
+/**
+ * append the open block of a column to the segment, rotate if the segment is full
+ * @returns 0 on success, -1 if the block was dropped
+ */
+int TSStore::_write_block(ts_column *col) {
+	ts_block_header block;
+	size_t blockSize = sizeof(block) + col->payload.size();
+	int retVal = -1;
+
+	if ((_header != NULL) && ((_header->used + blockSize > _header->size) || (_segment_tag(col) < 0))) {
+		if (_rotate() == 0) _segment_tag(col);
+	}
+	if ((_header != NULL) && (col->segmentTag >= 0) && (_header->used + blockSize <= _header->size)) {
+		block.tag = (uint16_t)col->segmentTag;
+		block.count = col->count;
+		block.length = (uint32_t)col->payload.size();
+		block.firstTime_ms = col->firstTime_ms;
+		block.lastTime_ms = col->prevTime_ms;
+		memcpy((char *)_header + _header->used, &block, sizeof(block));
+		memcpy((char *)_header + _header->used + sizeof(block), col->payload.data(), col->payload.size());
+		__sync_synchronize();			// block is complete before it becomes visible
+		if ((_header->firstTime_ms == 0) || (block.firstTime_ms < _header->firstTime_ms)) _header->firstTime_ms = block.firstTime_ms;
+		if (block.lastTime_ms > _header->lastTime_ms) _header->lastTime_ms = block.lastTime_ms;
+		_header->used += (uint32_t)blockSize;
+		retVal = 0;
+	}
+	col->payload.clear();
+	col->count = 0;
+	return retVal;
+}
+
+/**
+ * @returns index of the column name in the current segment, -1 if the name table is full
+ */
+int TSStore::_segment_tag(ts_column *col) {
+	if (col->segmentTag >= 0) return col->segmentTag;
+	for (int index = 0; index < _header->tagCount; index++) {
+		if (strncmp(_header->names[index], col->name.c_str(), TS_NAME_LEN) == 0) {
+			col->segmentTag = index;
+			return index;
+		}
+	}
+	if (_header->tagCount >= TS_SEGMENT_TAGS) return -1;
+	strncpy(_header->names[_header->tagCount], col->name.c_str(), TS_NAME_LEN - 1);
+	col->segmentTag = _header->tagCount++;
+	return col->segmentTag;
+}
+
+/**
+ * start the next segment and delete the oldest segments beyond the configured count
+ * @returns 0 on success, -1 on failure
+ */
+int TSStore::_rotate(void) {
+	vector<string> files;
+
+	if (_header != NULL) {
+		_close_segment();
+		_rotations++;
+	}
+	for (size_t index = 0; index < _columns.size(); index++) {
+		_columns[index].segmentTag = -1;
+	}
+	if (_open_segment(_sequence + 1, true) < 0) return -1;
+	_sequence++;
+
+	segments(_dir.c_str(), files);
+	for (size_t index = 0; index + _maxSegments < files.size(); index++) {
+		if (unlink(files[index].c_str()) != 0)
+			fprintf(stderr, "%s: unable to delete %s: %s\n", __func__, files[index].c_str(), strerror(errno));
+	}
+	return 0;
+}
+
+/**
+ * map a segment file
+ * @param create: create a new segment, otherwise the file must be a compatible segment
+ * @returns 0 on success, -1 on failure
+ */
+int TSStore::_open_segment(uint32_t sequence, bool create) {
+	string fileName = segment_name(_dir, sequence);
+	struct stat sb;
+	void *map;
+
+	_fd = ::open(fileName.c_str(), create ? (O_RDWR | O_CREAT | O_TRUNC) : O_RDWR, 0644);
+	if (_fd < 0) {
+		if (create) fprintf(stderr, "%s: unable to open %s: %s\n", __func__, fileName.c_str(), strerror(errno));
+		return -1;
+	}
+	if (create) {
+		if (ftruncate(_fd, _segmentSize) != 0) {
+			fprintf(stderr, "%s: unable to size %s: %s\n", __func__, fileName.c_str(), strerror(errno));
+			goto open_fail;
+		}
+	} else if ((fstat(_fd, &sb) != 0) || ((uint32_t)sb.st_size != _segmentSize)) {
+		goto open_fail;			// written with a different segment size
+	}
+
+	map = mmap(NULL, _segmentSize, PROT_READ | PROT_WRITE, MAP_SHARED, _fd, 0);
+	if (map == MAP_FAILED) {
+		fprintf(stderr, "%s: mmap %s failed: %s\n", __func__, fileName.c_str(), strerror(errno));
+		goto open_fail;
+	}
+	_header = (ts_segment_header *)map;
+	if (create) {
+		memset(_header, 0, sizeof(ts_segment_header));
+		_header->magic = TS_SEGMENT_MAGIC;
+		_header->version = TS_SEGMENT_VERSION;
+		_header->size = _segmentSize;
+		_header->used = sizeof(ts_segment_header);
+	} else if ((_header->magic != TS_SEGMENT_MAGIC) || (_header->version != TS_SEGMENT_VERSION) ||
+		(_header->size != _segmentSize) || (_header->used < sizeof(ts_segment_header)) || (_header->used > _segmentSize)) {
+		_close_segment();
+		return -1;
+	}
+	return 0;
+
+open_fail:
+	::close(_fd);
+	_fd = -1;
+	return -1;
+}
+
+void TSStore::_close_segment(void) {
+	if (_header != NULL) {
+		msync(_header, _segmentSize, MS_SYNC);
+		munmap(_header, _segmentSize);
+		_header = NULL;
+	}
+	if (_fd >= 0) {
+		::close(_fd);
+		_fd = -1;
+	}
+}
+
+/*********************
+ *  READ FUNCTIONS
+ *********************/
+
+void TSStore::segments(const char *dir, vector<string> &files) {
+	vector<uint32_t> sequences;
+	DIR *dp = opendir(dir);
+	struct dirent *entry;
+	uint32_t sequence;
+
+	files.clear();
+	if (dp == NULL) return;
+	while ((entry = readdir(dp)) != NULL) {
+		sequence = segment_sequence(entry->d_name);
+		if (sequence > 0) sequences.push_back(sequence);
+	}
+	closedir(dp);
+	sort(sequences.begin(), sequences.end());
+	for (size_t index = 0; index < sequences.size(); index++) {
+		files.push_back(segment_name(dir, sequences[index]));
+	}
+}
+
+int TSStore::decode(const ts_block_header *block, const uint8_t *payload, vector<ts_sample> &samples) {
+	const uint8_t *p = payload, *end = payload + block->length;
+	int64_t time_ms = block->firstTime_ms, delta = 0, dod;
+	uint32_t bits = 0, diff;
+	int used, trailing, length;
+	ts_sample sample;
+
+	for (int count = 0; count < block->count; count++) {
+		used = get_varint(p, end, &dod);
+		if (used == 0) return -1;
+		p += used;
+		delta += dod;
+		time_ms += delta;
+		if (p >= end) return -1;
+		trailing = *p >> 4;
+		length = *p++ & 0x0F;
+		if ((trailing + length > 4) || (p + length > end)) return -1;
+		diff = 0;
+		for (int i = 0; i < length; i++) {
+			diff |= (uint32_t)*p++ << (8 * i);
+		}
+		bits ^= diff << (8 * trailing);
+		sample.time_ms = time_ms;
+		memcpy(&sample.value, &bits, sizeof(bits));
+		samples.push_back(sample);
+	}
+	return block->count;
+}
+
+long TSStore::query(const char *dir, const char *name, int64_t from_ms, int64_t until_ms, vector<ts_sample> &samples) {
+	vector<string> files;
+	vector<uint8_t> data;
+	vector<ts_sample> blockSamples;
+	ts_segment_header header;
+	ts_block_header block;
+	size_t pos;
+	int tag;
+
+	samples.clear();
+	segments(dir, files);
+	if (files.empty()) return -1;
+	for (size_t index = 0; index < files.size(); index++) {
+		if (read_segment(files[index].c_str(), &header, data) < 0) continue;
+		if ((header.firstTime_ms > until_ms) || (header.lastTime_ms < from_ms)) continue;
+		tag = -1;
+		if (name != NULL) {
+			for (int i = 0; (i < header.tagCount) && (i < TS_SEGMENT_TAGS); i++) {
+				if (strncmp(header.names[i], name, TS_NAME_LEN) == 0) tag = i;
+			}
+			if (tag < 0) continue;
+		}
+		for (pos = 0; pos + sizeof(block) <= data.size(); pos += sizeof(block) + block.length) {
+			memcpy(&block, &data[pos], sizeof(block));
+			if (pos + sizeof(block) + block.length > data.size()) break;
+			if ((tag >= 0) && (block.tag != tag)) continue;
+			if ((block.firstTime_ms > until_ms) || (block.lastTime_ms < from_ms)) continue;
+			blockSamples.clear();
+			if (decode(&block, &data[pos + sizeof(block)], blockSamples) < 0) {
+				fprintf(stderr, "%s: corrupt block in %s\n", __func__, files[index].c_str());
+				continue;
+			}
+			for (size_t i = 0; i < blockSamples.size(); i++) {
+				if ((blockSamples[i].time_ms >= from_ms) && (blockSamples[i].time_ms <= until_ms))
+					samples.push_back(blockSamples[i]);
+			}
+		}
+	}
+	return (long)samples.size();
+}
+
+void TSStore::names(const char *dir, vector<string> &tagNames) {
+	vector<string> files;
+	vector<uint8_t> data;
+	ts_segment_header header;
+	string name;
+
+	tagNames.clear();
+	segments(dir, files);
+	for (size_t index = 0; index < files.size(); index++) {
+		if (read_segment(files[index].c_str(), &header, data) < 0) continue;
+		for (int i = 0; (i < header.tagCount) && (i < TS_SEGMENT_TAGS); i++) {
+			name.assign(header.names[i], strnlen(header.names[i], TS_NAME_LEN));
+			if (find(tagNames.begin(), tagNames.end(), name) == tagNames.end()) tagNames.push_back(name);
+		}
+	}
+}
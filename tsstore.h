@@ -0,0 +1,174 @@
+/**
+ * @file tsstore.h
+ *
+ -----------------------------------------------------------------------------
+  The TSStore class keeps a local history of tag values in append-only,
+  memory mapped segment files of fixed size. When a segment is full the
+  next one is started and the oldest segments beyond the configured count
+  are deleted.
+
+  Samples are collected per tag (column) in memory and compressed:
+  timestamps as zigzag varint delta-of-delta, values as XOR with the
+  previous value (float bits), trimmed to the bytes which differ.
+  A column is appended to the segment as one block when it is full or
+  when the store is flushed, so the SD card sees few, batched writes.
+  A block becomes visible to readers when the segment header is updated
+  after the block was written.
+
+  File layout: ts_segment_header, blocks (ts_block_header, payload)
+  File names: <dir>/ts-<sequence>.seg
+
+ -----------------------------------------------------------------------------
+ */
+
+#ifndef TSSTORE_H
+#define TSSTORE_H
+
+#include <stdint.h>
+#include <time.h>
+
+#include <string>
+#include <vector>
+
+#define TS_SEGMENT_MAGIC 0x53544C50		// "PLTS"
+#define TS_SEGMENT_VERSION 1
+#define TS_SEGMENT_TAGS 128				// tag names per segment
+#define TS_NAME_LEN 64					// max tag name length incl. terminator
+#define TS_BLOCK_SAMPLES 1024			// max samples per block
+#define TS_BLOCK_BYTES 4096				// max payload bytes per block
+#define TS_SAMPLE_MAX_BYTES 15			// worst case: 10 bytes time + 5 bytes value
+
+/**
+ * segment header, located at the start of each segment file
+ */
+struct ts_segment_header {
+	uint32_t magic;
+	uint16_t version;
+	uint16_t tagCount;					// names in use
+	uint32_t size;						// file size
+	uint32_t used;						// bytes in use including the header, committed blocks only
+	int64_t firstTime_ms;				// oldest sample in the segment, 0 = empty
+	int64_t lastTime_ms;				// newest sample in the segment
+	char names[TS_SEGMENT_TAGS][TS_NAME_LEN];
+};
+
+/**
+ * block header, followed by the compressed samples of one tag
+ */
+struct ts_block_header {
+	uint16_t tag;						// index into the segment names
+	uint16_t count;						// number of samples
+	uint32_t length;					// payload bytes
+	int64_t firstTime_ms;
+	int64_t lastTime_ms;
+};
+
+struct ts_sample {
+	int64_t time_ms;					// wall clock time [ms]
+	float value;
+};
+
+class TSStore {
+public:
+	TSStore();
+	~TSStore();
+
+	/**
+	 * open the store, appending continues in the newest segment if it is compatible
+	 * @param dir: directory of the segment files, must exist
+	 * @param segmentSize: segment file size [bytes]
+	 * @param maxSegments: number of segments kept
+	 * @returns 0 on success, -1 on failure
+	 */
+	int open(const char *dir, uint32_t segmentSize, int maxSegments);
+
+	/**
+	 * flush all columns, sync and unmap the segment
+	 */
+	void close(void);
+
+	/**
+	 * @returns true if the store is open
+	 */
+	bool isOpen(void) { return _header != NULL; }
+
+	/**
+	 * add a column
+	 * @param name: tag name (topic), truncated to TS_NAME_LEN - 1
+	 * @returns column index, columns are numbered in the order they are added
+	 */
+	int addColumn(const char *name);
+
+	/**
+	 * add a sample to a column, the column is written to the segment when it is full
+	 */
+	void append(int column, const ts_sample &sample);
+
+	/**
+	 * write all columns which hold samples to the segment and schedule write back
+	 */
+	void flush(void);
+
+	/**
+	 * @returns number of samples which are not written to a segment yet
+	 */
+	unsigned long buffered(void);
+
+	/**
+	 * @returns number of segment files written (rotations)
+	 */
+	unsigned long rotations(void) { return _rotations; }
+
+	/**
+	 * list the segment files of a store, oldest first
+	 */
+	static void segments(const char *dir, std::vector<std::string> &files);
+
+	/**
+	 * read the samples of a tag from all segments
+	 * @param name: tag name, NULL for all tags (samples are then not in time order)
+	 * @param from_ms, until_ms: time range, inclusive
+	 * @returns number of samples, -1 if the store can't be read
+	 */
+	static long query(const char *dir, const char *name, int64_t from_ms, int64_t until_ms, std::vector<ts_sample> &samples);
+
+	/**
+	 * get all tag names stored in the segments
+	 */
+	static void names(const char *dir, std::vector<std::string> &names);
+
+	/**
+	 * decode the payload of a block
+	 * @returns number of samples decoded, -1 if the payload is corrupt
+	 */
+	static int decode(const ts_block_header *block, const uint8_t *payload, std::vector<ts_sample> &samples);
+
+private:
+	struct ts_column {
+		std::string name;
+		std::vector<uint8_t> payload;		// compressed samples of the open block
+		uint16_t count;
+		int64_t firstTime_ms;
+		int64_t prevTime_ms;
+		int64_t prevDelta_ms;
+		uint32_t prevBits;
+		int segmentTag;						// index in the current segment names, -1 = not yet
+	};
+
+	int _write_block(ts_column *col);
+	int _open_segment(uint32_t sequence, bool create);
+	void _close_segment(void);
+	int _rotate(void);
+	int _segment_tag(ts_column *col);
+
+	std::string _dir;
+	uint32_t _segmentSize;
+	int _maxSegments;
+	uint32_t _sequence;					// sequence number of the current segment
+	int _fd;
+	ts_segment_header *_header;			// mapped segment
+	std::vector<ts_column> _columns;
+	unsigned long _rotations;
+};
+
+#endif /* TSSTORE_H */
@@ -0,0 +1,169 @@
+/**
+ * @file txrecorder.cpp
+ *
+ */
+
+/*********************
+ *      INCLUDES
+ *********************/
+#include <errno.h>
+#include <fcntl.h>
+#include <limits.h>
+#include <stdio.h>
+#include <string.h>
+#include <sys/stat.h>
+#include <time.h>
+#include <unistd.h>
+
+#include "txrecorder.h"
+
+using namespace std;
+
+/*********************
+ *      DEFINES
+ *********************/
+#define TX_WRITE_BATCH 256				// records per write() call
+#define TX_WRITE_INTERVAL_US 200000		// writer thread wakeup interval
+
+/*********************
+ * MEMBER FUNCTIONS
+ *********************/
+
+TxRecorder::TxRecorder() {
+	_maxSize = 0;
+	_maxFiles = 0;
+	_fd = -1;
+	_fileSize = 0;
+	_running = false;
+	_dropped = 0;
+}
+
+TxRecorder::~TxRecorder() {
+	close();
+}
+
+int TxRecorder::open(const char *fileName, long maxSize, int maxFiles) {
+	struct stat sb;
+
+	if (fileName == NULL) return -1;
+	close();
+	_fileName = fileName;
+	_maxSize = (maxSize < (long)(sizeof(tx_log_header) + sizeof(tx_record))) ? (long)(sizeof(tx_log_header) + sizeof(tx_record)) : maxSize;
+	_maxFiles = (maxFiles < 0) ? 0 : maxFiles;
+	// the header's clock pair is only valid for this session (CLOCK_MONOTONIC restarts on reboot)
+	if ((stat(_fileName.c_str(), &sb) == 0) && (sb.st_size > 0)) _shift();
+	if (_open_file() < 0) return -1;
+	_running = true;
+	_thread = std::thread(&TxRecorder::_writer, this);
+	return 0;
+}
+
+void TxRecorder::close(void) {
+	if (_running) {
+		_running = false;
+		_thread.join();			// writer drains the queue before it exits
+	}
+	if (_fd >= 0) {
+		::close(_fd);
+		_fd = -1;
+	}
+}
+
+void TxRecorder::record(const tx_record &rec) {
+	if (!_running) return;
+	if (!_queue.push(rec)) _dropped++;
+}
+
+unsigned long TxRecorder::dropped(void) {
+	return _dropped;
+}
+
+/**
+ * writer thread, writes queued records in batches
+ */
+void TxRecorder::_writer(void) {
+	tx_record batch[TX_WRITE_BATCH];
+	int count;
+	bool running;
+
+	do {
+		running = _running;		// read before draining, so nothing queued before close() is lost
+		do {
+			count = 0;
+			while ((count < TX_WRITE_BATCH) && _queue.pop(&batch[count])) count++;
+			if (count == 0) break;
+			if ((_fileSize > (long)sizeof(tx_log_header)) && (_fileSize + (long)(count * sizeof(tx_record)) > _maxSize)) _rotate();
+			if (_fd < 0) {				// rotation failed, records are lost
+				_dropped += count;
+				continue;
+			}
+			if (write(_fd, batch, count * sizeof(tx_record)) != (ssize_t)(count * sizeof(tx_record))) {
+				fprintf(stderr, "%s: write %s failed: %s\n", __func__, _fileName.c_str(), strerror(errno));
+				_dropped += count;
+			} else {
+				_fileSize += count * sizeof(tx_record);
+			}
+		} while (count == TX_WRITE_BATCH);
+		if (running) usleep(TX_WRITE_INTERVAL_US);
+	} while (running);
+}
+
+/**
+ * start a new log file with a header for this session
+ * @returns 0 on success, -1 on failure
+ */
+int TxRecorder::_open_file(void) {
+	struct timespec rt, mt;
+	tx_log_header header;
+
+	_fd = ::open(_fileName.c_str(), O_WRONLY | O_CREAT | O_TRUNC | O_CLOEXEC, 0644);
+	if (_fd < 0) {
+		fprintf(stderr, "%s: unable to open %s: %s\n", __func__, _fileName.c_str(), strerror(errno));
+		return -1;
+	}
+
+	clock_gettime(CLOCK_REALTIME, &rt);
+	clock_gettime(CLOCK_MONOTONIC, &mt);
+	memset(&header, 0, sizeof(header));
+	header.magic = TX_LOG_MAGIC;
+	header.version = TX_LOG_VERSION;
+	header.recordSize = sizeof(tx_record);
+	header.realtime_us = ((int64_t)rt.tv_sec * 1000000) + (rt.tv_nsec / 1000);
+	header.monotonic_us = ((int64_t)mt.tv_sec * 1000000) + (mt.tv_nsec / 1000);
+	if (write(_fd, &header, sizeof(header)) != sizeof(header)) {
+		fprintf(stderr, "%s: write %s failed: %s\n", __func__, _fileName.c_str(), strerror(errno));
+		::close(_fd);
+		_fd = -1;
+		return -1;
+	}
+	_fileSize = sizeof(header);
+	return 0;
+}
+
+/**
+ * close the file and start a new one
+ */
+void TxRecorder::_rotate(void) {
+	if (_fd >= 0) {
+		::close(_fd);
+		_fd = -1;
+	}
+	_shift();
+	_fileSize = 0;				// no further rotation if the new file can't be opened
+	_open_file();
+}
+
+/**
+ * rename file -> file.1 -> file.2 ..., the oldest file is removed
+ */
+void TxRecorder::_shift(void) {
+	char from[PATH_MAX], to[PATH_MAX];
+
+	for (int i = _maxFiles; i > 0; i--) {
+		if (i == 1) snprintf(from, sizeof(from), "%s", _fileName.c_str());
+		else snprintf(from, sizeof(from), "%s.%d", _fileName.c_str(), i - 1);
+		snprintf(to, sizeof(to), "%s.%d", _fileName.c_str(), i);
+		rename(from, to);
+	}
+	if (_maxFiles == 0) unlink(_fileName.c_str());
+}
@@ -0,0 +1,113 @@
+/**
+ * @file txrecorder.h
+ *
+ -----------------------------------------------------------------------------
+  The TxRecorder class writes every PL serial transaction into a compact
+  append-only binary log. record() only copies the transaction into a
+  preallocated lock-free queue, a background thread writes the records in
+  batches. The log is rotated by size (file, file.1 ... file.N) and at
+  every open, so each file holds records of one session only.
+
+  File layout: tx_log_header followed by tx_record entries.
+  Use plxx_txdump to print a log file as text.
+
+ -----------------------------------------------------------------------------
+ */
+
+#ifndef TXRECORDER_H
+#define TXRECORDER_H
+
+#include <stdint.h>
+
+#include <atomic>
+#include <string>
+#include <thread>
+
+#include "spscqueue.h"
+
+#define TX_LOG_MAGIC 0x58544C50			// "PLTX"
+#define TX_LOG_VERSION 1
+#define TX_QUEUE_SIZE 4096				// records waiting for the writer thread
+#define TX_REPLY_MAX 4					// reply bytes stored per record
+
+// transaction error codes
+#define TX_OK 0
+#define TX_ERR_WRITE -1					// request could not be sent
+#define TX_ERR_TIMEOUT -2				// no (complete) reply within timeout
+#define TX_ERR_REPLY -3					// reply did not start with 200
+#define TX_ERR_READ -4					// read or select/poll error
+
+/**
+ * log file header, written at the start of every file
+ */
+struct tx_log_header {
+	uint32_t magic;
+	uint16_t version;
+	uint16_t recordSize;				// sizeof(tx_record)
+	int64_t realtime_us;				// wall clock time at monotonic_us, to convert timestamps
+	int64_t monotonic_us;
+};
+
+/**
+ * a single transaction (24 bytes)
+ */
+struct tx_record {
+	int64_t sendTime_us;				// CLOCK_MONOTONIC when the request was sent
+	uint32_t recvDelta_us;				// reply received after send, 0 = no reply
+	uint8_t cmd;						// PL command
+	uint8_t address;
+	uint8_t value;						// value written (write commands)
+	uint8_t replyLen;					// number of reply bytes received
+	uint8_t reply[TX_REPLY_MAX];		// first reply bytes
+	int16_t error;						// TX_OK or TX_ERR_xxx
+	uint16_t reserved;
+};
+
+class TxRecorder {
+public:
+	TxRecorder();
+	~TxRecorder();
+
+	/**
+	 * open the log file and start the writer thread
+	 * @param fileName: log file, rotated files get the suffix .1 .. .N
+	 * @param maxSize: rotate when the file exceeds this size [bytes]
+	 * @param maxFiles: number of rotated files kept
+	 * @returns 0 on success, -1 on failure
+	 */
+	int open(const char *fileName, long maxSize, int maxFiles);
+
+	/**
+	 * stop the writer thread after all queued records are written
+	 */
+	void close(void);
+
+	/**
+	 * queue a transaction for writing, never blocks
+	 * must be called from a single thread
+	 */
+	void record(const tx_record &rec);
+
+	/**
+	 * @returns number of records lost because the queue was full or the file could not be written
+	 */
+	unsigned long dropped(void);
+
+private:
+	void _writer(void);
+	int _open_file(void);
+	void _rotate(void);
+	void _shift(void);
+
+	std::string _fileName;
+	long _maxSize;
+	int _maxFiles;
+	int _fd;
+	long _fileSize;
+	SpscQueue<tx_record, TX_QUEUE_SIZE> _queue;
+	std::thread _thread;
+	std::atomic<bool> _running;
+	std::atomic<unsigned long> _dropped;
+};
+
+#endif /* TXRECORDER_H */
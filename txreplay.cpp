@@ -0,0 +1,169 @@
+/**
+ * @file txreplay.cpp
+ *
+ */
+
+/*********************
+ *      INCLUDES
+ *********************/
+#include <errno.h>
+#include <stdio.h>
+#include <string.h>
+#include <unistd.h>
+
+#include "txreplay.h"
+
+using namespace std;
+
+/*********************
+ *      DEFINES
+ *********************/
+#define TX_REPLAY_SKEW_US 1000000		// records older than this are skipped as not requested
+
+/*********************
+ * MEMBER FUNCTIONS
+ *********************/
+
+TxReplay::TxReplay() {
+	memset(&_header, 0, sizeof(_header));
+	_cursor = 0;
+	_open = false;
+	_speed = 0;
+	_fastClock_us = 0;
+	_startClock_us = 0;
+	_startReal_us = 0;
+	_served = 0;
+	_mismatches = 0;
+	for (int i = 0; i < 256; i++) _lastValue[i] = -1;
+}
+
+TxReplay::~TxReplay() {
+}
+
+long TxReplay::open(const char *fileName, double speed) {
+	FILE *fp;
+	tx_record rec;
+	struct timespec now;
+
+	if (fileName == NULL) return -1;
+	fp = fopen(fileName, "rb");
+	if (fp == NULL) {
+		fprintf(stderr, "%s: unable to open %s: %s\n", __func__, fileName, strerror(errno));
+		return -1;
+	}
+	if ((fread(&_header, sizeof(_header), 1, fp) != 1) || (_header.magic != TX_LOG_MAGIC) ||
+		(_header.version != TX_LOG_VERSION) || (_header.recordSize != sizeof(tx_record))) {
+		fprintf(stderr, "%s: %s is not a transaction log\n", __func__, fileName);
+		fclose(fp);
+		return -1;
+	}
+	_records.clear();
+	while (fread(&rec, sizeof(rec), 1, fp) == 1) {
+		_records.push_back(rec);
+	}
+	fclose(fp);
+	if (_records.empty()) {
+		fprintf(stderr, "%s: %s has no transactions\n", __func__, fileName);
+		return -1;
+	}
+
+	_cursor = 0;
+	_speed = speed;
+	_startClock_us = _records[0].sendTime_us;
+	_fastClock_us = _startClock_us;
+	clock_gettime(CLOCK_MONOTONIC, &now);
+	_startReal_us = ((int64_t)now.tv_sec * 1000000) + (now.tv_nsec / 1000);
+	_served = 0;
+	_mismatches = 0;
+	for (int i = 0; i < 256; i++) _lastValue[i] = -1;
+	_open = true;
+	return (long)_records.size();
+}
+
+int TxReplay::transaction(uint8_t cmd, uint8_t address, uint8_t value, uint8_t *reply) {
+	size_t index, end;
+	tx_record *rec;
+	(void)value;
+
+	if (!_open) return TX_ERR_READ;
+	_seek(_clock() - TX_REPLAY_SKEW_US);
+
+	end = _cursor + TX_REPLAY_SEARCH;
+	if (end > _records.size()) end = _records.size();
+	for (index = _cursor; index < end; index++) {
+		if ((_records[index].cmd == cmd) && (_records[index].address == address)) break;
+	}
+
+	if (index >= end) {
+		// not in the recording, answer with the last value seen
+		_mismatches++;
+		if (_lastValue[address] < 0) return TX_ERR_TIMEOUT;
+		if (reply != NULL) *reply = (uint8_t)_lastValue[address];
+		return TX_OK;
+	}
+
+	rec = &_records[index];
+	_seek(rec->sendTime_us + 1);		// skipped records still update the last values
+	_cursor = index + 1;
+	if (fast()) {
+		if (rec->sendTime_us + rec->recvDelta_us > _fastClock_us) _fastClock_us = rec->sendTime_us + rec->recvDelta_us;
+	} else {
+		_wait(rec->sendTime_us + rec->recvDelta_us);
+	}
+	_served++;
+	if ((rec->error == TX_OK) && (rec->replyLen >= 2) && (reply != NULL)) *reply = rec->reply[1];
+	return rec->error;
+}
+
+void TxReplay::advance(unsigned int us) {
+	if (fast()) _fastClock_us += us;
+}
+
+time_t TxReplay::now(void) {
+	return (time_t)((_header.realtime_us + (_clock() - _header.monotonic_us)) / 1000000);
+}
+
+int64_t TxReplay::now_ms(void) {
+	return (_header.realtime_us + (_clock() - _header.monotonic_us)) / 1000;
+}
+
+double TxReplay::recordedDuration(void) {
+	if (_records.empty()) return 0;
+	return (_records.back().sendTime_us - _records.front().sendTime_us) / 1000000.0;
+}
+
+/**
+ * @returns the replay clock in the time base of the recording [us]
+ */
+int64_t TxReplay::_clock(void) {
+	struct timespec now;
+	int64_t real_us;
+
+	if (fast()) return _fastClock_us;
+	clock_gettime(CLOCK_MONOTONIC, &now);
+	real_us = ((int64_t)now.tv_sec * 1000000) + (now.tv_nsec / 1000);
+	return _startClock_us + (int64_t)((real_us - _startReal_us) * _speed);
+}
+
+/**
+ * move the replay position past all records sent before clock_us
+ * read replies of the skipped records update the last values
+ */
+void TxReplay::_seek(int64_t clock_us) {
+	tx_record *rec;
+
+	while ((_cursor < _records.size()) && (_records[_cursor].sendTime_us < clock_us)) {
+		rec = &_records[_cursor];
+		if ((rec->error == TX_OK) && (rec->replyLen >= 2) && (rec->reply[0] == 200))
+			_lastValue[rec->address] = rec->reply[1];
+		_cursor++;
+	}
+}
+
+/**
+ * timed replay: sleep until the replay clock reaches clock_us
+ */
+void TxReplay::_wait(int64_t clock_us) {
+	int64_t ahead_us = clock_us - _clock();
+	if (ahead_us > 0) usleep((useconds_t)(ahead_us / _speed));
+}
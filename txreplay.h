@@ -0,0 +1,107 @@
+/**
+ * @file txreplay.h
+ *
+ -----------------------------------------------------------------------------
+  The TxReplay class serves PL transactions from a log written by TxRecorder
+  in place of the serial port. Requests are matched against the recording
+  in order (command and address), the recorded reply or error is returned.
+  A request which has no match close to the replay position is answered
+  with the last value recorded for the address.
+
+  Replay runs with the recorded timing (optionally scaled) or as fast as
+  possible. The replay clock follows the recording, so a scheduler which
+  uses now() sees the same time line as the recorded session.
+
+ -----------------------------------------------------------------------------
+ */
+
+#ifndef TXREPLAY_H
+#define TXREPLAY_H
+
+#include <stdint.h>
+#include <time.h>
+
+#include <string>
+#include <vector>
+
+#include "txrecorder.h"
+
+#define TX_REPLAY_SEARCH 64			// records searched ahead of the replay position
+
+class TxReplay {
+public:
+	TxReplay();
+	~TxReplay();
+
+	/**
+	 * load a transaction log
+	 * @param speed: 0 = as fast as possible, 1 = recorded timing, 2 = twice as fast ...
+	 * @returns number of records loaded, -1 on failure
+	 */
+	long open(const char *fileName, double speed);
+
+	/**
+	 * @returns true if a recording is loaded
+	 */
+	bool isOpen(void) { return _open; }
+
+	/**
+	 * @returns true if all recorded transactions have been replayed
+	 */
+	bool finished(void) { return _cursor >= _records.size(); }
+
+	/**
+	 * @returns true if replaying as fast as possible
+	 */
+	bool fast(void) { return _speed <= 0; }
+
+	/**
+	 * replay a single transaction
+	 * @param value: value written (write commands)
+	 * @param reply: receives the reply value (read commands)
+	 * @returns TX_OK or TX_ERR_xxx as recorded
+	 */
+	int transaction(uint8_t cmd, uint8_t address, uint8_t value, uint8_t *reply);
+
+	/**
+	 * advance the clock while there is no transaction (fast replay only)
+	 */
+	void advance(unsigned int us);
+
+	/**
+	 * @returns wall clock time of the recording at the replay position
+	 */
+	time_t now(void);
+
+	/**
+	 * @returns wall clock time of the recording at the replay position [ms]
+	 */
+	int64_t now_ms(void);
+
+	unsigned long served(void) { return _served; }
+	unsigned long mismatches(void) { return _mismatches; }
+
+	/**
+	 * @returns duration of the recording [s]
+	 */
+	double recordedDuration(void);
+
+private:
+	int64_t _clock(void);
+	void _seek(int64_t clock_us);
+	void _wait(int64_t clock_us);
+
+	std::vector<tx_record> _records;
+	size_t _cursor;					// next record to replay
+	tx_log_header _header;
+	bool _open;
+	double _speed;
+	int64_t _fastClock_us;			// replay clock in fast mode (recording time base)
+	int64_t _startClock_us;			// recording time of the first record
+	int64_t _startReal_us;			// CLOCK_MONOTONIC when the timed replay started
+	int16_t _lastValue[256];		// last value read per address, -1 = none
+	unsigned long _served;
+	unsigned long _mismatches;		// requests without a matching record
+};
+
+#endif /* TXREPLAY_H */